@@ -0,0 +1,58 @@
+#include "regex/regex.hpp"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+
+/** serial vs parallel RegexNFA::compile() on a union of keyword and identifier patterns */
+int main(int argc, char** argv)
+{
+    const size_t npatterns = argc > 1 ? stoul(argv[1]) : 400;
+    const size_t rounds = 3;
+    mt19937 generator(2024);
+    uniform_int_distribution<int> letter('a', 'z'), length(3, 10);
+
+    vector<string> patterns;
+    for (size_t i = 0; i < npatterns; i++) {
+        string word;
+        for (int n = length(generator); n > 0; n--)
+            word.push_back(letter(generator));
+        if (i % 4 == 0) {
+            patterns.push_back(word + "_[a-zA-Z0-9_]*");
+        } else {
+            patterns.push_back(word);
+        }
+    }
+
+    vector<RegexNFA<char>> nfas;
+    for (auto& re : patterns)
+        nfas.push_back(NodeNFA<char>::from_regex(vector<char>(re.begin(), re.end())).toRegexNFA());
+    const auto nfa = RegexNFA<char>::tagged_union(nfas);
+
+    const auto measure = [&](size_t threads) {
+        double best = 0;
+        size_t states = 0;
+        for (size_t i = 0; i < rounds; i++) {
+            const auto begin = chrono::steady_clock::now();
+            states = nfa.compile(threads).state_count();
+            const auto end = chrono::steady_clock::now();
+            const auto ms = chrono::duration<double, milli>(end - begin).count();
+            best = i == 0 ? ms : min(best, ms);
+        }
+        cout << threads << " thread(s): " << best << " ms, " << states << " states" << endl;
+        return best;
+    };
+
+    cout << patterns.size() << " patterns, " << nfa.transitions().size() << " NFA states" << endl;
+    const auto serial = measure(1);
+    const size_t hardware = max(2u, thread::hardware_concurrency());
+    for (size_t threads = 2; threads <= hardware; threads *= 2) {
+        const auto parallel = measure(threads);
+        cout << "    speedup " << serial / parallel << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,36 @@
+#include "regex/regex.hpp"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+/** time to build a minimized DFA for counted repetitions with large bounds */
+int main(int argc, char** argv)
+{
+    vector<string> patterns = {
+        "x{1,1000}",
+        "x{1,20000}",
+        "x{20000}",
+        "x{500,}",
+        "(ab|cd){1,5000}",
+        "[0-9a-fA-F]{1,3000}",
+        "[a-z]{3000,6000}",
+        "(\\\\u[0-9a-fA-F]{4}|\\\\U[0-9a-fA-F]{8}){1,500}",
+    };
+    if (argc > 1)
+        patterns.assign(argv + 1, argv + argc);
+
+    for (auto& re : patterns) {
+        const auto begin = chrono::steady_clock::now();
+        auto nfa = NodeNFA<char>::from_regex(vector<char>(re.begin(), re.end())).toRegexNFA();
+        auto dfa = nfa.compile();
+        dfa.optimize();
+        const auto end = chrono::steady_clock::now();
+        cout << re << ": " << chrono::duration<double, milli>(end - begin).count() << " ms, "
+             << nfa.transitions().size() << " NFA states, " << dfa.state_count() << " DFA states"
+             << endl;
+    }
+    return 0;
+}
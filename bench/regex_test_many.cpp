@@ -0,0 +1,56 @@
+#include "regex/regex.hpp"
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+using namespace std;
+
+
+/** validating many short identifiers one by one and in one test_many() call */
+int main(int argc, char** argv)
+{
+    const string re = argc > 1 ? argv[1] : "[a-zA-Z_][a-zA-Z0-9_]*";
+    const size_t count = argc > 2 ? stoul(argv[2]) : 1000000;
+    DFAMatcher<char> matcher(vector<char>(re.begin(), re.end()));
+
+    const string alphabet = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_";
+    const vector<pair<int, int>> lengths = {{1, 8}, {1, 16}, {16, 16}, {1, 64}, {64, 64}};
+    for (auto [min_length, max_length] : lengths) {
+        std::default_random_engine generator(1);
+        std::uniform_int_distribution<int> length(min_length, max_length);
+        std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+        string text;
+        vector<size_t> offsets = {0};
+        for (size_t i = 0; i < count; i++) {
+            for (int k = length(generator); k > 0; k--)
+                text.push_back(alphabet[pick(generator)]);
+            offsets.push_back(text.size());
+        }
+        vector<string_view> views;
+        for (size_t i = 0; i < count; i++)
+            views.emplace_back(text.data() + offsets[i], offsets[i + 1] - offsets[i]);
+
+        auto begin = chrono::steady_clock::now();
+        size_t one_by_one = 0;
+        for (auto str : views)
+            one_by_one += matcher.test(str.begin(), str.end());
+        auto end = chrono::steady_clock::now();
+        const auto single_ms = chrono::duration<double, milli>(end - begin).count();
+
+        begin = chrono::steady_clock::now();
+        auto result = matcher.test_many(views);
+        end = chrono::steady_clock::now();
+        const auto batch_ms = chrono::duration<double, milli>(end - begin).count();
+        size_t batched = 0;
+        for (bool r : result)
+            batched += r;
+
+        cout << re << ", length " << min_length << "-" << max_length << ": test " << single_ms
+             << " ms, test_many " << batch_ms << " ms" << endl;
+        if (one_by_one != batched)
+            return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "lexer/lexer.hpp"
+#include "lexer/lexer_rule_regex.hpp"
+#include "lexer/token_arena.hpp"
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+using namespace std;
+
+
+struct TokenWord : public LexerToken
+{
+    TokenWord(TextRange range) : LexerToken(range)
+    {}
+};
+struct TokenPunc : public LexerToken
+{
+    TokenPunc(TextRange range) : LexerToken(range)
+    {}
+};
+
+static unique_ptr<Lexer<char>> make_lexer()
+{
+    auto lexer = make_unique<Lexer<char>>();
+    (*lexer)(make_unique<LexerRuleRegex<char>>(
+        "[a-z_][a-z0-9_]*", [](auto, auto info) { return make_token<TokenWord>(info); }));
+    (*lexer)(make_unique<LexerRuleRegex<char>>(
+        "[(){};=*+,]", [](auto, auto info) { return make_token<TokenPunc>(info); }));
+    (*lexer)(make_unique<LexerRuleRegex<char>>("[ \n]+", [](auto, auto) { return nullptr; }));
+    lexer->combine_rules();
+    lexer->reset();
+    return lexer;
+}
+
+/**
+ * lex @text holding every token like a parser stack would, then make as many
+ * tokens without the lexer. each mode runs in a fresh process, peak RSS is
+ * per process.
+ */
+static void measure(const string& text, bool arena, size_t rounds)
+{
+    if (fork() != 0) {
+        wait(nullptr);
+        return;
+    }
+
+    auto lexer = make_lexer();
+    double lex_ms = 0, make_ms = 0;
+    size_t ntokens = 0;
+    const auto time = [&](double& best, size_t round, auto fn) {
+        auto unit = make_unique<TokenArena>();
+        optional<TokenArena::Scope> scope;
+        if (arena)
+            scope.emplace(*unit);
+        vector<shared_ptr<LexerToken>> tokens;
+        const auto begin = chrono::steady_clock::now();
+        fn(tokens);
+        tokens.clear();
+        const auto end = chrono::steady_clock::now();
+        const auto ms = chrono::duration<double, milli>(end - begin).count();
+        best = round == 0 ? ms : min(best, ms);
+    };
+    for (size_t i = 0; i < rounds; i++) {
+        time(lex_ms, i, [&](auto& tokens) {
+            TokenBufferSink sink(tokens);
+            lexer->reset();
+            lexer->feed(span<const char>(text), sink);
+            lexer->feed_end(sink);
+            // drop the last token the lexer keeps, it would pin the arena
+            lexer->reset();
+            ntokens = tokens.size();
+        });
+        time(make_ms, i, [&](auto& tokens) {
+            for (size_t k = 0; k < ntokens; k++)
+                tokens.push_back(make_token<TokenPunc>(TextRange(k, k + 1)));
+        });
+    }
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    cout << (arena ? "arena" : "heap") << ": " << ntokens << " tokens, peak RSS "
+         << usage.ru_maxrss / 1024 << " MB" << endl;
+    cout << "    lex  " << lex_ms << " ms, " << ntokens / lex_ms / 1000 << " M tokens/s" << endl;
+    cout << "    make " << make_ms << " ms, " << ntokens / make_ms / 1000 << " M tokens/s" << endl;
+    exit(0);
+}
+
+/** lexing with tokens from make_shared() vs from a TokenArena */
+int main(int argc, char** argv)
+{
+    const size_t lines = argc > 1 ? stoul(argv[1]) : 100000;
+    const size_t rounds = argc > 2 ? stoul(argv[2]) : 3;
+    string text;
+    for (size_t i = 0; i < lines; i++)
+        text += "int f" + to_string(i) + "(a, b) { x = a * b + c; return (x); }\n";
+
+    measure(text, false, rounds);
+    measure(text, true, rounds);
+    return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef _C_PARSER_GENERATED_LEXER_H_
+#define _C_PARSER_GENERATED_LEXER_H_
+
+#include "lexer/simple_lexer.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace cparser {
+
+/**
+ * C lexer compiled ahead of time by c_scanner_gen, yields the same tokens as
+ * CLexerUTF8 without building any automaton at runtime. defined in the
+ * cparser_scanner library.
+ */
+std::unique_ptr<ISimpleLexer> make_generated_lexer(const std::string& utf8_text);
+
+} // namespace cparser
+#endif // _C_PARSER_GENERATED_LEXER_H_
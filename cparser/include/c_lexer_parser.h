@@ -4,6 +4,9 @@
 #include "./c_ast.h"
 #include "./c_parser.h"
 #include "./c_token.h"
+#include "lexer/token_arena.hpp"
+#include <memory>
+#include <span>
 
 namespace cparser {
 
@@ -12,13 +15,21 @@ class CLexerParser
   private:
     CParser parser;
     CLexerUTF8 lexer;
+    // tokens of the current translation unit, a new one per reset()
+    std::unique_ptr<TokenArena> arena;
+
+    void reset_parser();
 
   public:
     CLexerParser();
 
     void feed(char c);
+    /** feed the utf-8 bytes of @text */
+    void feed(std::span<const char> text);
     std::shared_ptr<ASTNodeTranslationUnit> end();
     void reset();
+    /** parse the utf-8 text of @source, positions are reported against it */
+    void reset(std::shared_ptr<BufferTextInfo> source);
     void setDebugStream(std::ostream& os);
 };
 
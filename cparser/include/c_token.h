@@ -2,8 +2,12 @@
 #define _C_PARSER_TOKEN_H_
 
 #include "dcutf8.h"
+#include "lexer/incremental_lexer.hpp"
+#include "lexer/scanner_codegen.hpp"
 #include "lexer/simple_lexer.hpp"
 #include "lexer/token.h"
+#include "lexer/token_sink.hpp"
+#include <span>
 #include <string>
 
 
@@ -167,14 +171,38 @@ class CLexer : private Lexer<int>
   public:
     using token_t = std::shared_ptr<LexerToken>;
     using encoder_t = Lexer<int>::encoder_t;
+    using token_factory_t = token_t (*)(std::span<const int> str, TextRange info);
 
   public:
-    CLexer(encoder_t encoder);
+    /** @automaton_cache, when not empty, is a file caching the combined rule automaton */
+    CLexer(encoder_t encoder, const std::string& automaton_cache = "");
+
+    /** token factories of the C rules, indexed like the rules of scanner_source() */
+    static std::vector<token_factory_t> token_factories();
+    /** C++ source of a scanner compiled ahead of time from the C rules, see generate_scanner() */
+    std::string scanner_source(const std::string& class_name,
+                               ScannerStyle style = ScannerStyle::Direct) const;
 
     std::vector<token_t> feed(int c);
     std::vector<token_t> end();
+    /** same as above without allocating a vector per character */
+    void feed(int c, TokenSink& sink);
+    void feed(std::span<const int> text, TokenSink& sink);
+    void end(TokenSink& sink);
 
     void reset();
+    /** lex the utf-8 text of @source, see Lexer::reset() */
+    void reset(std::shared_ptr<BufferTextInfo> source);
+    /** update @tokens of a text to the utf-8 text of @source after @edit, see ::relex() */
+    TokenDamage relex(std::shared_ptr<BufferTextInfo> source,
+                      std::vector<token_t>& tokens,
+                      const TextEdit& edit);
+
+    /** lex the utf-8 text of @source on up to @threads threads, see ::lex_parallel() */
+    static void lex_parallel(std::shared_ptr<BufferTextInfo> source,
+                             TokenSink& sink,
+                             size_t threads,
+                             const std::string& automaton_cache = "");
     using Lexer<int>::position_info;
 };
 
@@ -187,11 +215,15 @@ class CLexerUTF8 : private CLexer
     UTF8Decoder m_decoder;
 
   public:
-    CLexerUTF8();
+    CLexerUTF8(const std::string& automaton_cache = "");
 
     std::vector<token_t> feed(char c);
+    void feed(char c, TokenSink& sink);
+    /** feed the utf-8 bytes of @text */
+    void feed(std::span<const char> text, TokenSink& sink);
     using CLexer::end;
     using CLexer::position_info;
+    using CLexer::relex;
     using CLexer::reset;
 };
 
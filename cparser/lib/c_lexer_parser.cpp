@@ -10,22 +10,41 @@ CLexerParser::CLexerParser() : parser(), lexer()
 
 void CLexerParser::feed(char c)
 {
-    auto ts = lexer.feed(c);
-    for (auto& t : ts)
-        parser.feed(t);
+    TokenArena::Scope scope(*this->arena);
+    TokenCallbackSink sink([this](auto token) { parser.feed(token); });
+    lexer.feed(c, sink);
+}
+
+void CLexerParser::feed(span<const char> text)
+{
+    TokenArena::Scope scope(*this->arena);
+    TokenCallbackSink sink([this](auto token) { parser.feed(token); });
+    lexer.feed(text, sink);
 }
 
 shared_ptr<ASTNodeTranslationUnit> CLexerParser::end()
 {
-    auto ts = lexer.end();
-    for (auto& t : ts)
-        parser.feed(t);
+    TokenArena::Scope scope(*this->arena);
+    TokenCallbackSink sink([this](auto token) { parser.feed(token); });
+    lexer.end(sink);
     return parser.end();
 }
 
 void CLexerParser::reset()
 {
     this->lexer.reset();
+    this->reset_parser();
+}
+
+void CLexerParser::reset(shared_ptr<BufferTextInfo> source)
+{
+    this->lexer.reset(std::move(source));
+    this->reset_parser();
+}
+
+void CLexerParser::reset_parser()
+{
+    this->arena = std::make_unique<TokenArena>();
     this->parser.reset();
 
     auto ctx = parser.getContext();
@@ -1,8 +1,14 @@
 #include "c_token.h"
 #include "dcutf8.h"
+#include "lexer/incremental_lexer.hpp"
 #include "lexer/lexer_rule_regex.hpp"
+#include "lexer/parallel_lexer.hpp"
+#include "lexer/scanner_codegen.hpp"
+#include "lexer/token_arena.hpp"
 #include <algorithm>
+#include <iterator>
 #include <limits>
+#include <span>
 #include <stdexcept>
 using namespace std;
 
@@ -10,7 +16,7 @@ inline static auto s2u(string str)
 {
     return UTF8Decoder::strdecode(str);
 };
-inline static auto u2s(std::vector<int> cps)
+inline static auto u2s(std::span<const int> cps)
 {
     return UTF8Encoder::strencode(cps.begin(), cps.end());
 }
@@ -151,19 +157,19 @@ static cparser::TokenConstantInteger handle_integer_str(string str, TextRange ti
     return ret;
 }
 
-static cparser::TokenConstantInteger handle_integer_str(vector<int> str, TextRange tinfo)
+static cparser::TokenConstantInteger handle_integer_str(span<const int> str, TextRange tinfo)
 {
     return handle_integer_str(string(str.begin(), str.end()), tinfo);
 }
 
-static cparser::TokenConstantInteger handle_character_str(vector<int> str, TextRange tinfo)
+static cparser::TokenConstantInteger handle_character_str(span<const int> str, TextRange tinfo)
 {
     assert(str.size() >= 3);
     if (str.front() == 'L')
-        str.erase(str.begin());
+        str = str.subspan(1);
 
     assert(str[0] == '\'' && str.back() == '\'');
-    str = vector<int>(str.begin() + 1, str.end() - 1);
+    str = str.subspan(1, str.size() - 2);
     if (str.size() > 1 && str.front() != '\\')
         throw std::runtime_error("multi-character character literal");
 
@@ -204,104 +210,167 @@ using token_t = typename CLexer::token_t;
 using encoder_t = typename CLexer::encoder_t;
 
 
-// setup lexer rules when initialization
-CLexer::CLexer(encoder_t encoder) : Lexer<int>(encoder)
+namespace {
+// one line of the C lexer definition, a rule or a priority step
+struct CLexerRule
 {
-    auto& lexer = *this;
+    enum Kind
+    {
+        RULE,
+        DEC_MAJOR,
+        DEC_MINOR,
+    } kind;
+    const char* regex = nullptr;
+    CLexer::token_factory_t factory = nullptr;
+    bool compile = true, first_match = false;
+};
+} // namespace
 
-    // block comment
-    lexer(std::make_unique<LexerRuleRegex<int>>(
-        s2u("/\\*(!\\*/)\\*/"), [](auto str, auto info) { return nullptr; }, false, true));
+static const vector<CLexerRule>& c_lexer_rules()
+{
+    static const vector<CLexerRule> rules = {
+        // block comment
+        {CLexerRule::RULE,
+         "/\\*(!\\*/)\\*/",
+         [](auto, auto) -> token_t { return nullptr; },
+         false,
+         true},
 
-    // line comment
-    lexer(std::make_unique<LexerRuleRegex<int>>(s2u("//[^\n]*"),
-                                                [](auto str, auto info) { return nullptr; }));
+        // line comment
+        {CLexerRule::RULE, "//[^\n]*", [](auto, auto) -> token_t { return nullptr; }},
 
-    // string literal
-    lexer(std::make_unique<LexerRuleRegex<int>>(
-        s2u("L?\"([^\\\\\"\n]|(\\\\[^\n]))*\""), [](auto str, auto info) {
-            return std::make_shared<TokenStringLiteral>(string(u2s(str)), info);
-        }));
+        // string literal
+        {CLexerRule::RULE,
+         "L?\"([^\\\\\"\n]|(\\\\[^\n]))*\"",
+         [](auto str, auto info) -> token_t {
+             return make_token<TokenStringLiteral>(string(u2s(str)), info);
+         }},
 
 
-    // ***********************
-    lexer.dec_priority_major();
+        // ***********************
+        {CLexerRule::DEC_MAJOR},
 
 
 // keywords
 #define K_ENTRY(kw)                                                                                \
-    lexer(std::make_unique<LexerRuleRegex<int>>(                                                   \
-        s2u(#kw), [](auto str, auto info) { return std::make_shared<TokenKeyword_##kw>(info); }));
-    C_KEYWORD_LIST
+    {CLexerRule::RULE, #kw, [](auto, auto info) -> token_t {                                       \
+         return make_token<TokenKeyword_##kw>(info);                                               \
+     }},
+        C_KEYWORD_LIST
 #undef K_ENTRY
 
-    lexer.dec_priority_minor();
+        {CLexerRule::DEC_MINOR},
 
-    // identifier
-    lexer(std::make_unique<LexerRuleRegex<int>>(
-        s2u("([a-zA-Z_]|\\\\0[uU][0-9a-fA-F]{4})([a-zA-Z0-9_]|\\\\0[uU][0-9a-fA-F]{4})*"),
-        [](auto str, auto info) { return std::make_shared<TokenID>(string(u2s(str)), info); }));
+        // identifier
+        {CLexerRule::RULE,
+         "([a-zA-Z_]|\\\\0[uU][0-9a-fA-F]{4})([a-zA-Z0-9_]|\\\\0[uU][0-9a-fA-F]{4})*",
+         [](auto str, auto info) -> token_t {
+             return make_token<TokenID>(string(u2s(str)), info);
+         }},
 
 
-    // ***********************
-    lexer.dec_priority_major();
+        // ***********************
+        {CLexerRule::DEC_MAJOR},
 
 
 // punctuator
 #define P_ENTRY(n, regex)                                                                          \
-    lexer(std::make_unique<LexerRuleRegex<int>>(                                                   \
-        s2u(regex), [](auto str, auto info) { return std::make_shared<TokenPunc##n>(info); }));
-    C_PUNCTUATOR_LIST
+    {CLexerRule::RULE, regex, [](auto, auto info) -> token_t {                                     \
+         return make_token<TokenPunc##n>(info);                                                    \
+     }},
+        C_PUNCTUATOR_LIST
 #undef P_ENTRY
 
-    lexer.dec_priority_minor();
-
-    // integer literal
-    lexer(std::make_unique<LexerRuleRegex<int>>(
-        s2u("0[0-7]*" INTEGER_SUFFIX_REGEX), [](auto str, auto info) {
-            return std::make_shared<TokenConstantInteger>(handle_integer_str(str, info));
-        }));
-    lexer(std::make_unique<LexerRuleRegex<int>>(
-        s2u("0b[01]+" INTEGER_SUFFIX_REGEX), [](auto str, auto info) {
-            return std::make_shared<TokenConstantInteger>(handle_integer_str(str, info));
-        }));
-    lexer(std::make_unique<LexerRuleRegex<int>>(
-        s2u("[1-9][0-9]*" INTEGER_SUFFIX_REGEX), [](auto str, auto info) {
-            return std::make_shared<TokenConstantInteger>(handle_integer_str(str, info));
-        }));
-    lexer.dec_priority_minor();
-    lexer(std::make_unique<LexerRuleRegex<int>>(
-        s2u("(0[xX])?[0-9a-fA-F]+" INTEGER_SUFFIX_REGEX), [](auto str, auto info) {
-            return std::make_shared<TokenConstantInteger>(handle_integer_str(str, info));
-        }));
-    lexer.dec_priority_minor();
-    lexer(std::make_unique<LexerRuleRegex<int>>(
-        s2u("L?'([^\\\\']+|\\\\.|\\\\0[0-7]*|\\\\x[0-9a-fA-F]+)'" INTEGER_SUFFIX_REGEX),
-        [](auto str, auto info) {
-            return std::make_shared<TokenConstantInteger>(handle_character_str(str, info));
-        }));
-    lexer(std::make_unique<LexerRuleRegex<int>>(
-        s2u("[0-9]+[eE][\\+\\-]?[0-9]+[flFL]?"), [](auto str, auto info) {
-            const long double value = std::stold(u2s(str));
-            return std::make_shared<TokenConstantFloat>(value, info);
-        }));
-    lexer(std::make_unique<LexerRuleRegex<int>>(
-        s2u("((([0-9]+)?\\.[0-9]+)|[0-9]+\\.)([eE][\\+\\-]?[0-9]+)?[flFL]?"),
-        [](auto str, auto info) {
-            const long double value = std::stold(u2s(str));
-            return std::make_shared<TokenConstantFloat>(value, info);
-        }));
-    // TODO hexadecimal-floating-constant
-    // TODO preprocessor
-
-    // ignore space
-    lexer.dec_priority_major();
-    lexer(std::make_unique<LexerRuleRegex<int>>(s2u("[ \t\v\f\r\n]+"),
-                                                [](auto str, auto info) { return nullptr; }));
+        {CLexerRule::DEC_MINOR},
+
+        // integer literal
+        {CLexerRule::RULE,
+         "0[0-7]*" INTEGER_SUFFIX_REGEX,
+         [](auto str, auto info) -> token_t {
+             return make_token<TokenConstantInteger>(handle_integer_str(str, info));
+         }},
+        {CLexerRule::RULE,
+         "0b[01]+" INTEGER_SUFFIX_REGEX,
+         [](auto str, auto info) -> token_t {
+             return make_token<TokenConstantInteger>(handle_integer_str(str, info));
+         }},
+        {CLexerRule::RULE,
+         "[1-9][0-9]*" INTEGER_SUFFIX_REGEX,
+         [](auto str, auto info) -> token_t {
+             return make_token<TokenConstantInteger>(handle_integer_str(str, info));
+         }},
+        {CLexerRule::DEC_MINOR},
+        {CLexerRule::RULE,
+         "(0[xX])?[0-9a-fA-F]+" INTEGER_SUFFIX_REGEX,
+         [](auto str, auto info) -> token_t {
+             return make_token<TokenConstantInteger>(handle_integer_str(str, info));
+         }},
+        {CLexerRule::DEC_MINOR},
+        {CLexerRule::RULE,
+         "L?'([^\\\\']+|\\\\.|\\\\0[0-7]*|\\\\x[0-9a-fA-F]+)'" INTEGER_SUFFIX_REGEX,
+         [](auto str, auto info) -> token_t {
+             return make_token<TokenConstantInteger>(handle_character_str(str, info));
+         }},
+        {CLexerRule::RULE,
+         "[0-9]+[eE][\\+\\-]?[0-9]+[flFL]?",
+         [](auto str, auto info) -> token_t {
+             const long double value = std::stold(u2s(str));
+             return make_token<TokenConstantFloat>(value, info);
+         }},
+        {CLexerRule::RULE,
+         "((([0-9]+)?\\.[0-9]+)|[0-9]+\\.)([eE][\\+\\-]?[0-9]+)?[flFL]?",
+         [](auto str, auto info) -> token_t {
+             const long double value = std::stold(u2s(str));
+             return make_token<TokenConstantFloat>(value, info);
+         }},
+        // TODO hexadecimal-floating-constant
+        // TODO preprocessor
+
+        // ignore space
+        {CLexerRule::DEC_MAJOR},
+        {CLexerRule::RULE, "[ \t\v\f\r\n]+", [](auto, auto) -> token_t { return nullptr; }},
+    };
+    return rules;
+}
+
+// setup lexer rules when initialization
+CLexer::CLexer(encoder_t encoder, const string& automaton_cache) : Lexer<int>(encoder)
+{
+    auto& lexer = *this;
+    for (auto& rule : c_lexer_rules()) {
+        switch (rule.kind) {
+        case CLexerRule::DEC_MAJOR:
+            lexer.dec_priority_major();
+            break;
+        case CLexerRule::DEC_MINOR:
+            lexer.dec_priority_minor();
+            break;
+        case CLexerRule::RULE:
+            lexer(LexerRuleRegex<int>::with_view(
+                s2u(rule.regex), rule.factory, rule.compile, rule.first_match));
+            break;
+        }
+    }
 
+    lexer.combine_rules(automaton_cache);
     lexer.reset();
 }
 
+vector<CLexer::token_factory_t> CLexer::token_factories()
+{
+    vector<token_factory_t> factories;
+    for (auto& rule : c_lexer_rules()) {
+        if (rule.kind == CLexerRule::RULE)
+            factories.push_back(rule.factory);
+    }
+    return factories;
+}
+
+string CLexer::scanner_source(const string& class_name, ScannerStyle style) const
+{
+    return generate_scanner<int>(*this, class_name, style);
+}
+
 vector<token_t> CLexer::feed(int c)
 {
     return this->feed_char(c);
@@ -312,13 +381,69 @@ vector<token_t> CLexer::end()
     return this->feed_end();
 }
 
+void CLexer::feed(int c, TokenSink& sink)
+{
+    this->feed_char(c, sink);
+}
+
+void CLexer::feed(span<const int> text, TokenSink& sink)
+{
+    Lexer<int>::feed(text, sink);
+}
+
+void CLexer::end(TokenSink& sink)
+{
+    this->feed_end(sink);
+}
+
+static UTF8Encoder utf8encoder;
+
 void CLexer::reset()
 {
     Lexer<int>::reset();
 }
 
-static UTF8Encoder utf8encoder;
-CLexerUTF8::CLexerUTF8() : CLexer([](int c) { return utf8encoder.encode(c); })
+void CLexer::reset(shared_ptr<BufferTextInfo> source)
+{
+    Lexer<int>::reset(std::move(source));
+}
+
+TokenDamage CLexer::relex(shared_ptr<BufferTextInfo> source,
+                          vector<token_t>& tokens,
+                          const TextEdit& edit)
+{
+    // token starts are at code point boundaries, decoding can start there
+    UTF8Decoder decoder;
+    const auto decode = [&](char byte, int& c) {
+        auto cx = decoder.decode(byte);
+        if (cx.presented())
+            c = cx.getval();
+        return cx.presented();
+    };
+    return ::relex(static_cast<Lexer<int>&>(*this), std::move(source), tokens, edit, decode);
+}
+
+void CLexer::lex_parallel(shared_ptr<BufferTextInfo> source,
+                          TokenSink& sink,
+                          size_t threads,
+                          const string& automaton_cache)
+{
+    const auto bytes = source->text();
+    vector<int> text(bytes.size());
+    UTF8Decoder decoder;
+    text.resize(decoder.decode(span<const char>(bytes), text.data()));
+
+    const auto make_lexer = [&]() {
+        auto lexer =
+            make_unique<CLexer>([](int c) { return utf8encoder.encode(c); }, automaton_cache);
+        // Lexer<int> is a private base, only reachable from here
+        return unique_ptr<Lexer<int>>(lexer.release());
+    };
+    ::lex_parallel<int>(source, span<const int>(text), make_lexer, sink, threads);
+}
+
+CLexerUTF8::CLexerUTF8(const string& automaton_cache)
+    : CLexer([](int c) { return utf8encoder.encode(c); }, automaton_cache)
 {}
 
 vector<token_t> CLexerUTF8::feed(char c)
@@ -331,4 +456,22 @@ vector<token_t> CLexerUTF8::feed(char c)
         return {};
 }
 
+void CLexerUTF8::feed(char c, TokenSink& sink)
+{
+    auto cx = this->m_decoder.decode(c);
+
+    if (cx.presented())
+        CLexer::feed(cx.getval(), sink);
+}
+
+void CLexerUTF8::feed(span<const char> text, TokenSink& sink)
+{
+    int chars[1 << 12];
+    for (size_t i = 0; i < text.size(); i += std::size(chars)) {
+        const auto chunk = text.subspan(i, std::min(std::size(chars), text.size() - i));
+        const auto n = this->m_decoder.decode(chunk, chars);
+        CLexer::feed(span<const int>(chars, n), sink);
+    }
+}
+
 } // namespace cparser
@@ -0,0 +1,17 @@
+#include "c_generated_lexer.h"
+#include "c_scanner.gen.hpp"
+#include "c_token.h"
+#include "dcutf8.h"
+#include "lexer/generated_lexer.hpp"
+using namespace std;
+
+namespace cparser {
+
+unique_ptr<ISimpleLexer> make_generated_lexer(const string& utf8_text)
+{
+    static const auto factories = CLexer::token_factories();
+    return make_unique<GeneratedLexer<CScanner>>(
+        factories, UTF8Decoder::strdecode(utf8_text), UTF8Encoder::length);
+}
+
+} // namespace cparser
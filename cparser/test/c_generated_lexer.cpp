@@ -0,0 +1,64 @@
+#include "c_generated_lexer.h"
+#include "c_scanner_table.gen.hpp"
+#include "c_token.h"
+#include "dcutf8.h"
+#include "lexer/generated_lexer.hpp"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+using namespace std;
+
+
+static vector<shared_ptr<LexerToken>> clexer_tokens(const string& text)
+{
+    cparser::CLexerUTF8 lexer;
+    vector<shared_ptr<LexerToken>> tokens;
+    for (auto c : text) {
+        for (auto t : lexer.feed(c))
+            tokens.push_back(t);
+    }
+    for (auto t : lexer.end())
+        tokens.push_back(t);
+    return tokens;
+}
+
+static vector<shared_ptr<LexerToken>> drain(ISimpleLexer& lexer)
+{
+    vector<shared_ptr<LexerToken>> tokens;
+    while (!lexer.end())
+        tokens.push_back(lexer.next());
+    return tokens;
+}
+
+TEST(GeneratedLexer, SameTokensAsCLexer)
+{
+    const string text = "/* comment */ int main(int argc, char** argv)\n"
+                        "{\n"
+                        "    // line comment\n"
+                        "    unsigned long x = 0x1fUL + 017 + 0b101 + 'a' + '\\x21';\n"
+                        "    double y = 1.5e3 + .25f + 5. + 22E1;\n"
+                        "    const char* s = \"hello \\\"world\\\" 意见\";\n"
+                        "    if (x <<= 2 && y >= 1 || !s) return x->y ... %: <% %>;\n"
+                        "    ifx = _abc_1 + elsey;\n"
+                        "}\n";
+    const auto expected = clexer_tokens(text);
+    ASSERT_GT(expected.size(), 60);
+
+    auto direct = cparser::make_generated_lexer(text);
+    GeneratedLexer<CScannerTable> table(
+        cparser::CLexer::token_factories(), UTF8Decoder::strdecode(text), [](int c) -> size_t {
+            return UTF8Encoder().encode(c).size();
+        });
+    for (auto tokens : {drain(*direct), drain(table)}) {
+        ASSERT_EQ(tokens.size(), expected.size());
+        for (size_t i = 0; i < tokens.size(); i++) {
+            EXPECT_EQ(tokens[i]->charid(), expected[i]->charid()) << i;
+            EXPECT_EQ(tokens[i]->range(), expected[i]->range()) << i;
+        }
+    }
+
+    auto bad = cparser::make_generated_lexer("int @");
+    EXPECT_FALSE(bad->end());
+    EXPECT_EQ(bad->next()->charid(), CharID<cparser::TokenKeyword_int>());
+    EXPECT_THROW(bad->end(), LexerError);
+}
@@ -1,6 +1,7 @@
 #include "c_token.h"
 #include <gtest/gtest.h>
 #include <iostream>
+#include <span>
 #include <string>
 #include <vector>
 using namespace std;
@@ -200,3 +201,97 @@ TEST(shoud_reject, CLexerBasic)
         lexer.reset();
     }
 }
+
+TEST(bulk_feed, CLexerBasic)
+{
+    const string text = "int main() { /* 意见 */ return 0x1f + 'a' + 1.5; } \"s\\\"tr\" // end";
+    cparser::CLexerUTF8 lexer;
+    vector<shared_ptr<LexerToken>> expected;
+    for (auto c : text) {
+        for (auto x : lexer.feed(c))
+            expected.push_back(x);
+    }
+    for (auto x : lexer.end())
+        expected.push_back(x);
+    ASSERT_EQ(expected.size(), 14);
+
+    // the buffer is reused between feeds, a callback sees the same tokens
+    vector<shared_ptr<LexerToken>> buffer, tokens;
+    TokenBufferSink sink(buffer);
+    for (size_t split : {size_t(0), size_t(7), text.size()}) {
+        lexer.reset();
+        buffer.clear();
+        lexer.feed(span<const char>(text.data(), split), sink);
+        lexer.feed(span<const char>(text.data() + split, text.size() - split), sink);
+        lexer.end(sink);
+        ASSERT_EQ(buffer.size(), expected.size()) << split;
+        for (size_t i = 0; i < buffer.size(); i++) {
+            EXPECT_EQ(buffer[i]->charid(), expected[i]->charid()) << split;
+            EXPECT_EQ(buffer[i]->range(), expected[i]->range()) << split;
+        }
+    }
+
+    lexer.reset();
+    TokenCallbackSink callback([&](auto token) { tokens.push_back(token); });
+    lexer.feed(text, callback);
+    lexer.end(callback);
+    EXPECT_EQ(tokens.size(), expected.size());
+}
+
+TEST(parallel, CLexerBasic)
+{
+    string text;
+    for (int i = 0; text.size() < 300000; i++) {
+        text += "int f" + to_string(i) + "(int x) { return x * 0x" + to_string(i % 97) + "UL; }\n";
+        if (i % 50 == 0)
+            text += "/* 注释 spanning\n   lines with \"quotes and $\n */ const char* s = \"意见\";\n";
+    }
+    auto source = make_shared<BufferTextInfo>(text);
+
+    cparser::CLexerUTF8 lexer;
+    vector<shared_ptr<LexerToken>> expected, tokens;
+    TokenBufferSink expected_sink(expected), sink(tokens);
+    lexer.feed(span<const char>(text), expected_sink);
+    lexer.end(expected_sink);
+
+    cparser::CLexer::lex_parallel(source, sink, 4);
+    ASSERT_EQ(tokens.size(), expected.size());
+    for (size_t i = 0; i < tokens.size(); i++) {
+        ASSERT_EQ(tokens[i]->charid(), expected[i]->charid()) << i;
+        ASSERT_EQ(tokens[i]->range(), expected[i]->range()) << i;
+    }
+}
+
+TEST(relex, CLexerBasic)
+{
+    const auto lex = [](const string& text) {
+        cparser::CLexerUTF8 lexer;
+        vector<shared_ptr<LexerToken>> tokens;
+        TokenBufferSink sink(tokens);
+        lexer.feed(span<const char>(text), sink);
+        lexer.end(sink);
+        return tokens;
+    };
+
+    string text;
+    for (int i = 0; i < 20; i++)
+        text += "const char* s" + to_string(i) + " = \"意见\"; // 注释\nint x = 0x1f;\n";
+    auto tokens = lex(text);
+
+    cparser::CLexerUTF8 lexer;
+    const string inserted = "改 \\\"";
+    const auto offset = text.find("见\"; // 注释\nint x") + 3;
+    text.insert(offset, inserted);
+    const auto damage = lexer.relex(make_shared<BufferTextInfo>(text),
+                                    tokens,
+                                    TextEdit{offset, 0, inserted.size()});
+    EXPECT_EQ(damage.old_end - damage.first, 2);
+    EXPECT_EQ(damage.new_end - damage.first, 2);
+
+    const auto expected = lex(text);
+    ASSERT_EQ(tokens.size(), expected.size());
+    for (size_t i = 0; i < tokens.size(); i++) {
+        ASSERT_EQ(tokens[i]->charid(), expected[i]->charid()) << i;
+        ASSERT_EQ(tokens[i]->range(), expected[i]->range()) << i;
+    }
+}
@@ -0,0 +1,34 @@
+#include "c_token.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+using namespace std;
+
+
+// c_scanner_gen <output> [class name] [--table]
+int main(int argc, char** argv)
+{
+    if (argc < 2) {
+        cerr << "usage: " << argv[0] << " <output> [class name] [--table]" << endl;
+        return 1;
+    }
+
+    string class_name = "CScanner";
+    auto style = ScannerStyle::Direct;
+    for (int i = 2; i < argc; i++) {
+        if (string(argv[i]) == "--table") {
+            style = ScannerStyle::Table;
+        } else {
+            class_name = argv[i];
+        }
+    }
+
+    cparser::CLexer lexer(nullptr);
+    ofstream out(argv[1], ios::binary | ios::trunc);
+    out << lexer.scanner_source(class_name, style);
+    if (!out) {
+        cerr << "failed to write " << argv[1] << endl;
+        return 1;
+    }
+    return 0;
+}
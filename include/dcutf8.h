@@ -2,6 +2,7 @@
 #define _DC_PARSER_DCUTF8_HPP_
 
 #include <assert.h>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -12,6 +13,13 @@ class UTF8Encoder
     UTF8Encoder() = default;
     std::string encode(int);
 
+    /** size of encode(@c) without building it, 0 past the last code point */
+    static inline size_t length(int c)
+    {
+        const auto u = static_cast<unsigned>(c);
+        return u < 0x80 ? 1 : u < 0x800 ? 2 : u < 0x10000 ? 3 : u < 0x110000 ? 4 : 0;
+    }
+
     template<typename Iterator>
     static std::string strencode(Iterator begin, Iterator end)
     {
@@ -61,6 +69,15 @@ class UTF8Decoder
   public:
     UTF8Decoder() = default;
     UTF8CodePoint decode(char c);
+    /**
+     * decode the bytes of @text into @out, which has room for text.size()
+     * code points, going on from a sequence left unfinished by the bytes
+     * fed before. a sequence cut at the end of @text is kept for the next
+     * call. runs of ascii are converted 16 bytes at a time.
+     *
+     * @return the number of code points written
+     */
+    size_t decode(std::span<const char> text, int* out);
     inline size_t buflen()
     {
         return m_buffer.size();
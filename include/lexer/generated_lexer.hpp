@@ -0,0 +1,117 @@
+#ifndef _LEXER_GENERATED_LEXER_HPP_
+#define _LEXER_GENERATED_LEXER_HPP_
+
+#include "input_window.hpp"
+#include "lexer_error.h"
+#include "simple_lexer.hpp"
+#include "token.h"
+#include <algorithm>
+#include <assert.h>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+
+/**
+ * ISimpleLexer driven by a scanner emitted by generate_scanner().
+ * tokens are built by plain function pointers indexed by rule, and like
+ * in Lexer a nullptr token is dropped. token ranges count the bytes
+ * given by @char_length for each character, one byte when it's nullptr.
+ * a factory sees its text as a view into the buffer, valid during the call.
+ */
+template<typename Scanner>
+class GeneratedLexer : public ISimpleLexer
+{
+  public:
+    using CharType = typename Scanner::char_type;
+    using token_t = std::shared_ptr<LexerToken>;
+    using token_factory_t = token_t (*)(std::span<const CharType> str, TextRange info);
+    using char_length_t = size_t (*)(CharType c);
+
+  private:
+    std::vector<token_factory_t> m_factories;
+    char_length_t m_char_length;
+    std::vector<CharType> m_buffer;
+    size_t m_buf_pos, m_text_pos;
+    InputWindow<token_t> m_tokens;
+    size_t m_cur_pos;
+
+    void clean_token_buffer()
+    {
+        if (this->m_tokens.size() > 10) {
+            const auto n = std::min(this->m_tokens.size() - 10, this->m_cur_pos);
+            this->m_tokens.release(n);
+            this->m_cur_pos -= n;
+        }
+    }
+
+    void fill_one()
+    {
+        while (this->m_cur_pos == this->m_tokens.size() &&
+               this->m_buf_pos < this->m_buffer.size()) {
+            const auto begin = this->m_buffer.data() + this->m_buf_pos;
+            const auto end = this->m_buffer.data() + this->m_buffer.size();
+            size_t rule = 0;
+            const auto len = Scanner::longest_match(begin, end, rule);
+            if (len == 0)
+                throw LexerError("no rule match at " + std::to_string(this->m_text_pos));
+
+            assert(rule < this->m_factories.size());
+            size_t bytes = 0;
+            for (auto p = begin; p != begin + len; ++p)
+                bytes += this->m_char_length ? this->m_char_length(*p) : 1;
+
+            const TextRange range(this->m_text_pos, this->m_text_pos + bytes);
+            auto token = this->m_factories[rule](std::span<const CharType>(begin, len), range);
+            this->m_buf_pos += len;
+            this->m_text_pos += bytes;
+            if (token != nullptr) {
+                this->m_tokens.push_back(token);
+                this->clean_token_buffer();
+            }
+        }
+    }
+
+  public:
+    GeneratedLexer(std::vector<token_factory_t> factories,
+                   std::vector<CharType> buf,
+                   char_length_t char_length = nullptr)
+        : m_factories(std::move(factories)),
+          m_char_length(char_length),
+          m_buffer(std::move(buf)),
+          m_buf_pos(0),
+          m_text_pos(0),
+          m_cur_pos(0)
+    {
+        if (this->m_factories.size() != Scanner::rule_count)
+            throw LexerError("token factories don't match the rules of the scanner");
+    }
+
+    bool end() const override
+    {
+        auto _this = const_cast<GeneratedLexer*>(this);
+        _this->fill_one();
+
+        assert(this->m_cur_pos <= this->m_tokens.size());
+        return this->m_cur_pos == this->m_tokens.size();
+    }
+
+    token_t next() override
+    {
+        if (this->end())
+            throw LexerError("No more tokens");
+
+        return this->m_tokens[this->m_cur_pos++];
+    }
+
+    void back() override
+    {
+        if (this->m_cur_pos == 0)
+            throw LexerError("lexer can't go backward");
+
+        this->m_cur_pos--;
+    }
+};
+
+#endif // _LEXER_GENERATED_LEXER_HPP_
@@ -0,0 +1,133 @@
+#ifndef _LEXER_INCREMENTAL_LEXER_HPP_
+#define _LEXER_INCREMENTAL_LEXER_HPP_
+
+#include "text_info.h"
+#include "token.h"
+#include "token_sink.hpp"
+#include <algorithm>
+#include <assert.h>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+
+/** @removed bytes at @offset replaced by @inserted bytes */
+struct TextEdit
+{
+    size_t offset;
+    size_t removed;
+    size_t inserted;
+};
+
+/** tokens [first, old_end) of a stream were replaced by the ones now at [first, new_end) */
+struct TokenDamage
+{
+    size_t first;
+    size_t old_end;
+    size_t new_end;
+};
+
+/**
+ * update @tokens, the tokens of a text before @edit, to those of @source, the
+ * text after it. a token whose extent, what the lexer read to emit it as
+ * recorded by Lexer, ends before the edit is unchanged, and so is everything
+ * emitted before it, skipped text included. the text is thus lexed again
+ * from the start of the last such token until the lexer starts a token where
+ * an old token after the edit started. the old tokens from there on are kept,
+ * their ranges moved by the length change of the edit.
+ *
+ * every byte of @source from the restart on goes through @decode(byte, c),
+ * which returns true once the character @c is complete. the lexer is used as
+ * in lex_parallel(), lexers whose rules look at the last token also need the
+ * token before a resync point to match the old one.
+ *
+ * @return the replaced span of @tokens, the tokens outside of it can be kept
+ * by a parser, they are the same objects
+ */
+template<typename LexerType, typename Decode>
+TokenDamage relex(LexerType& lexer,
+                  std::shared_ptr<BufferTextInfo> source,
+                  std::vector<std::shared_ptr<LexerToken>>& tokens,
+                  const TextEdit& edit,
+                  Decode decode)
+{
+    assert(edit.offset + edit.inserted <= source->len());
+    const std::ptrdiff_t delta = std::ptrdiff_t(edit.inserted) - std::ptrdiff_t(edit.removed);
+    // extents only grow along the stream, the end of file counts as read.
+    // the end of a token may cover lookahead, its start is where rules reset
+    const size_t reached =
+        std::partition_point(tokens.begin(), tokens.end(), [&](const auto& token) {
+            return token->beg().value() + token->extent() < edit.offset;
+        }) -
+        tokens.begin();
+    const size_t first = reached > 0 ? reached - 1 : 0;
+    const size_t pos = reached > 0 ? tokens[first]->beg().value() : 0;
+
+    std::optional<std::shared_ptr<LexerToken>> last;
+    if (first > 0)
+        last = tokens[first - 1];
+    lexer.reset(source, pos, last);
+
+    std::vector<std::shared_ptr<LexerToken>> fresh;
+    TokenBufferSink sink(fresh);
+    // the next old token which may be a resync point
+    size_t old = first;
+    const auto synced = [&]() {
+        const auto start = lexer.token_start();
+        if (start < edit.offset + edit.inserted)
+            return false;
+        while (old < tokens.size() &&
+               (tokens[old]->beg().value() < edit.offset + edit.removed ||
+                tokens[old]->beg().value() + delta < start))
+            old++;
+        if (old == tokens.size() || tokens[old]->beg().value() + delta != start)
+            return false;
+        if (!lexer.uses_last_token())
+            return true;
+        if (old == first || fresh.empty())
+            return false;
+
+        const auto& prev = tokens[old - 1];
+        return fresh.back()->charid() == prev->charid() &&
+               fresh.back()->beg().value() == prev->beg().value() + delta &&
+               fresh.back()->end().value() == prev->end().value() + delta;
+    };
+
+    const std::string_view text = source->text();
+    size_t old_end = tokens.size();
+    typename LexerType::CharType c;
+    for (size_t k = pos; k < text.size(); k++) {
+        if (!decode(text[k], c))
+            continue;
+        lexer.feed_char(c, sink);
+        if (synced()) {
+            old_end = old;
+            break;
+        }
+    }
+    if (old_end == tokens.size())
+        lexer.feed_end(sink);
+
+    for (size_t i = old_end; i < tokens.size(); i++)
+        tokens[i]->shift(delta);
+    const auto at = tokens.erase(tokens.begin() + first, tokens.begin() + old_end);
+    tokens.insert(at, fresh.begin(), fresh.end());
+    return TokenDamage{first, old_end, first + fresh.size()};
+}
+
+/** relex() for lexers fed with the bytes of the text */
+template<typename LexerType>
+TokenDamage relex(LexerType& lexer,
+                  std::shared_ptr<BufferTextInfo> source,
+                  std::vector<std::shared_ptr<LexerToken>>& tokens,
+                  const TextEdit& edit)
+{
+    return relex(lexer, std::move(source), tokens, edit, [](char byte, auto& c) {
+        c = byte;
+        return true;
+    });
+}
+
+#endif // _LEXER_INCREMENTAL_LEXER_HPP_
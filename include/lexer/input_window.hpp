@@ -0,0 +1,86 @@
+#ifndef _LEXER_INPUT_WINDOW_HPP_
+#define _LEXER_INPUT_WINDOW_HPP_
+
+#include <assert.h>
+#include <span>
+#include <vector>
+
+
+/**
+ * the live part of a stream, from a mark to the last pushed element.
+ * elements are indexed from the mark and stay contiguous. moving the mark
+ * forward with release() is O(1), the storage is compacted only once the
+ * released prefix is longer than the live part, so every element is moved
+ * at most a constant number of times in amortized terms.
+ */
+template<typename T>
+class InputWindow
+{
+  private:
+    std::vector<T> m_items;
+    size_t m_mark;
+
+  public:
+    InputWindow() : m_mark(0)
+    {}
+
+    size_t size() const
+    {
+        return this->m_items.size() - this->m_mark;
+    }
+    bool empty() const
+    {
+        return this->size() == 0;
+    }
+
+    T& operator[](size_t index)
+    {
+        assert(index < this->size());
+        return this->m_items[this->m_mark + index];
+    }
+    const T& operator[](size_t index) const
+    {
+        assert(index < this->size());
+        return this->m_items[this->m_mark + index];
+    }
+    const T& front() const
+    {
+        return (*this)[0];
+    }
+    const T& back() const
+    {
+        return (*this)[this->size() - 1];
+    }
+
+    /** live elements, invalidated by push_back() and release() */
+    std::span<const T> view() const
+    {
+        return std::span<const T>(this->m_items.data() + this->m_mark, this->size());
+    }
+
+    void push_back(T item)
+    {
+        this->m_items.push_back(std::move(item));
+    }
+
+    /** move the mark past the first @n live elements */
+    void release(size_t n)
+    {
+        assert(n <= this->size());
+        this->m_mark += n;
+        if (this->m_mark == this->m_items.size()) {
+            this->clear();
+        } else if (this->m_mark > this->size()) {
+            this->m_items.erase(this->m_items.begin(), this->m_items.begin() + this->m_mark);
+            this->m_mark = 0;
+        }
+    }
+
+    void clear()
+    {
+        this->m_items.clear();
+        this->m_mark = 0;
+    }
+};
+
+#endif // _LEXER_INPUT_WINDOW_HPP_
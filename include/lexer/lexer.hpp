@@ -1,14 +1,22 @@
 #ifndef _LEXER_LEXER_HPP_
 #define _LEXER_LEXER_HPP_
 
+#include "dcutf8.h"
+#include "input_window.hpp"
 #include "lexer_error.h"
 #include "lexer_rule.hpp"
+#include "lexer_rule_regex.hpp"
+#include "regex/regex_automata_dfa_image.hpp"
+#include "regex/regex_cache.hpp"
 #include "regex/regex_char.hpp"
 #include "text_info.h"
+#include "token_sink.hpp"
 #include <algorithm>
 #include <assert.h>
 #include <functional>
+#include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -21,6 +29,25 @@ class Lexer
     using traits = character_traits<CharType>;
     using encoder_t = std::function<std::string(CharType)>;
 
+    /**
+     * all combinable regex rules merged into one tagged DFA, tag t stands
+     * for @rules[t]. for every DFA state and major priority it records
+     * whether a rule of that priority is still alive and which rule the
+     * lexer would pick among the ones matching in this state.
+     */
+    struct CombinedAutomaton
+    {
+        struct RuleIndex
+        {
+            size_t major, minor, index;
+        };
+        std::shared_ptr<const RegexDFAImage<CharType>> dfa;
+        std::vector<RuleIndex> rules;
+        size_t nlevels;
+        std::vector<uint8_t> level_alive;
+        std::vector<size_t> level_best;
+    };
+
   private:
     class KLexerPositionInfo : public TextInfo
     {
@@ -91,7 +118,9 @@ class Lexer
             return this->_buffer.substr(from, to - from);
         }
     };
-    std::shared_ptr<KLexerPositionInfo> m_textinfo;
+    // records the text while lexing, nullptr when the text is a BufferTextInfo
+    std::shared_ptr<KLexerPositionInfo> m_recorder;
+    std::shared_ptr<TextInfo> m_textinfo;
     encoder_t m_encoder;
 
     static constexpr auto npos = std::string::npos;
@@ -99,9 +128,11 @@ class Lexer
     {
         std::unique_ptr<LexerRule<CharType>> rule;
         size_t feed_len, match_len;
+        // driven by the combined automaton instead of being fed one by one
+        bool combined;
 
         RuleInfo(std::unique_ptr<LexerRule<CharType>> rule)
-            : rule(std::move(rule)), feed_len(0), match_len(0)
+            : rule(std::move(rule)), feed_len(0), match_len(0), combined(false)
         {}
 
         void reset(size_t pos, std::optional<std::shared_ptr<LexerToken>> last)
@@ -115,6 +146,15 @@ class Lexer
     std::vector<std::vector<std::vector<RuleInfo>>> m_rules;
     std::optional<size_t> m_match_major_priority;
 
+    // minor priority and index of a rule in its major priority
+    using rule_pos_t = std::pair<size_t, size_t>;
+    using candidate_t = std::tuple<size_t, size_t, size_t>;
+    // per major priority, the rules fed one by one that aren't dead in the
+    // current token and the dead ones that matched, rebuilt by reset_rules()
+    std::vector<std::vector<rule_pos_t>> m_live_rules;
+    std::vector<std::vector<rule_pos_t>> m_matched_rules;
+    std::vector<candidate_t> m_candidates;
+
     struct CharInfo
     {
         CharType char_val;
@@ -123,54 +163,101 @@ class Lexer
         CharInfo(CharType c, size_t pos, size_t len) : char_val(c), pos(pos), len_in_bytes(len)
         {}
     };
-    std::vector<CharInfo> m_cache;
+    // characters since the start of the pending token, the mark of both
+    // windows moves past every token taken from them
+    InputWindow<CharInfo> m_cache;
+    // char_val of m_cache, contiguous so rules without text get a view of it
+    InputWindow<CharType> m_cache_chars;
     size_t m_pos;
     std::string m_filename;
+    // characters fed since the rules were reset
+    size_t m_fed_count;
+
+    std::shared_ptr<const CombinedAutomaton> m_combined;
+    typename RegexDFAImage<CharType>::DFAState_t m_combined_state;
+    // per major priority, the length and the tag of the last combined match
+    std::vector<size_t> m_combined_match_len;
+    std::vector<size_t> m_combined_match_rule;
+
+    std::tuple<size_t, size_t, size_t> combined_candidate(size_t level) const
+    {
+        auto& rule = this->m_combined->rules[this->m_combined_match_rule[level]];
+        return std::make_tuple(this->m_combined_match_len[level], rule.minor, rule.index);
+    }
+
+    /** replay the cached characters into a combined rule, so its token sees what feed() would */
+    void replay_combined_rule(RuleInfo& ri)
+    {
+        assert(!this->m_cache.empty() && this->m_fed_count <= this->m_cache.size());
+        auto& rule = *ri.rule;
+        rule.reset(this->m_cache.front().pos, this->m_notnull_last_token);
+        for (size_t i = 0; i < this->m_fed_count && !rule.dead(); i++)
+            rule.feed(this->m_cache[i].char_val, this->m_cache[i].len_in_bytes);
+    }
+
+    /** drop the first @len cached characters */
+    void drop_cache(size_t len)
+    {
+        this->m_cache.release(len);
+        this->m_cache_chars.release(len);
+    }
 
     std::vector<CharType> getcachestr(size_t len)
     {
         assert(len <= m_cache.size());
-        std::vector<CharType> ret;
-        for (size_t i = 0; i < len; ++i) {
-            ret.push_back(m_cache[i].char_val);
-        }
-        return ret;
+        auto str = this->m_cache_chars.view().first(len);
+        return std::vector<CharType>(str.begin(), str.end());
     }
 
-    std::vector<std::shared_ptr<LexerToken>> push_cache_to_end(size_t cache_pos)
+    void emit(const std::shared_ptr<LexerToken>& token, TokenSink& sink)
     {
-        assert(cache_pos > 0 && cache_pos <= this->m_cache.size());
-        std::vector<std::shared_ptr<LexerToken>> tokens;
+        // everything up to m_pos was read to decide on the token
+        if (auto beg = token->beg(); beg.has_value() && beg.value() <= this->m_pos)
+            token->set_extent(this->m_pos - beg.value());
+        sink.push(token);
+    }
+
+    /**
+     * feed the cached characters from @cursor on. after a token the rules
+     * restart at the new mark, so the cursor rewinds to the first character
+     * following the token.
+     */
+    void push_cache_to_end(size_t cursor, TokenSink& sink)
+    {
+        assert(cursor < this->m_cache.size());
 
-        for (CharInfo ci = this->m_cache[cache_pos - 1]; cache_pos <= this->m_cache.size();
-             cache_pos++,
-                      ci = (cache_pos <= this->m_cache.size()) ? this->m_cache[cache_pos - 1]
-                                                               : ci) {
+        while (cursor < this->m_cache.size()) {
+            const CharInfo ci = this->m_cache[cursor++];
             auto [token, len] = this->feed_char_internal(ci);
-            assert(len <= cache_pos);
+            assert(len <= cursor);
             assert(token.has_value() || len == 0);
 
             if (token.has_value()) {
                 assert(len > 0);
                 auto val = token.value();
                 if (val != nullptr)
-                    tokens.push_back(val);
+                    this->emit(val, sink);
 
                 size_t reset_pos = this->m_pos;
                 if (this->m_cache.size() > len)
                     reset_pos = this->m_cache[len].pos;
                 this->reset_rules(reset_pos, val);
-                this->m_cache.erase(this->m_cache.begin(), this->m_cache.begin() + len);
-                cache_pos = 0;
+                this->drop_cache(len);
+                cursor = 0;
             }
         }
-
-        return tokens;
     }
 
     std::pair<std::optional<std::shared_ptr<LexerToken>>, size_t>
     feed_char_internal(const CharInfo& c)
     {
+        this->m_fed_count++;
+        if (this->m_combined) {
+            auto& dfa = *this->m_combined->dfa;
+            if (!dfa.is_dead(this->m_combined_state))
+                this->m_combined_state = dfa.state_transition(this->m_combined_state, c.char_val);
+        }
+
         bool prevs_is_dead = true;
         for (size_t i = 0; i < this->m_rules.size(); i++) {
             if (this->m_match_major_priority.has_value() &&
@@ -179,48 +266,71 @@ class Lexer
             }
             auto& r1 = this->m_rules[i];
             bool current_is_dead = true;
-            std::vector<std::tuple<size_t, size_t, size_t>> finished_rules;
 
-            for (size_t j = 0; j < r1.size(); j++) {
-                auto& r2 = r1[j];
+            if (this->m_combined) {
+                auto& ca = *this->m_combined;
+                const auto idx = this->m_combined_state * ca.nlevels + i;
+                if (ca.level_alive[idx])
+                    current_is_dead = false;
 
-                for (size_t k = 0; k < r2.size(); k++) {
-                    auto& ri = r2[k];
-                    auto& r = *ri.rule;
-                    if (r.dead()) {
-                        if (ri.match_len > 0)
-                            finished_rules.push_back(std::make_tuple(ri.match_len, j, k));
-                        continue;
+                if (ca.level_best[idx] != npos) {
+                    if (!this->m_match_major_priority.has_value() ||
+                        i < this->m_match_major_priority.value()) {
+                        this->m_match_major_priority = i;
                     }
 
-                    ri.feed_len++;
-                    r.feed(c.char_val, c.len_in_bytes);
-                    if (r.dead()) {
-                        if (ri.match_len > 0)
-                            finished_rules.push_back(std::make_tuple(ri.match_len, j, k));
-                    } else {
-                        current_is_dead = false;
-                    }
+                    this->m_combined_match_len[i] = this->m_fed_count;
+                    this->m_combined_match_rule[i] = ca.level_best[idx];
+                }
+            }
 
-                    if (r.match()) {
-                        if (this->m_match_major_priority.has_value()) {
-                            if (i < this->m_match_major_priority.value()) {
-                                this->m_match_major_priority = i;
-                            }
-                        } else {
+            auto& live = this->m_live_rules[i];
+            size_t nlive = 0;
+            for (auto pos : live) {
+                auto& ri = r1[pos.first][pos.second];
+                auto& r = *ri.rule;
+                ri.feed_len++;
+                r.feed(c.char_val, c.len_in_bytes);
+                if (r.dead()) {
+                    if (ri.match_len > 0)
+                        this->m_matched_rules[i].push_back(pos);
+                } else {
+                    live[nlive++] = pos;
+                }
+
+                if (r.match()) {
+                    if (this->m_match_major_priority.has_value()) {
+                        if (i < this->m_match_major_priority.value()) {
                             this->m_match_major_priority = i;
                         }
-
-                        ri.match_len = ri.feed_len;
+                    } else {
+                        this->m_match_major_priority = i;
                     }
+
+                    ri.match_len = ri.feed_len;
                 }
             }
+            live.resize(nlive);
+            if (nlive > 0)
+                current_is_dead = false;
+
             prevs_is_dead = prevs_is_dead && current_is_dead;
+            if (!prevs_is_dead)
+                continue;
+
+            auto& candidates = this->m_candidates;
+            candidates.clear();
+            for (auto pos : this->m_matched_rules[i]) {
+                auto& ri = r1[pos.first][pos.second];
+                candidates.push_back(std::make_tuple(ri.match_len, pos.first, pos.second));
+            }
+            if (this->m_combined && this->m_combined_match_len[i] > 0)
+                candidates.push_back(this->combined_candidate(i));
 
-            if (!prevs_is_dead || finished_rules.empty())
+            if (candidates.empty())
                 continue;
 
-            return this->get_token_by_candidates(i, finished_rules);
+            return this->get_token_by_candidates(i, candidates);
         }
 
         if (prevs_is_dead) {
@@ -243,18 +353,17 @@ class Lexer
                 continue;
             }
             auto& r1 = this->m_rules[i];
-            std::vector<std::tuple<size_t, size_t, size_t>> matchs;
-
-            for (size_t j = 0; j < r1.size(); j++) {
-                auto& r2 = r1[j];
-
-                for (size_t k = 0; k < r2.size(); k++) {
-                    auto& r = r2[k];
-                    if (r.match_len > 0) {
-                        matchs.push_back(std::make_tuple(r.match_len, j, k));
-                    }
+            auto& matchs = this->m_candidates;
+            matchs.clear();
+            for (auto list : {&this->m_matched_rules[i], &this->m_live_rules[i]}) {
+                for (auto pos : *list) {
+                    auto& r = r1[pos.first][pos.second];
+                    if (r.match_len > 0)
+                        matchs.push_back(std::make_tuple(r.match_len, pos.first, pos.second));
                 }
             }
+            if (this->m_combined && this->m_combined_match_len[i] > 0)
+                matchs.push_back(this->combined_candidate(i));
 
             if (matchs.empty())
                 continue;
@@ -268,7 +377,7 @@ class Lexer
 
     std::pair<std::optional<std::shared_ptr<LexerToken>>, size_t>
     get_token_by_candidates(size_t major_index,
-                            std::vector<std::tuple<size_t, size_t, size_t>>& candidates)
+                            std::vector<candidate_t>& candidates)
     {
         assert(candidates.size() > 0);
         std::sort(candidates.rbegin(), candidates.rend());
@@ -296,8 +405,20 @@ class Lexer
         auto& ri = ra[std::get<2>(f1)];
         assert(ri.rule != nullptr);
         auto& rule = *ri.rule;
-        auto str = this->getcachestr(std::get<0>(f1));
-        return std::make_pair(rule.token(str), std::get<0>(f1));
+        const auto len = std::get<0>(f1);
+        if (!rule.keeps_text()) {
+            // the token text is the head of the cache, no replay nor copy
+            assert(len > 0 && len <= this->m_cache.size());
+            auto& last = this->m_cache[len - 1];
+            TextRange range(this->m_cache.front().pos, last.pos + last.len_in_bytes);
+            auto str = this->m_cache_chars.view().first(len);
+            return std::make_pair(rule.token(str, range), len);
+        }
+
+        if (ri.combined)
+            this->replay_combined_rule(ri);
+        auto str = this->getcachestr(len);
+        return std::make_pair(rule.token(str), len);
     }
 
     std::optional<std::shared_ptr<LexerToken>> m_notnull_last_token;
@@ -306,28 +427,51 @@ class Lexer
         if (last.has_value() && last.value() != nullptr)
             this->m_notnull_last_token = last;
 
-        for (auto& r1 : this->m_rules) {
-            for (auto& r2 : r1) {
-                for (auto& ri : r2) {
+        this->m_live_rules.resize(this->m_rules.size());
+        this->m_matched_rules.resize(this->m_rules.size());
+        for (size_t i = 0; i < this->m_rules.size(); i++) {
+            auto& live = this->m_live_rules[i];
+            live.clear();
+            this->m_matched_rules[i].clear();
+            for (size_t j = 0; j < this->m_rules[i].size(); j++) {
+                auto& r2 = this->m_rules[i][j];
+                for (size_t k = 0; k < r2.size(); k++) {
+                    auto& ri = r2[k];
+                    if (ri.combined)
+                        continue;
+
                     ri.reset(pos, this->m_notnull_last_token);
+                    if (!ri.rule->dead())
+                        live.push_back(std::make_pair(j, k));
                 }
             }
         }
         this->m_match_major_priority = std::nullopt;
+        this->m_fed_count = 0;
+
+        if (this->m_combined) {
+            this->m_combined_state = this->m_combined->dfa->start_state();
+            this->m_combined_match_len.assign(this->m_combined->nlevels, 0);
+        }
     }
 
     virtual void update_position_info(CharType c)
     {
+        if (this->m_recorder == nullptr) {
+            this->m_pos += this->char_length(c);
+            return;
+        }
+
         std::string str;
         if (this->m_encoder) {
             str = this->m_encoder(c);
         } else {
             str.push_back((char) c);
         }
-        this->m_pos = this->m_textinfo->push_str(str);
+        this->m_pos = this->m_recorder->push_str(str);
 
         if (c == traits::NEWLINE)
-            this->m_textinfo->newline();
+            this->m_recorder->newline();
     }
 
     void setup_rules_set()
@@ -336,6 +480,91 @@ class Lexer
         this->m_rules.back().resize(1);
     }
 
+    /** the combined automaton of @rules, mapped from @cache_file when it matches @checksum */
+    std::shared_ptr<const CombinedAutomaton>
+    build_combined_automaton(const std::vector<LexerRuleRegex<CharType>*>& regex_rules,
+                             const std::vector<typename CombinedAutomaton::RuleIndex>& rules,
+                             uint64_t checksum,
+                             const std::string& cache_file) const
+    {
+        std::optional<RegexDFAImage<CharType>> image;
+        if (!cache_file.empty())
+            image = RegexDFAImage<CharType>::load(cache_file, checksum);
+        if (image.has_value() && !image->has_accept_tags())
+            image = std::nullopt;
+        // the image checked that the tags of a state ascend, the last one bounds them all
+        for (size_t s = 0; image.has_value() && s < image->state_count(); s++) {
+            auto tags = image->accept_tags(s);
+            if (!tags.empty() && tags.back() >= rules.size())
+                image = std::nullopt;
+        }
+
+        if (!image.has_value()) {
+            std::vector<RegexNFA<CharType>> nfas;
+            for (auto rule : regex_rules)
+                nfas.push_back(rule->combinable_nfa());
+
+            auto dfa = RegexNFA<CharType>::tagged_union(nfas).compile();
+            dfa.optimize();
+            image = RegexDFAImage<CharType>::from_dfa(dfa, checksum);
+            if (!cache_file.empty())
+                image->save(cache_file);
+        }
+
+        auto ca = std::make_shared<CombinedAutomaton>();
+        ca->dfa = std::make_shared<RegexDFAImage<CharType>>(std::move(image.value()));
+        ca->rules = rules;
+        ca->nlevels = this->m_rules.size();
+
+        // a rule is alive in the states that can still reach one accepting it
+        auto& cdfa = *ca->dfa;
+        const auto nstates = cdfa.state_count();
+        std::vector<std::vector<size_t>> reverse_graph(nstates);
+        for (size_t s = 0; s < nstates; s++) {
+            for (size_t cls = 0; cls < cdfa.class_count(); cls++)
+                reverse_graph[cdfa.class_transition(s, cls)].push_back(s);
+        }
+        ca->level_alive.assign(nstates * ca->nlevels, 0);
+        for (size_t t = 0; t < rules.size(); t++) {
+            std::vector<bool> alive(nstates, false);
+            std::vector<size_t> stack;
+            for (size_t f = 0; f < nstates; f++) {
+                auto tags = cdfa.accept_tags(f);
+                if (std::binary_search(tags.begin(), tags.end(), t)) {
+                    alive[f] = true;
+                    stack.push_back(f);
+                }
+            }
+            while (!stack.empty()) {
+                auto s = stack.back();
+                stack.pop_back();
+                for (auto p : reverse_graph[s]) {
+                    if (!alive[p]) {
+                        alive[p] = true;
+                        stack.push_back(p);
+                    }
+                }
+            }
+            for (size_t s = 0; s < nstates; s++) {
+                if (alive[s])
+                    ca->level_alive[s * ca->nlevels + rules[t].major] = 1;
+            }
+        }
+
+        // same preference as get_token_by_candidates: smaller minor, then later rule
+        ca->level_best.assign(nstates * ca->nlevels, npos);
+        for (size_t s = 0; s < nstates; s++) {
+            for (auto t : cdfa.accept_tags(s)) {
+                auto& best = ca->level_best[s * ca->nlevels + rules[t].major];
+                if (best == npos || rules[t].minor < rules[best].minor ||
+                    (rules[t].minor == rules[best].minor && rules[t].index > rules[best].index)) {
+                    best = t;
+                }
+            }
+        }
+
+        return ca;
+    }
 
   public:
     Lexer(encoder_t encoder = nullptr) : m_encoder(encoder)
@@ -348,7 +577,7 @@ class Lexer
         this->setup_rules_set();
         this->reset(fn);
     }
-    ~Lexer() = default;
+    virtual ~Lexer() = default;
 
     Lexer(const Lexer&) = delete;
     Lexer(Lexer&&) = default;
@@ -357,10 +586,63 @@ class Lexer
     {
         this->m_filename = fn;
         this->m_cache.clear();
+        this->m_cache_chars.clear();
         this->m_match_major_priority = std::nullopt;
         this->m_pos = 0;
+        // the last token of the previous text would also pin its memory
+        this->m_notnull_last_token = std::nullopt;
         this->reset_rules(0, std::nullopt);
-        this->m_textinfo = std::make_shared<KLexerPositionInfo>(this->m_filename);
+        this->m_recorder = std::make_shared<KLexerPositionInfo>(this->m_filename);
+        this->m_textinfo = this->m_recorder;
+    }
+
+    /**
+     * lex the text of @source from byte @pos, where a token is assumed to
+     * start after @last, it must then be fed exactly the following characters.
+     * positions come from @source, the lexer keeps no copy of the text. the
+     * text is utf-8 when characters are wider than a byte, see char_length().
+     */
+    void reset(std::shared_ptr<BufferTextInfo> source,
+               size_t pos = 0,
+               std::optional<std::shared_ptr<LexerToken>> last = std::nullopt)
+    {
+        assert(pos <= source->len());
+        this->reset(source->filename());
+        this->m_recorder = nullptr;
+        this->m_textinfo = std::move(source);
+        this->m_pos = pos;
+        this->reset_rules(pos, last);
+    }
+
+    /**
+     * length in bytes of @c in a BufferTextInfo, whose text is utf-8 for
+     * characters wider than a byte, computed without going through the encoder
+     */
+    size_t char_length(CharType c) const
+    {
+        if constexpr (sizeof(CharType) == 1) {
+            return 1;
+        } else {
+            return UTF8Encoder::length(c);
+        }
+    }
+    /** byte position where the pending token starts */
+    size_t token_start() const
+    {
+        return this->m_cache.empty() ? this->m_pos : this->m_cache.front().pos;
+    }
+    /** whether a rule looks at the previous token, so a token start alone doesn't fix the state */
+    bool uses_last_token() const
+    {
+        for (auto& r1 : this->m_rules) {
+            for (auto& r2 : r1) {
+                for (auto& ri : r2) {
+                    if (ri.rule->uses_last_token())
+                        return true;
+                }
+            }
+        }
+        return false;
     }
 
     void reset()
@@ -397,7 +679,90 @@ class Lexer
         return *this;
     }
 
-    std::vector<std::shared_ptr<LexerToken>> feed_char(CharType c)
+    /**
+     * merge every LexerRuleRegex without a deter function into one tagged DFA,
+     * so feeding a character costs one transition instead of one call per rule.
+     * other rules keep being fed one by one, tokens are the same as before.
+     * rules added afterwards are not combined.
+     * with @cache_file the DFA is mapped from that file when it was built from
+     * the same rules, otherwise it's built and written there. the automaton is
+     * shared by every lexer combining the same rules in this process, so only
+     * the first of them reads or writes @cache_file.
+     */
+    void combine_rules(const std::string& cache_file = std::string())
+    {
+        using RuleIndex = typename CombinedAutomaton::RuleIndex;
+        std::vector<LexerRuleRegex<CharType>*> regex_rules;
+        std::vector<RuleIndex> rules;
+        uint64_t checksum = fnv1a_64_basis;
+        for (size_t i = 0; i < this->m_rules.size(); i++) {
+            for (size_t j = 0; j < this->m_rules[i].size(); j++) {
+                auto& r2 = this->m_rules[i][j];
+                for (size_t k = 0; k < r2.size(); k++) {
+                    auto rule = dynamic_cast<LexerRuleRegex<CharType>*>(r2[k].rule.get());
+                    if (rule == nullptr || rule->has_deter() || r2[k].combined)
+                        continue;
+
+                    regex_rules.push_back(rule);
+                    rules.push_back(RuleIndex{i, j, k});
+                    const uint64_t key[] = {i, j, k, rule->is_first_match()};
+                    checksum = fnv1a_64(key, sizeof(key), checksum);
+                    checksum = regex_patterns_checksum<CharType>({rule->pattern()}, checksum);
+                }
+            }
+        }
+        if (rules.empty())
+            return;
+
+        // the same rules give the same automaton, it is built once per process
+        std::string key = "lexer";
+        key.push_back('\0');
+        const auto append_key = [&key](const void* data, size_t size) {
+            key.append(static_cast<const char*>(data), size);
+        };
+        const uint64_t nlevels = this->m_rules.size();
+        append_key(&nlevels, sizeof(nlevels));
+        for (size_t t = 0; t < rules.size(); t++) {
+            auto& pattern = regex_rules[t]->pattern();
+            const uint64_t fields[] = {rules[t].major,
+                                       rules[t].minor,
+                                       rules[t].index,
+                                       regex_rules[t]->is_first_match(),
+                                       pattern.size()};
+            append_key(fields, sizeof(fields));
+            append_key(pattern.data(), pattern.size() * sizeof(CharType));
+        }
+        auto ca = RegexCache<CharType>::instance().template get<CombinedAutomaton>(key, [&]() {
+            return this->build_combined_automaton(regex_rules, rules, checksum, cache_file);
+        });
+
+        for (auto& r : rules)
+            this->m_rules[r.major][r.minor][r.index].combined = true;
+        this->m_combined = ca;
+        this->m_combined_match_len.assign(ca->nlevels, 0);
+        this->m_combined_match_rule.assign(ca->nlevels, 0);
+        this->m_combined_state = ca->dfa->start_state();
+    }
+
+    std::shared_ptr<const CombinedAutomaton> combined_automaton() const
+    {
+        return this->m_combined;
+    }
+    /** whether every rule is driven by the combined automaton */
+    bool all_rules_combined() const
+    {
+        for (auto& r1 : this->m_rules) {
+            for (auto& r2 : r1) {
+                for (auto& ri : r2) {
+                    if (!ri.combined)
+                        return false;
+                }
+            }
+        }
+        return this->m_combined != nullptr;
+    }
+
+    void feed_char(CharType c, TokenSink& sink)
     {
         if (this->m_pos == 0)
             this->reset_rules(0, std::nullopt);
@@ -406,32 +771,19 @@ class Lexer
         this->update_position_info(c);
         assert(this->m_pos > old_pos);
         this->m_cache.push_back(CharInfo(c, old_pos, this->m_pos - old_pos));
-        return this->push_cache_to_end(this->m_cache.size());
+        this->m_cache_chars.push_back(c);
+        this->push_cache_to_end(this->m_cache.size() - 1, sink);
     }
 
-    template<typename Iterator>
-    std::vector<std::shared_ptr<LexerToken>> feed_char(Iterator begin, Iterator end)
-    {
-        std::vector<std::shared_ptr<LexerToken>> ret;
-
-        for (; begin != end; begin++) {
-            auto r = this->feed_char(*begin);
-            ret.insert(ret.end(), r.begin(), r.end());
-        }
-
-        return ret;
-    }
-
-    template<typename Container>
-    std::vector<std::shared_ptr<LexerToken>> feed_char(const Container& c)
+    /** feed all of @text, tokens go to @sink as soon as they are complete */
+    void feed(std::span<const CharType> text, TokenSink& sink)
     {
-        return this->feed_char(c.begin(), c.end());
+        for (auto c : text)
+            this->feed_char(c, sink);
     }
 
-    std::vector<std::shared_ptr<LexerToken>> feed_end()
+    void feed_end(TokenSink& sink)
     {
-        std::vector<std::shared_ptr<LexerToken>> tokens;
-
         while (!this->m_cache.empty()) {
             auto [token, len] = this->feed_end_internal();
             assert(len <= this->m_cache.size());
@@ -441,22 +793,50 @@ class Lexer
                 assert(len > 0);
                 auto val = token.value();
                 if (val != nullptr)
-                    tokens.push_back(val);
+                    this->emit(val, sink);
 
                 size_t reset_pos = this->m_pos;
                 if (this->m_cache.size() > len)
                     reset_pos = this->m_cache[len].pos;
                 this->reset_rules(reset_pos, val);
-                this->m_cache.erase(this->m_cache.begin(), this->m_cache.begin() + len);
+                this->drop_cache(len);
 
-                if (!this->m_cache.empty()) {
-                    auto nx = this->push_cache_to_end(1);
-                    for (auto t : nx)
-                        tokens.push_back(t);
-                }
+                if (!this->m_cache.empty())
+                    this->push_cache_to_end(0, sink);
             }
         }
+    }
 
+    std::vector<std::shared_ptr<LexerToken>> feed_char(CharType c)
+    {
+        std::vector<std::shared_ptr<LexerToken>> tokens;
+        TokenBufferSink sink(tokens);
+        this->feed_char(c, sink);
+        return tokens;
+    }
+
+    template<typename Iterator>
+    std::vector<std::shared_ptr<LexerToken>> feed_char(Iterator begin, Iterator end)
+    {
+        std::vector<std::shared_ptr<LexerToken>> tokens;
+        TokenBufferSink sink(tokens);
+        for (; begin != end; begin++)
+            this->feed_char(*begin, sink);
+
+        return tokens;
+    }
+
+    template<typename Container>
+    std::vector<std::shared_ptr<LexerToken>> feed_char(const Container& c)
+    {
+        return this->feed_char(c.begin(), c.end());
+    }
+
+    std::vector<std::shared_ptr<LexerToken>> feed_end()
+    {
+        std::vector<std::shared_ptr<LexerToken>> tokens;
+        TokenBufferSink sink(tokens);
+        this->feed_end(sink);
         return tokens;
     }
 
@@ -4,6 +4,7 @@
 #include "token.h"
 #include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -22,6 +23,31 @@ class LexerRule
     virtual void reset(size_t pos, std::optional<std::shared_ptr<LexerToken>> last_token) = 0;
     virtual std::shared_ptr<LexerToken> token(std::vector<CharType> str) = 0;
 
+    /**
+     * whether token() builds the token from the characters fed since reset.
+     * otherwise the lexer calls token(str, range) instead, without buffering
+     * the text in the rule.
+     */
+    virtual bool keeps_text() const
+    {
+        return true;
+    }
+    /**
+     * token of @str, the matched characters, covering their range. @str is
+     * only valid during the call. the default ignores the range and goes
+     * through token(str) like a rule keeping its text.
+     */
+    virtual std::shared_ptr<LexerToken> token(std::span<const CharType> str, TextRange)
+    {
+        return this->token(std::vector<CharType>(str.begin(), str.end()));
+    }
+
+    /** whether the rule depends on the last token given to reset() */
+    virtual bool uses_last_token() const
+    {
+        return false;
+    }
+
     virtual ~LexerRule() = default;
 };
 
@@ -5,6 +5,8 @@
 #include "./lexer_rule.hpp"
 #include "./token.h"
 #include <functional>
+#include <memory>
+#include <span>
 #include <vector>
 
 
@@ -19,11 +21,15 @@ class LexerRuleRegex : public LexerRule<T>
     using string_t = std::vector<CharType>;
     using token_factory_t =
         std::function<std::shared_ptr<LexerToken>(std::vector<CharType> str, TextRange)>;
+    using view_token_factory_t =
+        std::function<std::shared_ptr<LexerToken>(std::span<const CharType> str, TextRange)>;
     bool m_resetted;
     TextRange m_range;
     string_t m_string;
+    string_t m_pattern;
     SimpleRegExp<CharType> m_regex;
     token_factory_t m_token_factory;
+    view_token_factory_t m_view_token_factory;
     DeterType m_deter;
 
     bool _opt_compile, _opt_first_match;
@@ -34,8 +40,11 @@ class LexerRuleRegex : public LexerRule<T>
         this->_opt_first_match = first_match;
         this->match_dead = false;
 
-        if (this->_opt_compile)
+        if (this->_opt_compile) {
             this->m_regex.compile();
+        } else if (!this->m_regex.is_bit_parallel()) {
+            this->m_regex.compile_lazy();
+        }
     }
 
   public:
@@ -47,7 +56,11 @@ class LexerRuleRegex : public LexerRule<T>
                    bool compile = true,
                    bool first_match = false,
                    DeterType deter = nullptr)
-        : m_resetted(false), m_regex(begin, end), m_token_factory(factory), m_deter(deter)
+        : m_resetted(false),
+          m_pattern(begin, end),
+          m_regex(m_pattern),
+          m_token_factory(factory),
+          m_deter(deter)
     {
         this->apply_options(compile, first_match);
     }
@@ -57,7 +70,8 @@ class LexerRuleRegex : public LexerRule<T>
                    bool compile = true,
                    bool first_match = false,
                    DeterType deter = nullptr)
-        : m_regex(std::vector<CharType>(regex.begin(), regex.end())),
+        : m_pattern(regex.begin(), regex.end()),
+          m_regex(m_pattern),
           m_token_factory(factory),
           m_deter(deter)
     {
@@ -69,13 +83,86 @@ class LexerRuleRegex : public LexerRule<T>
                    bool compile = true,
                    bool first_match = false,
                    DeterType deter = nullptr)
-        : m_regex(std::vector<CharType>(regex.begin(), regex.end())),
+        : m_pattern(regex.begin(), regex.end()),
+          m_regex(m_pattern),
           m_token_factory(factory),
           m_deter(deter)
     {
         this->apply_options(compile, first_match);
     }
 
+    /**
+     * a rule whose @factory gets a view of the token text, valid only during
+     * the call. the rule doesn't buffer its text, a factory keeping it copies it.
+     */
+    static std::unique_ptr<LexerRuleRegex> with_view(const std::vector<CharType>& regex,
+                                                     view_token_factory_t factory,
+                                                     bool compile = true,
+                                                     bool first_match = false,
+                                                     DeterType deter = nullptr)
+    {
+        auto rule = std::make_unique<LexerRuleRegex>(regex, nullptr, compile, first_match, deter);
+        rule->m_view_token_factory = std::move(factory);
+        return rule;
+    }
+    static std::unique_ptr<LexerRuleRegex> with_view(const std::basic_string<CharType>& regex,
+                                                     view_token_factory_t factory,
+                                                     bool compile = true,
+                                                     bool first_match = false,
+                                                     DeterType deter = nullptr)
+    {
+        return with_view(std::vector<CharType>(regex.begin(), regex.end()),
+                         std::move(factory),
+                         compile,
+                         first_match,
+                         std::move(deter));
+    }
+
+    bool has_deter() const
+    {
+        return this->m_deter != nullptr;
+    }
+    virtual bool uses_last_token() const override
+    {
+        return this->has_deter();
+    }
+    bool is_first_match() const
+    {
+        return this->_opt_first_match;
+    }
+    const std::vector<CharType>& pattern() const
+    {
+        return this->m_pattern;
+    }
+
+    /**
+     * NFA accepting the same strings as this rule. for first_match rules
+     * every transition out of a final state is cut, so they stop at the
+     * first match like feed() does.
+     */
+    RegexNFA<CharType> combinable_nfa() const
+    {
+        auto nfa = this->m_regex.get_nfa();
+        if (!this->_opt_first_match)
+            return *nfa;
+
+        auto cached = RegexCache<CharType>::instance().dfa(this->m_pattern);
+        auto& dfa = *cached;
+        assert(!dfa.dead_states().empty());
+        const auto dead_state = *dfa.dead_states().begin();
+        auto table = dfa.transitions();
+        for (auto f : dfa.final_states()) {
+            table[f].clear();
+            table[f].emplace_back(character_traits<CharType>::MIN,
+                                  character_traits<CharType>::MAX,
+                                  dead_state);
+        }
+
+        RegexDFA<CharType> cut(
+            std::move(table), dfa.start_state(), dfa.dead_states(), dfa.final_states());
+        return cut.toNodeNFA().toRegexNFA();
+    }
+
     virtual void feed(CharType c, size_t length_in_bytes) override
     {
         if (this->_opt_first_match && this->m_regex.match()) {
@@ -85,7 +172,8 @@ class LexerRuleRegex : public LexerRule<T>
 
         this->m_regex.feed(c);
         if (!this->dead()) {
-            this->m_string.push_back(c);
+            if (!this->m_view_token_factory)
+                this->m_string.push_back(c);
             this->m_range.second += length_in_bytes;
         }
     }
@@ -114,8 +202,22 @@ class LexerRuleRegex : public LexerRule<T>
     virtual std::shared_ptr<LexerToken> token(std::vector<CharType> str) override
     {
         assert(this->m_resetted);
+        if (this->m_view_token_factory)
+            return this->m_view_token_factory(str, this->m_range);
         return this->m_token_factory(this->m_string, this->m_range);
     }
+
+    virtual bool keeps_text() const override
+    {
+        return !this->m_view_token_factory;
+    }
+    virtual std::shared_ptr<LexerToken> token(std::span<const CharType> str,
+                                              TextRange range) override
+    {
+        if (!this->m_view_token_factory)
+            return LexerRule<CharType>::token(str, range);
+        return this->m_view_token_factory(str, range);
+    }
 };
 
 #endif // _LEXER_LEXER_RULE_REGEX_HPP_
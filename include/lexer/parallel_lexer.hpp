@@ -0,0 +1,140 @@
+#ifndef _LEXER_PARALLEL_LEXER_HPP_
+#define _LEXER_PARALLEL_LEXER_HPP_
+
+#include "regex/regex_char.hpp"
+#include "regex/worker_pool.hpp"
+#include "text_info.h"
+#include "token_sink.hpp"
+#include <algorithm>
+#include <assert.h>
+#include <exception>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+
+/**
+ * lex @text, the characters of @source, with lexers made by @make_lexer on up
+ * to @threads threads. tokens go to @sink in order, the same ones a single
+ * lexer would give.
+ *
+ * the text is cut after newlines into chunks of at least @min_chunk
+ * characters. every chunk but the first is lexed speculatively as if a
+ * token started there, recording the position of every token start it
+ * reaches. then the lexer of the previous chunk goes on into the chunk until
+ * it starts a token where the speculative lexer did, from there both agree
+ * and the speculative tokens are taken. a chunk starting inside a comment
+ * or a string literal is thus fixed up by lexing up to the end of it again.
+ *
+ * a lexer provides reset(source, pos), feed_char(c, sink), feed_end(sink),
+ * token_start(), char_length(c) and uses_last_token(). lexers whose rules
+ * look at the last token are run on one thread.
+ */
+template<typename CharType, typename MakeLexer>
+void lex_parallel(std::shared_ptr<BufferTextInfo> source,
+                  std::span<const CharType> text,
+                  MakeLexer make_lexer,
+                  TokenSink& sink,
+                  size_t threads,
+                  size_t min_chunk = 1 << 16)
+{
+    using traits = character_traits<CharType>;
+    auto first = make_lexer();
+    std::vector<size_t> bounds = {0};
+    if (threads > 1 && !first->uses_last_token()) {
+        const size_t nchunks = std::min(threads, text.size() / std::max<size_t>(min_chunk, 1));
+        for (size_t i = 1; i < nchunks; i++) {
+            auto pos = std::max(bounds.back() + min_chunk, text.size() * i / nchunks);
+            while (pos < text.size() && text[pos - 1] != traits::NEWLINE)
+                pos++;
+            if (pos >= text.size())
+                break;
+            bounds.push_back(pos);
+        }
+    }
+    bounds.push_back(text.size());
+    const size_t nchunks = bounds.size() - 1;
+
+    if (nchunks == 1) {
+        first->reset(source);
+        for (auto c : text)
+            first->feed_char(c, sink);
+        first->feed_end(sink);
+        return;
+    }
+
+    using lexer_t = typename decltype(first)::element_type;
+    struct Chunk
+    {
+        std::unique_ptr<lexer_t> lexer;
+        size_t offset = 0;
+        std::vector<std::shared_ptr<LexerToken>> tokens;
+        // token starts reached, with the number of tokens before them
+        std::vector<std::pair<size_t, size_t>> starts;
+        std::exception_ptr error;
+    };
+    std::vector<Chunk> chunks(nchunks);
+    chunks[0].lexer = std::move(first);
+
+    // both passes run on the same threads
+    WorkerPool pool(std::min(threads, nchunks));
+
+    // byte length of every chunk, then where each one starts in @source
+    pool.run(nchunks, [&](size_t i) {
+        auto& chunk = chunks[i];
+        if (chunk.lexer == nullptr)
+            chunk.lexer = make_lexer();
+        for (size_t k = bounds[i]; k < bounds[i + 1]; k++)
+            chunk.offset += chunk.lexer->char_length(text[k]);
+    });
+    for (size_t i = 0, offset = 0; i < nchunks; i++)
+        offset += std::exchange(chunks[i].offset, offset);
+
+    pool.run(nchunks, [&](size_t i) {
+        auto& chunk = chunks[i];
+        auto& lexer = *chunk.lexer;
+        TokenBufferSink tokens(chunk.tokens);
+        try {
+            lexer.reset(source, chunk.offset);
+            chunk.starts.emplace_back(chunk.offset, 0);
+            for (size_t k = bounds[i]; k < bounds[i + 1]; k++) {
+                lexer.feed_char(text[k], tokens);
+                if (lexer.token_start() != chunk.starts.back().first)
+                    chunk.starts.emplace_back(lexer.token_start(), chunk.tokens.size());
+            }
+        } catch (...) {
+            // a speculative chunk may start where no rule matches
+            chunk.error = std::current_exception();
+            chunk.starts.clear();
+        }
+    });
+
+    if (chunks[0].error)
+        std::rethrow_exception(chunks[0].error);
+    for (auto& token : chunks[0].tokens)
+        sink.push(token);
+
+    auto lexer = std::move(chunks[0].lexer);
+    for (size_t i = 1; i < nchunks; i++) {
+        auto& chunk = chunks[i];
+        auto start = chunk.starts.begin();
+        bool synced = false;
+        for (size_t k = bounds[i]; k < bounds[i + 1] && !synced; k++) {
+            lexer->feed_char(text[k], sink);
+            const auto pos = lexer->token_start();
+            while (start != chunk.starts.end() && start->first < pos)
+                ++start;
+            synced = start != chunk.starts.end() && start->first == pos;
+        }
+        if (!synced)
+            continue;
+
+        for (size_t t = start->second; t < chunk.tokens.size(); t++)
+            sink.push(chunk.tokens[t]);
+        lexer = std::move(chunk.lexer);
+    }
+    lexer->feed_end(sink);
+}
+
+#endif // _LEXER_PARALLEL_LEXER_HPP_
@@ -0,0 +1,293 @@
+#ifndef _LEXER_SCANNER_CODEGEN_HPP_
+#define _LEXER_SCANNER_CODEGEN_HPP_
+
+#include "lexer.hpp"
+#include "lexer_error.h"
+#include "regex/regex_char_class.hpp"
+#include <algorithm>
+#include <assert.h>
+#include <cctype>
+#include <functional>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+enum class ScannerStyle
+{
+    /** one label per state, characters dispatched by a binary if-tree and goto */
+    Direct,
+    /** constexpr tables walked by a loop */
+    Table,
+};
+
+namespace scanner_codegen_detail {
+
+template<typename T>
+const char* char_type_name()
+{
+    if constexpr (std::is_same<T, char>::value) {
+        return "char";
+    } else if constexpr (std::is_same<T, wchar_t>::value) {
+        return "wchar_t";
+    } else if constexpr (std::is_same<T, char16_t>::value) {
+        return "char16_t";
+    } else if constexpr (std::is_same<T, char32_t>::value) {
+        return "char32_t";
+    } else if constexpr (std::is_same<T, int>::value) {
+        return "int";
+    } else {
+        static_assert(std::is_same<T, int>::value, "unsupported scanner character type");
+    }
+}
+
+template<typename T>
+std::string char_literal(T c)
+{
+    if constexpr (std::is_signed<T>::value) {
+        return "char_type(" + std::to_string(static_cast<long long>(c)) + ")";
+    } else {
+        return "char_type(" + std::to_string(static_cast<unsigned long long>(c)) + "u)";
+    }
+}
+
+inline std::string size_literal(size_t n)
+{
+    if (n == std::numeric_limits<size_t>::max())
+        return "npos";
+    return std::to_string(n);
+}
+
+/** what the lexer does in one state of the combined automaton */
+struct StateAction
+{
+    // lowest major priority accepted here and the rule picked for it, npos if none
+    size_t accept_level, accept_rule;
+    // lowest major priority still alive, npos in the dead state
+    size_t min_alive;
+};
+
+} // namespace scanner_codegen_detail
+
+/**
+ * emit a standalone C++ header defining the struct @class_name, a scanner
+ * equivalent to @lexer. every rule of @lexer must be combined, see
+ * Lexer::combine_rules(). the struct provides
+ *
+ *   static size_t longest_match(const char_type* begin, const char_type* end, size_t& rule);
+ *
+ * returning the length of the token Lexer would emit at @begin and storing its
+ * rule index, rules are numbered in the order they were added. 0 means no
+ * rule matches. the header depends on nothing but <cstddef>.
+ */
+template<typename T>
+std::string generate_scanner(const Lexer<T>& lexer,
+                             const std::string& class_name,
+                             ScannerStyle style = ScannerStyle::Direct)
+{
+    using namespace scanner_codegen_detail;
+    constexpr auto npos = std::numeric_limits<size_t>::max();
+    if (!lexer.all_rules_combined())
+        throw LexerError("generate_scanner: lexer has rules outside of the combined automaton");
+
+    auto ca = lexer.combined_automaton();
+    auto& image = *ca->dfa;
+    const auto dfa = image.to_dfa();
+    const auto nstates = dfa.state_count();
+    const auto nlevels = ca->nlevels;
+
+    std::vector<StateAction> actions(nstates, StateAction{npos, npos, npos});
+    for (size_t s = 0; s < nstates; s++) {
+        auto& action = actions[s];
+        for (size_t level = nlevels; level-- > 0;) {
+            if (ca->level_alive[s * nlevels + level])
+                action.min_alive = level;
+            if (ca->level_best[s * nlevels + level] != npos) {
+                action.accept_level = level;
+                action.accept_rule = ca->level_best[s * nlevels + level];
+            }
+        }
+    }
+
+    std::string guard = "_GENERATED_SCANNER_";
+    for (auto c : class_name)
+        guard.push_back(std::isalnum(static_cast<unsigned char>(c)) ? std::toupper(c) : '_');
+    guard += "_HPP_";
+
+    std::ostringstream out;
+    out << "// generated by generate_scanner(), do not edit\n"
+        << "#ifndef " << guard << "\n#define " << guard << "\n\n"
+        << "#include <cstddef>\n\n\n"
+        << "struct " << class_name << "\n{\n"
+        << "    using char_type = " << char_type_name<T>() << ";\n"
+        << "    static constexpr size_t rule_count = " << ca->rules.size() << ";\n"
+        << "    static constexpr size_t npos = static_cast<size_t>(-1);\n\n";
+
+    // the start state is never checked for acceptance, Lexer only matches after a character
+    const auto emit_action = [&](const std::string& indent, size_t s) {
+        auto& action = actions[s];
+        if (action.accept_level == 0) {
+            out << indent << "level = 0;\n"
+                << indent << "len = p - begin;\n"
+                << indent << "rule = " << action.accept_rule << ";\n";
+        } else if (action.accept_level != npos) {
+            out << indent << "if (" << action.accept_level << " <= level) {\n"
+                << indent << "    level = " << action.accept_level << ";\n"
+                << indent << "    len = p - begin;\n"
+                << indent << "    rule = " << action.accept_rule << ";\n"
+                << indent << "}\n";
+        }
+        if (action.min_alive == npos) {
+            out << indent << "return len;\n";
+        } else if (action.min_alive > 0) {
+            out << indent << "if (level < " << action.min_alive << ")\n"
+                << indent << "    return len;\n";
+        }
+    };
+
+    if (style == ScannerStyle::Direct) {
+        std::vector<bool> is_target(nstates, false);
+        for (size_t s = 0; s < nstates; s++) {
+            if (actions[s].min_alive == npos)
+                continue;
+            for (auto& entry : dfa.transitions()[s])
+                is_target[entry.state] = true;
+        }
+
+        const std::function<void(const std::string&, size_t, size_t, size_t)> emit_dispatch =
+            [&](const std::string& indent, size_t s, size_t lo, size_t hi) {
+                auto& row = dfa.transitions()[s];
+                if (lo == hi) {
+                    auto& target = actions[row[lo].state];
+                    if (target.min_alive == npos && target.accept_level == npos) {
+                        out << indent << "return len;\n";
+                    } else {
+                        out << indent << "goto s" << row[lo].state << ";\n";
+                    }
+                    return;
+                }
+
+                const auto mid = (lo + hi + 1) / 2;
+                out << indent << "if (c < " << char_literal<T>(row[mid].low) << ") {\n";
+                emit_dispatch(indent + "    ", s, lo, mid - 1);
+                out << indent << "} else {\n";
+                emit_dispatch(indent + "    ", s, mid, hi);
+                out << indent << "}\n";
+            };
+
+        out << "    static size_t longest_match(const char_type* begin, const char_type* end, "
+               "size_t& rule)\n"
+            << "    {\n"
+            << "        const char_type* p = begin;\n"
+            << "        size_t len = 0, level = npos;\n"
+            << "        char_type c;\n"
+            << "        goto t" << dfa.start_state() << ";\n\n";
+        for (size_t s = 0; s < nstates; s++) {
+            const bool alive = actions[s].min_alive != npos;
+            const bool start = s == dfa.start_state();
+            if (!start && (!is_target[s] || (!alive && actions[s].accept_level == npos)))
+                continue;
+
+            if (is_target[s]) {
+                out << "    s" << s << ":\n";
+                emit_action("        ", s);
+            }
+            if (start) {
+                out << "    t" << s << ":\n";
+                if (!alive)
+                    out << "        return len;\n";
+            }
+            if (!alive)
+                continue;
+
+            out << "        if (p == end)\n"
+                << "            return len;\n"
+                << "        c = *p++;\n";
+            emit_dispatch("        ", s, 0, dfa.transitions()[s].size() - 1);
+            out << "\n";
+        }
+        out << "    }\n";
+    } else {
+        std::vector<T> lows;
+        for (auto& trans : dfa.transitions()) {
+            for (auto& entry : trans)
+                lows.push_back(entry.low);
+        }
+        std::sort(lows.begin(), lows.end());
+        lows.erase(std::unique(lows.begin(), lows.end()), lows.end());
+        std::vector<std::vector<size_t>> columns(lows.size(), std::vector<size_t>(nstates));
+        for (size_t i = 0; i < lows.size(); i++) {
+            for (size_t s = 0; s < nstates; s++)
+                columns[i][s] = dfa.range_transition(s, lows[i]);
+        }
+        auto classes = CharClassMap<T>::from_boundaries(
+            lows, [&](size_t i, T) { return columns[i]; });
+        const auto nclasses = classes.size();
+
+        const auto emit_array = [&](const char* type, const char* name, size_t n, auto value) {
+            out << "    static constexpr " << type << " " << name << "[" << n << "] = {";
+            for (size_t i = 0; i < n; i++)
+                out << (i % 12 == 0 ? "\n        " : " ") << value(i) << ",";
+            out << "\n    };\n";
+        };
+        emit_array("char_type", "interval_lows", lows.size(), [&](size_t i) {
+            return char_literal<T>(lows[i]);
+        });
+        emit_array("unsigned", "interval_class", lows.size(), [&](size_t i) {
+            return std::to_string(classes.interval_classes()[i]);
+        });
+        emit_array("unsigned", "transitions", nstates * nclasses, [&](size_t i) {
+            const auto s = i / nclasses, cls = i % nclasses;
+            return std::to_string(
+                dfa.range_transition(s, classes.representative(cls)));
+        });
+        emit_array("size_t", "accept_level", nstates, [&](size_t s) {
+            return size_literal(actions[s].accept_level);
+        });
+        emit_array("size_t", "accept_rule", nstates, [&](size_t s) {
+            return size_literal(actions[s].accept_rule);
+        });
+        emit_array("size_t", "min_alive", nstates, [&](size_t s) {
+            return size_literal(actions[s].min_alive);
+        });
+
+        out << "\n"
+            << "    static size_t char_class(char_type c)\n"
+            << "    {\n"
+            << "        size_t lo = 0, hi = " << lows.size() << ";\n"
+            << "        while (hi - lo > 1) {\n"
+            << "            const size_t mid = (lo + hi) / 2;\n"
+            << "            if (c < interval_lows[mid]) {\n"
+            << "                hi = mid;\n"
+            << "            } else {\n"
+            << "                lo = mid;\n"
+            << "            }\n"
+            << "        }\n"
+            << "        return interval_class[lo];\n"
+            << "    }\n\n"
+            << "    static size_t longest_match(const char_type* begin, const char_type* end, "
+               "size_t& rule)\n"
+            << "    {\n"
+            << "        size_t len = 0, level = npos;\n"
+            << "        size_t state = " << dfa.start_state() << ";\n"
+            << "        for (const char_type* p = begin; p != end;) {\n"
+            << "            state = transitions[state * " << nclasses << " + char_class(*p++)];\n"
+            << "            if (accept_level[state] != npos && accept_level[state] <= level) {\n"
+            << "                level = accept_level[state];\n"
+            << "                len = p - begin;\n"
+            << "                rule = accept_rule[state];\n"
+            << "            }\n"
+            << "            if (min_alive[state] == npos || level < min_alive[state])\n"
+            << "                return len;\n"
+            << "        }\n"
+            << "        return len;\n"
+            << "    }\n";
+    }
+
+    out << "};\n\n#endif // " << guard << "\n";
+    return out.str();
+}
+
+#endif // _LEXER_SCANNER_CODEGEN_HPP_
@@ -1,8 +1,10 @@
 #ifndef _LEXER_SIMPLE_LEXER_HPP_
 #define _LEXER_SIMPLE_LEXER_HPP_
 
+#include "input_window.hpp"
 #include "lexer.hpp"
 #include "lexer_error.h"
+#include <algorithm>
 #include <assert.h>
 #include <memory>
 #include <string>
@@ -30,16 +32,18 @@ class SimpleLexer : public ISimpleLexer
 
   private:
     std::unique_ptr<Lexer<CharType>> lexer;
-    std::vector<token_t> token_buffer;
+    // tokens from the oldest one back() can reach, cur_pos is the next one
+    InputWindow<token_t> token_buffer;
     size_t cur_pos;
     std::vector<CharType> buffer;
     size_t buf_pos;
 
     void clean_token_buffer()
     {
-        while (cur_pos >= 0 && token_buffer.size() > 10) {
-            token_buffer.erase(token_buffer.begin());
-            cur_pos--;
+        if (token_buffer.size() > 10) {
+            const auto n = std::min(token_buffer.size() - 10, cur_pos);
+            token_buffer.release(n);
+            cur_pos -= n;
         }
     }
 
@@ -51,25 +55,16 @@ class SimpleLexer : public ISimpleLexer
         if (cur_pos < token_buffer.size() || buf_pos == buffer.size())
             return;
 
-        while (buf_pos < buffer.size()) {
-            auto c = buffer[buf_pos];
-            buf_pos++;
+        const auto filled = token_buffer.size();
+        TokenCallbackSink sink(
+            [this](token_t token) { token_buffer.push_back(std::move(token)); });
+        while (buf_pos < buffer.size() && token_buffer.size() == filled)
+            lexer->feed_char(buffer[buf_pos++], sink);
 
-            auto tokens = lexer->feed_char(c);
-            if (!tokens.empty()) {
-                token_buffer.insert(token_buffer.end(), tokens.begin(), tokens.end());
-                this->clean_token_buffer();
-                break;
-            }
-        }
-
-        if (buf_pos == buffer.size()) {
-            auto tokens = lexer->feed_end();
-            if (!tokens.empty()) {
-                token_buffer.insert(token_buffer.end(), tokens.begin(), tokens.end());
-                this->clean_token_buffer();
-            }
-        }
+        if (buf_pos == buffer.size())
+            lexer->feed_end(sink);
+        if (token_buffer.size() > filled)
+            this->clean_token_buffer();
     }
 
   public:
@@ -1,10 +1,16 @@
 #ifndef _LEXER_POSITION_INFO_H_
 #define _LEXER_POSITION_INFO_H_
 
+#include <cstddef>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
+class MappedFile;
+
 
 class TextRangeEntity
 {
@@ -26,6 +32,8 @@ class TextRangeEntity
     std::optional<size_t> end() const;
     std::optional<size_t> length() const;
     void benowhere();
+    /** move the range by @offset bytes */
+    void shift(std::ptrdiff_t offset);
 
     inline void contain(const TextRangeEntity& other)
     {
@@ -75,4 +83,37 @@ class TextInfo
     virtual ~TextInfo() = default;
 };
 
+
+/**
+ * TextInfo of a text already in memory, a buffer of the caller or a mapped
+ * file, so a lexer reading it keeps no copy. the line table is built on the
+ * first query() or line_range().
+ */
+class BufferTextInfo : public TextInfo
+{
+  private:
+    std::string m_filename;
+    std::shared_ptr<MappedFile> m_file;
+    std::string_view m_text;
+    mutable std::once_flag m_lines_once;
+    // start of every line
+    mutable std::vector<size_t> m_lines;
+
+    const std::vector<size_t>& line_starts() const;
+
+  public:
+    /** @text must outlive this object */
+    BufferTextInfo(std::string_view text, std::string filename = "");
+    /** nullptr when @path can't be opened or mapped */
+    static std::shared_ptr<BufferTextInfo> map_file(const std::string& path);
+
+    std::string_view text() const;
+
+    virtual const std::string& filename() const override;
+    virtual size_t len() const override;
+    virtual PInfo query(size_t pos) const override;
+    virtual std::pair<size_t, size_t> line_range(size_t line) const override;
+    virtual std::string query_string(size_t from, size_t to) const override;
+};
+
 #endif // _LEXER_POSITION_INFO_H_
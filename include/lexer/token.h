@@ -39,10 +39,17 @@ size_t CharID()
 using TextRange = TextRangeEntity::TextRange;
 class LexerToken : public DChar
 {
+  private:
+    size_t m_extent;
+
   public:
     LexerToken();
     LexerToken(TextRange info);
 
+    /** bytes from the start of the token the lexer had read to emit it, lookahead included */
+    size_t extent() const;
+    void set_extent(size_t bytes);
+
     virtual ~LexerToken() = default;
 };
 
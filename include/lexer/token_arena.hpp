@@ -0,0 +1,205 @@
+#ifndef _LEXER_TOKEN_ARENA_HPP_
+#define _LEXER_TOKEN_ARENA_HPP_
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+/**
+ * bump allocator for the tokens of one translation unit. a token made with
+ * make_token() while a Scope of the arena is alive on the thread gets its
+ * object and its shared_ptr control block from the arena. the handles are
+ * still std::shared_ptr, only the allocation per token is saved.
+ *
+ * freeing a token is a no-op, its memory is never reused. all of it is
+ * released at once when the arena and every token allocated from it are
+ * gone. tokens may thus safely outlive the arena, but a single one kept past
+ * the translation unit, by an AST node or an error for instance, keeps the
+ * whole arena alive. copy what has to outlive the unit into a heap token.
+ *
+ * an arena is not thread-safe, a Scope only affects its own thread, and it
+ * must be destroyed on the thread that created it. tokens may be released
+ * from any thread. allocating and releasing on the creating thread while the
+ * arena lives only bumps plain counters. a token released elsewhere, or after
+ * the arena, costs one atomic operation, on top of those of its shared_ptr.
+ */
+class TokenArena
+{
+  private:
+    struct Pool
+    {
+        std::vector<std::unique_ptr<std::byte[]>> blocks;
+        std::byte* cursor = nullptr;
+        size_t left = 0;
+        size_t block_size;
+        size_t used = 0;
+
+        // the creating thread counts without atomics while the arena lives
+        const std::thread::id owner = std::this_thread::get_id();
+        bool arena_alive = true;
+        size_t allocated = 0;
+        size_t owner_freed = 0;
+        // frees counted atomically, down from a bias the arena trades for
+        // allocated - owner_freed when it dies. the pool goes at zero
+        static constexpr size_t bias = std::numeric_limits<size_t>::max() / 2;
+        std::atomic<size_t> live = bias;
+
+        void drop(size_t count)
+        {
+            if (this->live.fetch_sub(count, std::memory_order_acq_rel) == count)
+                delete this;
+        }
+
+        /** an allocation was freed, on any thread */
+        void release()
+        {
+            // other threads never read arena_alive, only the owner writes it
+            if (std::this_thread::get_id() == this->owner && this->arena_alive) {
+                this->owner_freed++;
+                return;
+            }
+            this->drop(1);
+        }
+
+        /** the arena is gone, on the owner thread */
+        void release_arena()
+        {
+            assert(std::this_thread::get_id() == this->owner);
+            this->arena_alive = false;
+            this->drop(bias - (this->allocated - this->owner_freed));
+        }
+
+        void* allocate(size_t size, size_t align)
+        {
+            auto pad = (align - reinterpret_cast<uintptr_t>(this->cursor) % align) % align;
+            if (pad + size > this->left) {
+                const auto bytes = std::max(this->block_size, size + align);
+                this->blocks.emplace_back(new std::byte[bytes]);
+                this->cursor = this->blocks.back().get();
+                this->left = bytes;
+                pad = (align - reinterpret_cast<uintptr_t>(this->cursor) % align) % align;
+            }
+
+            auto ptr = this->cursor + pad;
+            this->cursor += pad + size;
+            this->left -= pad + size;
+            this->used += size;
+            this->allocated++;
+            return ptr;
+        }
+    };
+
+    Pool* m_pool;
+
+    static TokenArena*& current_arena()
+    {
+        thread_local TokenArena* arena = nullptr;
+        return arena;
+    }
+
+  public:
+    /** allocator of std::allocate_shared() backed by a pool, its allocations keep the pool alive */
+    template<typename T>
+    class Allocator
+    {
+      private:
+        template<typename U>
+        friend class Allocator;
+        Pool* m_pool;
+
+      public:
+        using value_type = T;
+
+        explicit Allocator(Pool* pool) : m_pool(pool)
+        {}
+        template<typename U>
+        Allocator(const Allocator<U>& other) : m_pool(other.m_pool)
+        {}
+
+        T* allocate(size_t n)
+        {
+            return static_cast<T*>(this->m_pool->allocate(n * sizeof(T), alignof(T)));
+        }
+        void deallocate(T*, size_t)
+        {
+            this->m_pool->release();
+        }
+
+        template<typename U>
+        bool operator==(const Allocator<U>& other) const
+        {
+            return this->m_pool == other.m_pool;
+        }
+    };
+
+    /** scoped on the current thread, scopes nest */
+    class Scope
+    {
+      private:
+        TokenArena* m_prev;
+
+      public:
+        Scope(TokenArena& arena) : m_prev(std::exchange(current_arena(), &arena))
+        {}
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        ~Scope()
+        {
+            current_arena() = this->m_prev;
+        }
+    };
+
+    /** @block_size bytes are taken from the heap at a time */
+    explicit TokenArena(size_t block_size = 1 << 16) : m_pool(new Pool())
+    {
+        assert(block_size > 0);
+        this->m_pool->block_size = block_size;
+    }
+    TokenArena(const TokenArena&) = delete;
+    TokenArena& operator=(const TokenArena&) = delete;
+    ~TokenArena()
+    {
+        this->m_pool->release_arena();
+    }
+
+    /** arena of the innermost Scope on this thread, nullptr without one */
+    static TokenArena* current()
+    {
+        return current_arena();
+    }
+
+    template<typename T, typename... Args>
+    std::shared_ptr<T> make(Args&&... args)
+    {
+        return std::allocate_shared<T>(Allocator<T>(this->m_pool), std::forward<Args>(args)...);
+    }
+
+    /** bytes handed out, padding excluded */
+    size_t used() const
+    {
+        return this->m_pool->used;
+    }
+    size_t blocks() const
+    {
+        return this->m_pool->blocks.size();
+    }
+};
+
+/** a token allocated from the current arena, or on the heap without one */
+template<typename T, typename... Args>
+std::shared_ptr<T> make_token(Args&&... args)
+{
+    if (auto arena = TokenArena::current())
+        return arena->make<T>(std::forward<Args>(args)...);
+    return std::make_shared<T>(std::forward<Args>(args)...);
+}
+
+#endif // _LEXER_TOKEN_ARENA_HPP_
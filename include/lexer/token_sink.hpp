@@ -0,0 +1,51 @@
+#ifndef _LEXER_TOKEN_SINK_HPP_
+#define _LEXER_TOKEN_SINK_HPP_
+
+#include "token.h"
+#include <memory>
+#include <utility>
+#include <vector>
+
+
+/** receives the tokens of a lexer in order, nullptr tokens are never pushed */
+class TokenSink
+{
+  public:
+    virtual void push(std::shared_ptr<LexerToken> token) = 0;
+    virtual ~TokenSink() = default;
+};
+
+/** appends to a vector owned by the caller, which keeps its capacity when reused */
+class TokenBufferSink : public TokenSink
+{
+  private:
+    std::vector<std::shared_ptr<LexerToken>>& m_tokens;
+
+  public:
+    TokenBufferSink(std::vector<std::shared_ptr<LexerToken>>& tokens) : m_tokens(tokens)
+    {}
+
+    void push(std::shared_ptr<LexerToken> token) override
+    {
+        this->m_tokens.push_back(std::move(token));
+    }
+};
+
+/** hands every token to @callback */
+template<typename Callback>
+class TokenCallbackSink : public TokenSink
+{
+  private:
+    Callback m_callback;
+
+  public:
+    TokenCallbackSink(Callback callback) : m_callback(std::move(callback))
+    {}
+
+    void push(std::shared_ptr<LexerToken> token) override
+    {
+        this->m_callback(std::move(token));
+    }
+};
+
+#endif // _LEXER_TOKEN_SINK_HPP_
@@ -0,0 +1,36 @@
+#ifndef _DC_PARSER_MAPPED_FILE_H_
+#define _DC_PARSER_MAPPED_FILE_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+
+/** read-only memory mapping of a whole file, unmapped on destruction */
+class MappedFile
+{
+  private:
+    const char* m_data;
+    size_t m_size;
+
+    MappedFile(const char* data, size_t size);
+
+  public:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    /** nullptr when @path can't be opened or mapped */
+    static std::shared_ptr<MappedFile> open(const std::string& path);
+
+    const char* data() const;
+    size_t size() const;
+};
+
+/**
+ * replace @path with @content. the bytes go to a temporary file first,
+ * so readers never map a partially written file.
+ */
+bool write_file_atomic(const std::string& path, const std::string& content);
+
+#endif // _DC_PARSER_MAPPED_FILE_H_
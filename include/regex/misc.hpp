@@ -12,7 +12,8 @@ std::vector<std::pair<T, T>> merge_sorted_range(const std::vector<std::pair<T, T
 {
     std::vector<std::pair<T, T>> result;
     for (auto const& range : ranges) {
-        if (result.empty() || result.back().second + 1 < range.first) {
+        if (result.empty() ||
+            (result.back().second < range.first && result.back().second + 1 < range.first)) {
             result.push_back(range);
         } else {
             result.back().second = std::max(result.back().second, range.second);
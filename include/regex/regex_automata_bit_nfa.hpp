@@ -0,0 +1,216 @@
+#ifndef _DC_PARSER_REGEX_AUTOMATA_BIT_NFA_HPP_
+#define _DC_PARSER_REGEX_AUTOMATA_BIT_NFA_HPP_
+
+#include "./regex_automata.hpp"
+#include "./regex_automata_nfa.hpp"
+#include "./regex_char.hpp"
+#include "./regex_char_class.hpp"
+#include <array>
+#include <assert.h>
+#include <bit>
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+
+/**
+ * NFA simulation with the active states held in @Words machine words.
+ * only states with a character transition or a final mark are kept, the
+ * others never affect matching once closures are taken. every (class, state)
+ * pair owns a precomputed mask of the epsilon closed successors, so feed()
+ * ORs together the masks of the active states without allocating. the masks
+ * are immutable and shared by copies of a matcher, a copy only owns its
+ * active states.
+ */
+template<typename CharT, size_t Words = 1>
+class BitNFAMatcher : public AutomataMatcher<CharT>
+{
+  public:
+    using traits = character_traits<CharT>;
+    using char_type = CharT;
+    using NFAState_t = typename RegexNFA<char_type>::NFAState_t;
+    using word_t = uint64_t;
+    using mask_t = std::array<word_t, Words>;
+    static constexpr size_t word_bits = 64;
+    static constexpr size_t max_states = Words * word_bits;
+
+  private:
+    struct Program
+    {
+        std::shared_ptr<const RegexNFA<char_type>> nfa;
+        CharClassMap<char_type> classes;
+        size_t nstates;
+        std::vector<mask_t> follow;
+        mask_t start, final;
+    };
+    std::shared_ptr<const Program> m_program;
+    mask_t m_current;
+
+    static std::vector<NFAState_t> kept_states(const RegexNFA<char_type>& nfa)
+    {
+        std::vector<NFAState_t> states;
+        auto& finals = nfa.final_states();
+        auto& transitions = nfa.transitions();
+        for (size_t s = 0; s < transitions.size(); s++) {
+            bool keep = finals.find(s) != finals.end();
+            for (auto& entry : transitions[s])
+                keep = keep || entry.low != traits::EMPTY_CHAR;
+
+            if (keep)
+                states.push_back(s);
+        }
+
+        return states;
+    }
+
+    static void set_bit(mask_t& mask, size_t bit)
+    {
+        mask[bit / word_bits] |= word_t(1) << (bit % word_bits);
+    }
+
+    static bool empty(const mask_t& mask)
+    {
+        for (auto w : mask) {
+            if (w != 0)
+                return false;
+        }
+        return true;
+    }
+
+    void setup(std::shared_ptr<const RegexNFA<char_type>> rnfa)
+    {
+        if (rnfa == nullptr)
+            throw std::runtime_error("NFA is null");
+
+        auto program = std::make_shared<Program>();
+        program->nfa = rnfa;
+        auto& nfa = *rnfa;
+        auto& transitions = nfa.transitions();
+        auto& closures = nfa.epsilon_closure();
+        const auto kept = kept_states(nfa);
+        if (kept.size() > max_states)
+            throw std::runtime_error("too many NFA states for bit-parallel simulation");
+
+        program->nstates = kept.size();
+        std::vector<size_t> bit_of(transitions.size(), max_states);
+        for (size_t i = 0; i < kept.size(); i++)
+            bit_of[kept[i]] = i;
+        const auto closure_mask = [&](NFAState_t state) {
+            mask_t mask{};
+            for (auto s : closures[state]) {
+                if (bit_of[s] != max_states)
+                    set_bit(mask, bit_of[s]);
+            }
+            return mask;
+        };
+
+        std::vector<std::pair<char_type, char_type>> ranges;
+        for (auto& trans : transitions) {
+            for (auto& entry : trans) {
+                if (entry.low != traits::EMPTY_CHAR)
+                    ranges.push_back(std::make_pair(entry.low, entry.high));
+            }
+        }
+        program->classes = CharClassMap<char_type>::from_ranges(ranges);
+
+        const auto nclasses = program->classes.size();
+        program->follow.assign(nclasses * program->nstates, mask_t{});
+        for (size_t cls = 0; cls < nclasses; cls++) {
+            const auto c = program->classes.representative(cls);
+            for (size_t i = 0; i < kept.size(); i++) {
+                auto& follow = program->follow[cls * program->nstates + i];
+                for (auto& entry : transitions[kept[i]]) {
+                    if (entry.low == traits::EMPTY_CHAR || c < entry.low || entry.high < c)
+                        continue;
+
+                    for (auto t : entry.state) {
+                        auto mask = closure_mask(t);
+                        for (size_t k = 0; k < Words; k++)
+                            follow[k] |= mask[k];
+                    }
+                }
+            }
+        }
+
+        program->start = mask_t{};
+        for (auto s : nfa.start_closure()) {
+            if (bit_of[s] != max_states)
+                set_bit(program->start, bit_of[s]);
+        }
+        program->final = mask_t{};
+        for (auto s : nfa.final_states())
+            set_bit(program->final, bit_of[s]);
+
+        this->m_program = std::move(program);
+        this->reset();
+    }
+
+  public:
+    BitNFAMatcher() = delete;
+    BitNFAMatcher(std::shared_ptr<const RegexNFA<char_type>> nfa)
+    {
+        this->setup(nfa);
+    }
+    BitNFAMatcher(const std::vector<char_type>& pattern);
+
+    /** whether @nfa is small enough for this matcher */
+    static bool fits(const RegexNFA<char_type>& nfa)
+    {
+        return kept_states(nfa).size() <= max_states;
+    }
+
+    virtual void feed(char_type c) override
+    {
+        assert(traits::MIN <= c && c <= traits::MAX);
+        auto& program = *this->m_program;
+        const auto follow = program.follow.data() + program.classes(c) * program.nstates;
+        mask_t next{};
+        for (size_t w = 0; w < Words; w++) {
+            for (auto word = this->m_current[w]; word != 0; word &= word - 1) {
+                auto& mask = follow[w * word_bits + std::countr_zero(word)];
+                for (size_t k = 0; k < Words; k++)
+                    next[k] |= mask[k];
+            }
+        }
+        this->m_current = next;
+    }
+    virtual bool match() const override
+    {
+        for (size_t k = 0; k < Words; k++) {
+            if (this->m_current[k] & this->m_program->final[k])
+                return true;
+        }
+        return false;
+    }
+    virtual bool dead() const override
+    {
+        return empty(this->m_current);
+    }
+    virtual void reset() override
+    {
+        this->m_current = this->m_program->start;
+    }
+
+    std::shared_ptr<const RegexNFA<char_type>> get_nfa() const
+    {
+        return this->m_program->nfa;
+    }
+    size_t state_count() const
+    {
+        return this->m_program->nstates;
+    }
+
+    std::string to_string() const
+    {
+        std::ostringstream ss;
+        auto& program = *this->m_program;
+        ss << "bit-parallel NFA: " << program.nstates << " states, " << program.classes.size()
+           << " classes" << std::endl;
+        ss << program.nfa->to_string();
+        return ss.str();
+    }
+    virtual ~BitNFAMatcher() = default;
+};
+
+#endif // _DC_PARSER_REGEX_AUTOMATA_BIT_NFA_HPP_
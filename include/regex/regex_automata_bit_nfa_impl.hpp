@@ -0,0 +1,16 @@
+#ifndef _DC_PARSER_REGEX_AUTOMATA_BIT_NFA_IMPL_HPP_
+#define _DC_PARSER_REGEX_AUTOMATA_BIT_NFA_IMPL_HPP_
+
+#include "./regex_automata_bit_nfa.hpp"
+#include "./regex_automata_node_nfa.hpp"
+
+
+template<typename CharT, size_t Words>
+BitNFAMatcher<CharT, Words>::BitNFAMatcher(const std::vector<char_type>& pattern)
+{
+    auto nfa = NodeNFA<CharT>::from_regex(pattern);
+    auto rnfa = nfa.toRegexNFA();
+    this->setup(std::make_shared<RegexNFA<char_type>>(std::move(rnfa)));
+}
+
+#endif // _DC_PARSER_REGEX_AUTOMATA_BIT_NFA_IMPL_HPP_
@@ -3,12 +3,19 @@
 
 #include "./regex_automata.hpp"
 #include "./regex_char.hpp"
+#include "./regex_char_class.hpp"
+#include <algorithm>
+#include <array>
 #include <assert.h>
+#include <cstdint>
 #include <map>
 #include <memory>
 #include <queue>
 #include <set>
+#include <span>
 #include <sstream>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 
@@ -32,23 +39,119 @@ class RegexDFA
         {}
     };
     using DFATransitionTable = std::vector<std::vector<DFAEntry>>;
+    using FlatState_t = uint16_t;
+
+    static constexpr DFAState_t npos = std::numeric_limits<DFAState_t>::max();
+
+    /** flat table is skipped when it would exceed this many entries */
+    static constexpr size_t max_flat_entries = 1 << 22;
 
   private:
     DFAState_t m_start_state;
     std::set<DFAState_t> m_dead_states, m_final_states;
     DFATransitionTable m_transitions;
+    // sorted tags of the patterns accepted by each state, empty for untagged DFAs
+    std::vector<std::vector<size_t>> m_accept_tags;
+
+    // compiled representation, one row of @m_nclasses entries per state
+    CharClassMap<char_type> m_classes;
+    size_t m_nclasses;
+    std::vector<FlatState_t> m_flat_table;
+    enum StateFlag : uint8_t
+    {
+        STATE_FINAL = 1,
+        STATE_DEAD = 2,
+    };
+    std::vector<uint8_t> m_state_flags;
+
+    /** sorted lower bounds of the coarsest intervals no transition range crosses */
+    std::vector<char_type> interval_lows() const
+    {
+        std::vector<char_type> lows;
+        for (auto& trans : this->m_transitions) {
+            for (auto& entry : trans)
+                lows.push_back(entry.low);
+        }
+        std::sort(lows.begin(), lows.end());
+        lows.erase(std::unique(lows.begin(), lows.end()), lows.end());
+        return lows;
+    }
+
+    /** column of interval i is the target of every state on lows[i] */
+    std::vector<std::vector<DFAState_t>> interval_columns(const std::vector<char_type>& lows) const
+    {
+        const auto nstates = this->m_transitions.size();
+        std::vector<std::vector<DFAState_t>> columns(lows.size(),
+                                                     std::vector<DFAState_t>(nstates));
+        for (size_t s = 0; s < nstates; s++) {
+            auto& trans = this->m_transitions[s];
+            auto entry = trans.begin();
+            for (size_t i = 0; i < lows.size(); i++) {
+                while (entry != trans.end() && entry->high < lows[i])
+                    entry++;
+                assert(entry != trans.end() && entry->low <= lows[i]);
+                columns[i][s] = entry->state;
+            }
+        }
+
+        return columns;
+    }
+
+    void build_compiled_table()
+    {
+        const auto nstates = this->m_transitions.size();
+        this->m_state_flags.assign(nstates, 0);
+        for (auto s : this->m_final_states) {
+            assert(s < nstates);
+            this->m_state_flags[s] |= STATE_FINAL;
+        }
+        for (auto s : this->m_dead_states) {
+            assert(s < nstates);
+            this->m_state_flags[s] |= STATE_DEAD;
+        }
+
+        this->m_flat_table.clear();
+        this->m_classes = CharClassMap<char_type>();
+        this->m_nclasses = 1;
+
+        auto lows = this->interval_lows();
+        if (nstates == 0 || nstates > std::numeric_limits<FlatState_t>::max() ||
+            nstates * lows.size() > max_flat_entries) {
+            return;
+        }
+
+        auto columns = this->interval_columns(lows);
+        auto classes = CharClassMap<char_type>::from_boundaries(
+            lows, [&](size_t i, char_type) { return columns[i]; });
+        const auto nclasses = classes.size();
+        this->m_flat_table.resize(nstates * nclasses);
+        auto& interval_classes = classes.interval_classes();
+        for (size_t i = 0; i < interval_classes.size(); i++) {
+            const auto cls = interval_classes[i];
+            for (size_t s = 0; s < nstates; s++)
+                this->m_flat_table[s * nclasses + cls] = columns[i][s];
+        }
+
+        this->m_classes = std::move(classes);
+        this->m_nclasses = nclasses;
+    }
 
   public:
     RegexDFA() = delete;
     RegexDFA(DFATransitionTable table,
              DFAState_t start_state,
              std::set<DFAState_t> dead_states,
-             std::set<DFAState_t> final_states)
+             std::set<DFAState_t> final_states,
+             std::vector<std::vector<size_t>> accept_tags = {})
         : m_transitions(std::move(table)),
           m_start_state(start_state),
           m_dead_states(std::move(dead_states)),
-          m_final_states(std::move(final_states))
-    {}
+          m_final_states(std::move(final_states)),
+          m_accept_tags(std::move(accept_tags))
+    {
+        assert(m_accept_tags.empty() || m_accept_tags.size() == m_transitions.size());
+        this->build_compiled_table();
+    }
 
     DFAState_t start_state() const
     {
@@ -63,7 +166,69 @@ class RegexDFA
         return m_final_states;
     }
 
+    size_t state_count() const
+    {
+        return m_transitions.size();
+    }
+    const DFATransitionTable& transitions() const
+    {
+        return m_transitions;
+    }
+    bool is_final(DFAState_t state) const
+    {
+        assert(state < m_state_flags.size());
+        return m_state_flags[state] & STATE_FINAL;
+    }
+    bool is_dead(DFAState_t state) const
+    {
+        assert(state < m_state_flags.size());
+        return m_state_flags[state] & STATE_DEAD;
+    }
+
+    bool has_accept_tags() const
+    {
+        return !m_accept_tags.empty();
+    }
+    /** tags of the patterns accepted in @state, sorted ascending */
+    const std::vector<size_t>& accept_tags(DFAState_t state) const
+    {
+        static const std::vector<size_t> no_tags;
+        if (m_accept_tags.empty())
+            return no_tags;
+
+        assert(state < m_accept_tags.size());
+        return m_accept_tags[state];
+    }
+
+    bool has_flat_table() const
+    {
+        return !m_flat_table.empty();
+    }
+    const CharClassMap<char_type>& char_classes() const
+    {
+        return m_classes;
+    }
+    size_t class_count() const
+    {
+        return m_nclasses;
+    }
+    /** target of state s on class c is at s * class_count() + c */
+    const std::vector<FlatState_t>& flat_table() const
+    {
+        return m_flat_table;
+    }
+
     DFAState_t state_transition(DFAState_t state, char_type c) const
+    {
+        if (!this->m_flat_table.empty()) {
+            assert(state < m_transitions.size());
+            return this->m_flat_table[state * this->m_nclasses + this->m_classes(c)];
+        }
+
+        return this->range_transition(state, c);
+    }
+
+    DFAState_t range_transition(DFAState_t state, char_type c) const
     {
         assert(state < m_transitions.size());
         auto& trans = this->m_transitions[state];
@@ -89,82 +254,238 @@ class RegexDFA
             this->m_transitions, this->m_start_state, std::set<DFAState_t>(), new_finals);
     }
 
+    /**
+     * remove states that are unreachable or can't reach a final state,
+     * then merge equivalent states by Hopcroft's partition refinement.
+     * the result is the minimal DFA with the dead state numbered 0.
+     */
     void optimize()
     {
-        std::map<DFAState_t, std::set<DFAState_t>> state_reverse_graph;
-        for (size_t i = 0; i < this->m_transitions.size(); i++) {
-            for (auto& entry : this->m_transitions[i]) {
-                state_reverse_graph[entry.state].insert(i);
-            }
+        const auto nstates = this->m_transitions.size();
+        std::vector<std::vector<DFAState_t>> reverse_graph(nstates);
+        for (size_t i = 0; i < nstates; i++) {
+            for (auto& entry : this->m_transitions[i])
+                reverse_graph[entry.state].push_back(i);
         }
 
-        std::set<size_t> seen_states = this->m_final_states;
-        std::queue<size_t> process_queue;
-        for (auto s : seen_states)
-            process_queue.push(s);
-
+        std::vector<bool> reachable(nstates, false), coreachable(nstates, false);
+        std::queue<DFAState_t> process_queue;
+        reachable[this->m_start_state] = true;
+        process_queue.push(this->m_start_state);
+        while (!process_queue.empty()) {
+            auto s = process_queue.front();
+            process_queue.pop();
+            for (auto& entry : this->m_transitions[s]) {
+                if (!reachable[entry.state]) {
+                    reachable[entry.state] = true;
+                    process_queue.push(entry.state);
+                }
+            }
+        }
+        for (auto f : this->m_final_states) {
+            coreachable[f] = true;
+            process_queue.push(f);
+        }
         while (!process_queue.empty()) {
             auto s = process_queue.front();
             process_queue.pop();
-            for (auto& t : state_reverse_graph[s]) {
-                if (seen_states.find(t) == seen_states.end()) {
-                    seen_states.insert(t);
+            for (auto t : reverse_graph[s]) {
+                if (!coreachable[t]) {
+                    coreachable[t] = true;
                     process_queue.push(t);
                 }
             }
         }
 
-        std::set<size_t> deleted_states;
-        for (size_t i = 0; i < this->m_transitions.size(); i++) {
-            if (seen_states.find(i) == seen_states.end()) {
-                deleted_states.insert(i);
+        // live states are renumbered densely, every other state collapses into a sink
+        std::vector<DFAState_t> live_index(nstates);
+        size_t nlive = 0;
+        for (size_t i = 0; i < nstates; i++)
+            live_index[i] = reachable[i] && coreachable[i] ? nlive++ : npos;
+        const auto sink = nlive;
+        const auto n = nlive + 1;
+        for (auto& idx : live_index) {
+            if (idx == npos)
+                idx = sink;
+        }
+
+        const auto lows = this->interval_lows();
+        const auto columns = this->interval_columns(lows);
+        const auto classes = CharClassMap<char_type>::from_boundaries(
+            lows, [&](size_t i, char_type) { return columns[i]; });
+        const auto nclasses = classes.size();
+        std::vector<DFAState_t> delta(n * nclasses, sink);
+        auto& interval_classes = classes.interval_classes();
+        for (size_t i = 0; i < interval_classes.size(); i++) {
+            for (size_t s = 0; s < nstates; s++) {
+                if (live_index[s] != sink)
+                    delta[live_index[s] * nclasses + interval_classes[i]] =
+                        live_index[columns[i][s]];
             }
         }
 
-        std::map<size_t, size_t> state_rewriter;
+        // inverse transitions, inverse[a][t] => states reaching t by class a
+        std::vector<std::vector<std::vector<DFAState_t>>> inverse(
+            nclasses, std::vector<std::vector<DFAState_t>>(n));
+        for (size_t s = 0; s < n; s++) {
+            for (size_t a = 0; a < nclasses; a++)
+                inverse[a][delta[s * nclasses + a]].push_back(s);
+        }
+
+        // initial partition separates non-final states and final states by accept tags
+        std::map<std::pair<bool, std::vector<size_t>>, size_t> initial_blocks = {
+            {std::make_pair(false, std::vector<size_t>()), 0}};
+        std::vector<size_t> block_of(n, 0);
+        for (size_t i = 0; i < nstates; i++) {
+            if (live_index[i] == sink || this->m_final_states.count(i) == 0)
+                continue;
+
+            auto key = std::make_pair(true, this->accept_tags(i));
+            auto it = initial_blocks.emplace(key, initial_blocks.size()).first;
+            block_of[live_index[i]] = it->second;
+        }
+        // blocks are ranges of elems, the marked states of a block are moved
+        // to its front so splitting it costs only the marked states
+        const auto nblocks = initial_blocks.size();
+        std::vector<DFAState_t> elems(n), position(n);
+        std::vector<size_t> block_begin(nblocks + 1, 0), block_end, block_marked(nblocks, 0);
+        for (size_t s = 0; s < n; s++)
+            block_begin[block_of[s] + 1]++;
+        for (size_t b = 0; b < nblocks; b++)
+            block_begin[b + 1] += block_begin[b];
+        block_begin.pop_back();
+        block_end = block_begin;
+        for (size_t s = 0; s < n; s++) {
+            position[s] = block_end[block_of[s]]++;
+            elems[position[s]] = s;
+        }
+
+        std::vector<std::vector<bool>> in_worklist;
+        std::queue<std::pair<size_t, size_t>> worklist;
+        const auto push_work = [&](size_t b, size_t a) {
+            if (in_worklist.size() <= b)
+                in_worklist.resize(b + 1, std::vector<bool>(nclasses, false));
+            if (!in_worklist[b][a]) {
+                in_worklist[b][a] = true;
+                worklist.push(std::make_pair(b, a));
+            }
+        };
+        for (size_t b = 0; b < nblocks; b++) {
+            for (size_t a = 0; a < nclasses; a++)
+                push_work(b, a);
+        }
+
+        std::vector<DFAState_t> preimage;
+        std::vector<size_t> touched;
+        while (!worklist.empty()) {
+            auto [splitter, a] = worklist.front();
+            worklist.pop();
+            in_worklist[splitter][a] = false;
+
+            preimage.clear();
+            for (auto k = block_begin[splitter]; k < block_end[splitter]; k++) {
+                auto& sources = inverse[a][elems[k]];
+                preimage.insert(preimage.end(), sources.begin(), sources.end());
+            }
+
+            touched.clear();
+            for (auto s : preimage) {
+                const auto b = block_of[s];
+                const auto marked_end = block_begin[b] + block_marked[b];
+                if (position[s] < marked_end)
+                    continue;
+                if (block_marked[b]++ == 0)
+                    touched.push_back(b);
+
+                auto other = elems[marked_end];
+                std::swap(elems[marked_end], elems[position[s]]);
+                position[other] = position[s];
+                position[s] = marked_end;
+            }
+
+            for (auto b : touched) {
+                const auto marked = block_marked[b];
+                block_marked[b] = 0;
+                if (marked == block_end[b] - block_begin[b])
+                    continue;
+
+                const auto nb = block_begin.size();
+                block_begin.push_back(block_begin[b]);
+                block_end.push_back(block_begin[b] + marked);
+                block_marked.push_back(0);
+                block_begin[b] += marked;
+                for (auto k = block_begin[nb]; k < block_end[nb]; k++)
+                    block_of[elems[k]] = nb;
+
+                const auto size_b = block_end[b] - block_begin[b];
+                for (size_t c = 0; c < nclasses; c++) {
+                    if (in_worklist.size() > b && in_worklist[b][c]) {
+                        push_work(nb, c);
+                    } else {
+                        push_work(size_b <= marked ? b : nb, c);
+                    }
+                }
+            }
+        }
+        const auto nblocks_final = block_begin.size();
+
+        // dead block becomes state 0, others keep the order of their first original state
         const auto n_dead_state = 0;
+        std::vector<DFAState_t> block_state(nblocks_final, npos);
+        block_state[block_of[sink]] = n_dead_state;
         size_t state_n = 1;
-        for (size_t i = 0; i < this->m_transitions.size(); i++) {
-            if (deleted_states.find(i) == deleted_states.end()) {
-                state_rewriter[i] = state_n;
-                state_n++;
-            } else {
-                state_rewriter[i] = 0;
-            }
+        for (size_t i = 0; i < nstates; i++) {
+            auto b = block_of[live_index[i]];
+            if (block_state[b] == npos)
+                block_state[b] = state_n++;
         }
+        std::vector<DFAState_t> state_rewriter(nstates);
+        for (size_t i = 0; i < nstates; i++)
+            state_rewriter[i] = block_state[block_of[live_index[i]]];
 
         decltype(this->m_transitions) new_transitions(state_n);
-        for (size_t i = 0; i < this->m_transitions.size(); i++) {
-            if (deleted_states.find(i) != deleted_states.end())
+        new_transitions[n_dead_state].emplace_back(traits::MIN, traits::MAX, n_dead_state);
+        std::vector<bool> filled(state_n, false);
+        filled[n_dead_state] = true;
+        for (size_t i = 0; i < nstates; i++) {
+            auto m1 = state_rewriter[i];
+            if (filled[m1])
                 continue;
 
-            auto m1 = state_rewriter[i];
-            assert(new_transitions.size() > m1);
+            filled[m1] = true;
             auto& ntrans = new_transitions[m1];
-            bool prev_is_dead = false;
             for (auto& entry : this->m_transitions[i]) {
                 auto m2 = state_rewriter[entry.state];
-                assert(new_transitions.size() > m2);
-                if (prev_is_dead && m2 == n_dead_state) {
-                    assert(ntrans.size() > 0);
+                if (!ntrans.empty() && ntrans.back().state == m2) {
                     assert(ntrans.back().high + 1 == entry.low);
                     ntrans.back().high = entry.high;
                 } else {
                     ntrans.push_back(DFAEntry(entry.low, entry.high, m2));
                 }
-                prev_is_dead = m2 == n_dead_state;
             }
         }
 
-        this->m_transitions = new_transitions;
+        if (!this->m_accept_tags.empty()) {
+            std::vector<std::vector<size_t>> new_tags(state_n);
+            for (size_t i = 0; i < nstates; i++) {
+                if (this->m_final_states.count(i) > 0)
+                    new_tags[state_rewriter[i]] = this->m_accept_tags[i];
+            }
+            this->m_accept_tags = std::move(new_tags);
+        }
+
+        this->m_transitions = std::move(new_transitions);
         this->m_start_state = state_rewriter[this->m_start_state];
         this->m_dead_states.clear();
         this->m_dead_states.insert(n_dead_state);
         auto old_finals = std::move(this->m_final_states);
         this->m_final_states.clear();
         for (auto f : old_finals) {
-            this->m_final_states.insert(state_rewriter[f]);
+            if (state_rewriter[f] != n_dead_state)
+                this->m_final_states.insert(state_rewriter[f]);
         }
+
+        this->build_compiled_table();
     }
 
     NodeNFA<char_type> toNodeNFA() const;
@@ -178,8 +499,15 @@ class RegexDFA
             ss << s << " ";
         ss << std::endl;
         ss << "final states: ";
-        for (auto s : m_final_states)
+        for (auto s : m_final_states) {
             ss << s << " ";
+            if (!this->accept_tags(s).empty()) {
+                ss << "{ ";
+                for (auto t : this->accept_tags(s))
+                    ss << t << " ";
+                ss << "} ";
+            }
+        }
         ss << std::endl;
         ss << "transitions: " << std::endl;
         for (size_t i = 0; i < m_transitions.size(); ++i) {
@@ -202,12 +530,66 @@ class DFAMatcher : public AutomataMatcher<CharT>
     using char_type = CharT;
     using entry_type = typename RegexDFA<char_type>::DFAEntry;
     using DFAState_t = typename RegexDFA<char_type>::DFAState_t;
-    std::shared_ptr<RegexDFA<char_type>> m_dfa;
+    std::shared_ptr<const RegexDFA<char_type>> m_dfa;
     DFAState_t m_current_state;
 
+    DFAState_t walk(DFAState_t state, const char_type* begin, const char_type* end) const
+    {
+        for (; begin != end && !this->m_dfa->is_dead(state); ++begin)
+            state = this->m_dfa->state_transition(state, *begin);
+        return state;
+    }
+
+    /** test_many() over the flat table, one input per lane at a time */
+    template<size_t... L>
+    void test_lanes(std::span<const std::basic_string_view<char_type>> inputs,
+                    std::vector<bool>& result,
+                    std::index_sequence<L...>) const
+    {
+        constexpr size_t lanes = sizeof...(L);
+        assert(inputs.size() >= lanes);
+        auto& dfa = *this->m_dfa;
+        const auto table = dfa.flat_table().data();
+        const auto nclasses = dfa.class_count();
+        auto& classes = dfa.char_classes();
+        std::array<const char_type*, lanes> cur, end;
+        std::array<size_t, lanes> input;
+        std::array<uint32_t, lanes> state;
+        size_t next = 0;
+        const auto load = [&](size_t l) {
+            cur[l] = inputs[next].data();
+            end[l] = cur[l] + inputs[next].size();
+            input[l] = next++;
+            state[l] = dfa.start_state();
+        };
+        (load(L), ...);
+
+        // lanes are unrolled so their states stay in registers
+        bool more = true;
+        const auto step = [&](auto lane) {
+            constexpr size_t l = decltype(lane)::value;
+            if (cur[l] != end[l]) {
+                state[l] = table[state[l] * nclasses + classes(*cur[l]++)];
+                return;
+            }
+            result[input[l]] = dfa.is_final(state[l]);
+            if (next == inputs.size()) {
+                more = false;
+                return;
+            }
+            load(l);
+        };
+        while (more)
+            (step(std::integral_constant<size_t, L>()), ...);
+
+        // the last inputs are finished one by one
+        for (size_t l = 0; l < lanes; l++)
+            result[input[l]] = dfa.is_final(this->walk(state[l], cur[l], end[l]));
+    }
+
   public:
     DFAMatcher() = delete;
-    DFAMatcher(std::shared_ptr<RegexDFA<char_type>> dfa) : m_dfa(dfa)
+    DFAMatcher(std::shared_ptr<const RegexDFA<char_type>> dfa) : m_dfa(dfa)
     {
         if (this->m_dfa == nullptr)
             throw std::runtime_error("DFA is null");
@@ -219,8 +601,7 @@ class DFAMatcher : public AutomataMatcher<CharT>
     virtual void feed(char_type c) override
     {
         assert(traits::MIN <= c && c <= traits::MAX);
-        auto& dead_states = this->m_dfa->dead_states();
-        if (dead_states.find(this->m_current_state) != dead_states.end())
+        if (this->m_dfa->is_dead(this->m_current_state))
             return;
 
         auto cstate = this->m_current_state;
@@ -229,18 +610,39 @@ class DFAMatcher : public AutomataMatcher<CharT>
 
     virtual bool match() const override
     {
-        auto& finals = m_dfa->final_states();
-        return finals.find(this->m_current_state) != finals.end();
+        return m_dfa->is_final(this->m_current_state);
     }
     virtual bool dead() const override
     {
-        auto& dead_states = m_dfa->dead_states();
-        return dead_states.find(this->m_current_state) != dead_states.end();
+        return m_dfa->is_dead(this->m_current_state);
     }
     virtual void reset() override
     {
         this->m_current_state = this->m_dfa->start_state();
     }
+
+    /**
+     * whether each of @inputs matches, the current state is left alone. with a
+     * flat table several inputs are walked in lock step, so the table loads of
+     * one input overlap with those of the others.
+     */
+    std::vector<bool> test_many(std::span<const std::basic_string_view<char_type>> inputs) const
+    {
+        constexpr size_t lanes = 4;
+        std::vector<bool> result(inputs.size(), false);
+        if (this->m_dfa->has_flat_table() && inputs.size() >= lanes) {
+            this->test_lanes(inputs, result, std::make_index_sequence<lanes>());
+            return result;
+        }
+
+        for (size_t i = 0; i < inputs.size(); i++) {
+            auto& str = inputs[i];
+            auto state = this->walk(this->m_dfa->start_state(), str.data(), str.data() + str.size());
+            result[i] = this->m_dfa->is_final(state);
+        }
+        return result;
+    }
+
     std::string to_string() const
     {
         return m_dfa->to_string();
@@ -0,0 +1,431 @@
+#ifndef _DC_PARSER_REGEX_AUTOMATA_DFA_IMAGE_HPP_
+#define _DC_PARSER_REGEX_AUTOMATA_DFA_IMAGE_HPP_
+
+#include "./mapped_file.h"
+#include "./regex_automata_dfa.hpp"
+#include "./regex_char.hpp"
+#include "./regex_char_class.hpp"
+#include <algorithm>
+#include <assert.h>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <set>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+constexpr uint64_t fnv1a_64_basis = 0xcbf29ce484222325ULL;
+
+/** 64-bit FNV-1a of [data, data + len), chained through @hash */
+inline uint64_t fnv1a_64(const void* data, size_t len, uint64_t hash = fnv1a_64_basis)
+{
+    auto p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/** checksum identifying the patterns an automaton is compiled from */
+template<typename CharT>
+uint64_t regex_patterns_checksum(const std::vector<std::vector<CharT>>& patterns,
+                                 uint64_t hash = fnv1a_64_basis)
+{
+    for (auto& pattern : patterns) {
+        const uint64_t len = pattern.size();
+        hash = fnv1a_64(&len, sizeof(len), hash);
+        hash = fnv1a_64(pattern.data(), pattern.size() * sizeof(CharT), hash);
+    }
+    return hash;
+}
+
+/**
+ * read-only DFA in a versioned binary format, used in place without
+ * copying, so it can run straight from a memory mapped file.
+ *
+ * layout, every section padded to 8 bytes:
+ *   header | interval lows | interval classes | classes of bytes 0..255 |
+ *   transition table [state * classes + class] | state flags |
+ *   accept tag offsets [states + 1] | accept tags
+ * the tag sections are present only for tagged DFAs. the checksum of the
+ * source patterns is stored in the header, a stale image is rejected by load().
+ */
+template<typename CharT>
+class RegexDFAImage
+{
+  public:
+    using traits = character_traits<CharT>;
+    using char_type = CharT;
+    using DFAState_t = uint32_t;
+    using class_t = uint32_t;
+
+    static constexpr uint32_t format_version = 1;
+
+  private:
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t char_size;
+        uint64_t checksum;
+        uint64_t nstates;
+        uint64_t start_state;
+        uint64_t nintervals;
+        uint64_t nclasses;
+        uint64_t tagged;
+        uint64_t ntags;
+    };
+    static constexpr char image_magic[8] = {'D', 'C', 'R', 'X', 'D', 'F', 'A', '\0'};
+    static constexpr size_t byte_size = 256;
+    enum StateFlag : uint8_t
+    {
+        STATE_FINAL = 1,
+        STATE_DEAD = 2,
+    };
+
+    std::shared_ptr<const void> m_owner;
+    const char* m_data;
+    size_t m_size;
+    const Header* m_header;
+    const char_type* m_lows;
+    const class_t* m_interval_class;
+    const class_t* m_bytes;
+    const DFAState_t* m_table;
+    const uint8_t* m_flags;
+    const uint64_t* m_tag_offsets;
+    const uint64_t* m_tags;
+
+    static size_t padded(size_t n)
+    {
+        return (n + 7) & ~size_t(7);
+    }
+
+    static void append(std::string& out, const void* data, size_t len)
+    {
+        out.append(static_cast<const char*>(data), len);
+        out.resize(padded(out.size()), '\0');
+    }
+
+    /** point the sections into the buffer, checking every count and index it holds */
+    void setup()
+    {
+        const auto fail = [](const char* what) {
+            throw std::runtime_error(std::string("bad DFA image: ") + what);
+        };
+        if (reinterpret_cast<uintptr_t>(this->m_data) % alignof(uint64_t) != 0)
+            fail("misaligned buffer");
+        if (this->m_size < sizeof(Header))
+            fail("truncated header");
+
+        auto h = reinterpret_cast<const Header*>(this->m_data);
+        if (std::memcmp(h->magic, image_magic, sizeof(image_magic)) != 0)
+            fail("wrong magic");
+        if (h->version != format_version)
+            fail("unsupported version");
+        if (h->char_size != sizeof(char_type))
+            fail("character size mismatch");
+        if (h->nstates == 0 || h->nstates > std::numeric_limits<DFAState_t>::max() ||
+            h->start_state >= h->nstates)
+            fail("bad state count");
+        if (h->nintervals == 0 || h->nclasses == 0 || h->nclasses > h->nintervals)
+            fail("bad class count");
+
+        // elements take at least one byte, so a count beyond the buffer size is truncated
+        size_t offset = sizeof(Header);
+        const auto section = [&](uint64_t count, size_t elem) {
+            if (count > this->m_size || elem * count > this->m_size - offset)
+                fail("truncated section");
+            auto p = this->m_data + offset;
+            offset = padded(offset + elem * count);
+            if (offset > this->m_size)
+                fail("truncated section");
+            return p;
+        };
+        this->m_lows =
+            reinterpret_cast<const char_type*>(section(h->nintervals, sizeof(char_type)));
+        this->m_interval_class =
+            reinterpret_cast<const class_t*>(section(h->nintervals, sizeof(class_t)));
+        this->m_bytes = reinterpret_cast<const class_t*>(section(byte_size, sizeof(class_t)));
+        if (h->nclasses > this->m_size / h->nstates)
+            fail("truncated section");
+        this->m_table = reinterpret_cast<const DFAState_t*>(
+            section(h->nstates * h->nclasses, sizeof(DFAState_t)));
+        this->m_flags = reinterpret_cast<const uint8_t*>(section(h->nstates, sizeof(uint8_t)));
+        this->m_tag_offsets = nullptr;
+        this->m_tags = nullptr;
+        if (h->tagged) {
+            this->m_tag_offsets =
+                reinterpret_cast<const uint64_t*>(section(h->nstates + 1, sizeof(uint64_t)));
+            this->m_tags = reinterpret_cast<const uint64_t*>(section(h->ntags, sizeof(uint64_t)));
+        }
+        this->m_header = h;
+
+        if (this->m_lows[0] != traits::MIN)
+            fail("intervals don't start at MIN");
+        for (size_t i = 0; i < h->nintervals; i++) {
+            if ((i > 0 && !(this->m_lows[i - 1] < this->m_lows[i])) ||
+                this->m_interval_class[i] >= h->nclasses)
+                fail("bad interval");
+        }
+        for (size_t i = 0; i < byte_size; i++) {
+            if (this->m_bytes[i] >= h->nclasses)
+                fail("bad byte class");
+        }
+        for (size_t i = 0; i < h->nstates * h->nclasses; i++) {
+            if (this->m_table[i] >= h->nstates)
+                fail("bad transition");
+        }
+        if (h->tagged) {
+            if (this->m_tag_offsets[0] != 0 || this->m_tag_offsets[h->nstates] != h->ntags)
+                fail("bad tag offsets");
+            for (size_t s = 0; s < h->nstates; s++) {
+                if (this->m_tag_offsets[s] > this->m_tag_offsets[s + 1])
+                    fail("bad tag offsets");
+                // accept_tags() promises them ascending, users bound them by the last one
+                for (auto t = this->m_tag_offsets[s] + 1; t < this->m_tag_offsets[s + 1]; t++) {
+                    if (!(this->m_tags[t - 1] < this->m_tags[t]))
+                        fail("tags not ascending");
+                }
+            }
+        }
+    }
+
+  public:
+    RegexDFAImage() = delete;
+    /** @owner keeps [data, data + size) alive, @data must be 8-byte aligned */
+    RegexDFAImage(std::shared_ptr<const void> owner, const char* data, size_t size)
+        : m_owner(std::move(owner)), m_data(data), m_size(size)
+    {
+        this->setup();
+    }
+
+    /** encode @dfa, the result can be passed to the constructor or written to a file */
+    static std::string serialize(const RegexDFA<char_type>& dfa, uint64_t checksum = 0)
+    {
+        const auto nstates = dfa.state_count();
+        if (nstates == 0 || nstates > std::numeric_limits<DFAState_t>::max())
+            throw std::runtime_error("DFA can't be serialized: bad state count");
+
+        std::vector<char_type> lows;
+        for (auto& trans : dfa.transitions()) {
+            for (auto& entry : trans)
+                lows.push_back(entry.low);
+        }
+        std::sort(lows.begin(), lows.end());
+        lows.erase(std::unique(lows.begin(), lows.end()), lows.end());
+
+        std::vector<std::vector<DFAState_t>> columns(lows.size(),
+                                                     std::vector<DFAState_t>(nstates));
+        for (size_t i = 0; i < lows.size(); i++) {
+            for (size_t s = 0; s < nstates; s++)
+                columns[i][s] = dfa.range_transition(s, lows[i]);
+        }
+        auto classes = CharClassMap<char_type>::from_boundaries(
+            lows, [&](size_t i, char_type) { return columns[i]; });
+        const auto nclasses = classes.size();
+
+        std::vector<class_t> bytes(byte_size, 0);
+        for (size_t i = 0; i < byte_size; i++) {
+            const auto c = static_cast<char_type>(i);
+            if (static_cast<size_t>(c) == i && traits::MIN <= c && c <= traits::MAX)
+                bytes[i] = classes(c);
+        }
+
+        std::vector<DFAState_t> table(nstates * nclasses);
+        auto& interval_classes = classes.interval_classes();
+        for (size_t i = 0; i < lows.size(); i++) {
+            for (size_t s = 0; s < nstates; s++)
+                table[s * nclasses + interval_classes[i]] = columns[i][s];
+        }
+
+        std::vector<uint8_t> flags(nstates, 0);
+        for (size_t s = 0; s < nstates; s++) {
+            flags[s] = (dfa.is_final(s) ? STATE_FINAL : 0) | (dfa.is_dead(s) ? STATE_DEAD : 0);
+        }
+
+        std::vector<uint64_t> tag_offsets, tags;
+        if (dfa.has_accept_tags()) {
+            tag_offsets.push_back(0);
+            for (size_t s = 0; s < nstates; s++) {
+                for (auto t : dfa.accept_tags(s))
+                    tags.push_back(t);
+                tag_offsets.push_back(tags.size());
+            }
+        }
+
+        Header header;
+        std::memcpy(header.magic, image_magic, sizeof(image_magic));
+        header.version = format_version;
+        header.char_size = sizeof(char_type);
+        header.checksum = checksum;
+        header.nstates = nstates;
+        header.start_state = dfa.start_state();
+        header.nintervals = lows.size();
+        header.nclasses = nclasses;
+        header.tagged = dfa.has_accept_tags();
+        header.ntags = tags.size();
+
+        std::string out;
+        append(out, &header, sizeof(header));
+        append(out, lows.data(), lows.size() * sizeof(char_type));
+        append(out, interval_classes.data(), interval_classes.size() * sizeof(class_t));
+        append(out, bytes.data(), bytes.size() * sizeof(class_t));
+        append(out, table.data(), table.size() * sizeof(DFAState_t));
+        append(out, flags.data(), flags.size());
+        if (header.tagged) {
+            append(out, tag_offsets.data(), tag_offsets.size() * sizeof(uint64_t));
+            append(out, tags.data(), tags.size() * sizeof(uint64_t));
+        }
+        return out;
+    }
+
+    static RegexDFAImage from_dfa(const RegexDFA<char_type>& dfa, uint64_t checksum = 0)
+    {
+        auto buffer = std::make_shared<std::string>(serialize(dfa, checksum));
+        return RegexDFAImage(buffer, buffer->data(), buffer->size());
+    }
+
+    /**
+     * map the image stored in @path. nullopt when the file is missing,
+     * malformed, or doesn't carry @checksum.
+     */
+    static std::optional<RegexDFAImage> load(const std::string& path,
+                                             std::optional<uint64_t> checksum = std::nullopt)
+    {
+        auto file = MappedFile::open(path);
+        if (file == nullptr)
+            return std::nullopt;
+
+        try {
+            RegexDFAImage image(file, file->data(), file->size());
+            if (checksum.has_value() && image.checksum() != checksum.value())
+                return std::nullopt;
+            return image;
+        } catch (const std::runtime_error&) {
+            return std::nullopt;
+        }
+    }
+
+    bool save(const std::string& path) const
+    {
+        return write_file_atomic(path, std::string(this->m_data, this->m_size));
+    }
+
+    const char* data() const
+    {
+        return this->m_data;
+    }
+    size_t size() const
+    {
+        return this->m_size;
+    }
+    uint64_t checksum() const
+    {
+        return this->m_header->checksum;
+    }
+
+    size_t state_count() const
+    {
+        return this->m_header->nstates;
+    }
+    size_t class_count() const
+    {
+        return this->m_header->nclasses;
+    }
+    DFAState_t start_state() const
+    {
+        return this->m_header->start_state;
+    }
+    bool is_final(DFAState_t state) const
+    {
+        assert(state < this->state_count());
+        return this->m_flags[state] & STATE_FINAL;
+    }
+    bool is_dead(DFAState_t state) const
+    {
+        assert(state < this->state_count());
+        return this->m_flags[state] & STATE_DEAD;
+    }
+    bool has_accept_tags() const
+    {
+        return this->m_header->tagged;
+    }
+    /** tags of the patterns accepted in @state, strictly ascending as checked on load */
+    std::span<const uint64_t> accept_tags(DFAState_t state) const
+    {
+        assert(state < this->state_count());
+        if (!this->has_accept_tags())
+            return {};
+
+        return std::span<const uint64_t>(this->m_tags + this->m_tag_offsets[state],
+                                         this->m_tags + this->m_tag_offsets[state + 1]);
+    }
+
+    class_t char_class(char_type c) const
+    {
+        assert(traits::MIN <= c && c <= traits::MAX);
+        if (0 <= c && static_cast<size_t>(c) < byte_size)
+            return this->m_bytes[static_cast<size_t>(c)];
+
+        const auto end = this->m_lows + this->m_header->nintervals;
+        auto ub = std::upper_bound(this->m_lows, end, c);
+        assert(ub != this->m_lows);
+        return this->m_interval_class[ub - this->m_lows - 1];
+    }
+    DFAState_t class_transition(DFAState_t state, class_t cls) const
+    {
+        assert(state < this->state_count() && cls < this->class_count());
+        return this->m_table[state * this->m_header->nclasses + cls];
+    }
+    DFAState_t state_transition(DFAState_t state, char_type c) const
+    {
+        return this->class_transition(state, this->char_class(c));
+    }
+
+    /** decode into an owning RegexDFA */
+    RegexDFA<char_type> to_dfa() const
+    {
+        using Entry = typename RegexDFA<char_type>::DFAEntry;
+        const auto nstates = this->state_count();
+        const auto nintervals = this->m_header->nintervals;
+        typename RegexDFA<char_type>::DFATransitionTable table(nstates);
+        std::set<typename RegexDFA<char_type>::DFAState_t> dead_states, final_states;
+        std::vector<std::vector<size_t>> accept_tags;
+        for (size_t s = 0; s < nstates; s++) {
+            auto& row = table[s];
+            for (size_t i = 0; i < nintervals; i++) {
+                const char_type high =
+                    i + 1 < nintervals ? char_type(this->m_lows[i + 1] - 1) : traits::MAX;
+                const auto target = this->class_transition(s, this->m_interval_class[i]);
+                if (!row.empty() && row.back().state == target) {
+                    row.back().high = high;
+                } else {
+                    row.push_back(Entry(this->m_lows[i], high, target));
+                }
+            }
+
+            if (this->is_dead(s))
+                dead_states.insert(s);
+            if (this->is_final(s))
+                final_states.insert(s);
+            if (this->has_accept_tags()) {
+                auto tags = this->accept_tags(s);
+                accept_tags.emplace_back(tags.begin(), tags.end());
+            }
+        }
+
+        return RegexDFA<char_type>(std::move(table),
+                                   this->start_state(),
+                                   std::move(dead_states),
+                                   std::move(final_states),
+                                   std::move(accept_tags));
+    }
+};
+
+#endif // _DC_PARSER_REGEX_AUTOMATA_DFA_IMAGE_HPP_
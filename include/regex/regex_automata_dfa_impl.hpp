@@ -11,6 +11,7 @@ DFAMatcher<CharT>::DFAMatcher(const std::vector<char_type>& pattern)
     auto nfa = NodeNFA<CharT>::from_regex(pattern);
     auto rnfa = nfa.toRegexNFA();
     auto dfa = rnfa.compile();
+    dfa.optimize();
     this->m_dfa = std::make_shared<RegexDFA<char_type>>(std::move(dfa));
     this->reset();
 }
@@ -18,30 +19,22 @@ DFAMatcher<CharT>::DFAMatcher(const std::vector<char_type>& pattern)
 template<typename CharT>
 NodeNFA<CharT> RegexDFA<CharT>::toNodeNFA() const
 {
-    using NodeNFATransitionTable = typename NodeNFA<CharT>::NodeNFATransitionTable;
-    using NodeNFAEntry = typename NodeNFA<CharT>::NodeNFAEntry;
-    using NFAState_t = typename NodeNFA<CharT>::NFAState_t;
-
-    const auto epsilon_symbol = traits::EMPTY_CHAR;
-    const NFAState_t startstate = this->m_start_state;
-    const NFAState_t nfinals = this->m_transitions.size();
-    NodeNFATransitionTable table;
+    // DFA states keep their index, every final state leads to one more state
+    const size_t nfinals = this->m_transitions.size();
+    NodeNFA<CharT> nfa(nfinals + 1, this->m_start_state, nfinals);
     for (size_t s = 0; s < this->m_transitions.size(); s++) {
-        if (this->m_final_states.find(s) != this->m_final_states.end()) {
-            table[s].push_back(NodeNFAEntry(epsilon_symbol, epsilon_symbol, {nfinals}));
-        }
+        if (this->m_final_states.find(s) != this->m_final_states.end())
+            nfa.add_epsilon(s, nfinals);
 
-        auto& t = this->m_transitions[s];
-        for (auto& e : t) {
+        for (auto& e : this->m_transitions[s]) {
             if (this->m_dead_states.find(e.state) != this->m_dead_states.end())
                 continue;
 
-            NodeNFAEntry ne(e.low, e.high, {e.state});
-            table[s].push_back(std::move(ne));
+            nfa.add_link(s, e.state, e.low, e.high);
         }
     }
 
-    return NodeNFA<CharT>(table, startstate, nfinals);
+    return nfa;
 }
 
 #endif // _DC_PARSER_REGEX_AUTOMATA_DFA_IMPL_HPP_
@@ -0,0 +1,262 @@
+#ifndef _DC_PARSER_REGEX_AUTOMATA_LAZY_DFA_HPP_
+#define _DC_PARSER_REGEX_AUTOMATA_LAZY_DFA_HPP_
+
+#include "./regex_automata.hpp"
+#include "./regex_automata_nfa.hpp"
+#include "./regex_char.hpp"
+#include "./regex_char_class.hpp"
+#include <assert.h>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * DFA matcher which builds its states on demand from the NFA.
+ * each DFA state is a sorted set of NFA states, and its transitions are
+ * filled lazily one character class at a time. when the cache outgrows
+ * @m_memory_budget it is flushed, keeping only the states in use. if the
+ * cache keeps being flushed before it pays off, the matcher falls back to
+ * NFA simulation until the next reset().
+ */
+template<typename CharT>
+class LazyDFAMatcher : public AutomataMatcher<CharT>
+{
+  public:
+    using traits = character_traits<CharT>;
+    using char_type = CharT;
+    using NFAState_t = typename RegexNFA<char_type>::NFAState_t;
+    using LazyState_t = uint32_t;
+
+    static constexpr size_t default_memory_budget = 1 << 20;
+
+    /** a flushed cache is given up when it served fewer characters than this per state */
+    static constexpr size_t min_chars_per_state = 10;
+
+  private:
+    struct StateSetHash
+    {
+        size_t operator()(const std::vector<NFAState_t>& states) const
+        {
+            size_t h = states.size();
+            for (auto s : states)
+                h ^= std::hash<NFAState_t>()(s) + 0x9e3779b9 + (h << 6) + (h >> 2);
+            return h;
+        }
+    };
+
+    static constexpr LazyState_t unknown_state = std::numeric_limits<LazyState_t>::max();
+    static constexpr LazyState_t dead_state = 0;
+
+    /** estimated bytes per cached state, besides its row and its NFA states */
+    static constexpr size_t state_overhead = 64;
+
+    std::shared_ptr<const RegexNFA<char_type>> m_nfa;
+    CharClassMap<char_type> m_classes;
+    size_t m_nclasses;
+    size_t m_memory_budget;
+    size_t m_memory_used;
+
+    std::vector<std::vector<NFAState_t>> m_state_sets;
+    std::vector<bool> m_state_final;
+    std::vector<LazyState_t> m_table;
+    std::unordered_map<std::vector<NFAState_t>, LazyState_t, StateSetHash> m_state_map;
+    LazyState_t m_start_state;
+    LazyState_t m_current_state;
+
+    size_t m_flush_count;
+    size_t m_chars_since_flush;
+    bool m_bailed_out;
+    std::set<NFAState_t> m_current_set;
+
+    size_t state_cost(const std::vector<NFAState_t>& states) const
+    {
+        return this->m_nclasses * sizeof(LazyState_t) + 2 * states.size() * sizeof(NFAState_t) +
+               state_overhead;
+    }
+
+    LazyState_t add_state(const std::vector<NFAState_t>& states)
+    {
+        auto it = this->m_state_map.find(states);
+        if (it != this->m_state_map.end())
+            return it->second;
+
+        const LazyState_t state = this->m_state_sets.size();
+        if (state == unknown_state)
+            throw std::runtime_error("too many lazy DFA states");
+
+        auto& finals = this->m_nfa->final_states();
+        bool final = false;
+        for (auto s : states)
+            final = final || finals.find(s) != finals.end();
+
+        this->m_state_sets.push_back(states);
+        this->m_state_final.push_back(final);
+        this->m_table.resize(this->m_table.size() + this->m_nclasses, unknown_state);
+        this->m_state_map.emplace(states, state);
+        this->m_memory_used += this->state_cost(states);
+        return state;
+    }
+
+    void flush()
+    {
+        this->m_state_sets.clear();
+        this->m_state_final.clear();
+        this->m_table.clear();
+        this->m_state_map.clear();
+        this->m_memory_used = 0;
+
+        auto dead = this->add_state({});
+        assert(dead == dead_state);
+        auto sclosure = this->m_nfa->start_closure();
+        this->m_start_state =
+            this->add_state(std::vector<NFAState_t>(sclosure.begin(), sclosure.end()));
+    }
+
+    void compute_transition(typename CharClassMap<char_type>::class_t cls)
+    {
+        const auto current = this->m_state_sets[this->m_current_state];
+        const std::set<NFAState_t> current_set(current.begin(), current.end());
+        auto next = this->m_nfa->state_transition(current_set, this->m_classes.representative(cls));
+        std::vector<NFAState_t> key(next.begin(), next.end());
+
+        auto it = this->m_state_map.find(key);
+        if (it == this->m_state_map.end() &&
+            this->m_memory_used + this->state_cost(key) > this->m_memory_budget) {
+            const auto nstates = this->m_state_sets.size();
+            if (this->m_flush_count > 0 &&
+                this->m_chars_since_flush < min_chars_per_state * nstates) {
+                this->m_bailed_out = true;
+                this->m_current_set = std::move(next);
+                return;
+            }
+
+            this->m_flush_count++;
+            this->m_chars_since_flush = 0;
+            this->flush();
+            this->m_current_state = this->add_state(current);
+        }
+
+        auto state = this->add_state(key);
+        this->m_table[this->m_current_state * this->m_nclasses + cls] = state;
+        this->m_current_state = state;
+    }
+
+    /** split the alphabet at every NFA transition boundary and start with an empty cache */
+    void setup()
+    {
+        std::vector<std::pair<char_type, char_type>> ranges;
+        for (auto& trans : this->m_nfa->transitions()) {
+            for (auto& entry : trans) {
+                if (entry.low != traits::EMPTY_CHAR)
+                    ranges.push_back(std::make_pair(entry.low, entry.high));
+            }
+        }
+        this->m_classes = CharClassMap<char_type>::from_ranges(ranges);
+        this->m_nclasses = this->m_classes.size();
+
+        this->m_flush_count = 0;
+        this->m_chars_since_flush = 0;
+        this->m_bailed_out = false;
+        this->flush();
+        this->reset();
+    }
+
+  public:
+    LazyDFAMatcher() = delete;
+    LazyDFAMatcher(std::shared_ptr<const RegexNFA<char_type>> nfa,
+                   size_t memory_budget = default_memory_budget)
+        : m_nfa(nfa), m_memory_budget(memory_budget)
+    {
+        if (this->m_nfa == nullptr)
+            throw std::runtime_error("NFA is null");
+
+        this->setup();
+    }
+    LazyDFAMatcher(const std::vector<char_type>& pattern,
+                   size_t memory_budget = default_memory_budget);
+
+    virtual void feed(char_type c) override
+    {
+        assert(traits::MIN <= c && c <= traits::MAX);
+        if (this->m_bailed_out) {
+            if (!this->m_current_set.empty())
+                this->m_current_set = this->m_nfa->state_transition(this->m_current_set, c);
+            return;
+        }
+
+        if (this->m_current_state == dead_state)
+            return;
+
+        this->m_chars_since_flush++;
+        const auto cls = this->m_classes(c);
+        const auto next = this->m_table[this->m_current_state * this->m_nclasses + cls];
+        if (next != unknown_state) {
+            this->m_current_state = next;
+        } else {
+            this->compute_transition(cls);
+        }
+    }
+    virtual bool match() const override
+    {
+        if (this->m_bailed_out) {
+            auto& finals = m_nfa->final_states();
+            return std::any_of(
+                m_current_set.begin(), m_current_set.end(), [&finals](NFAState_t state) {
+                    return finals.find(state) != finals.end();
+                });
+        }
+
+        return this->m_state_final[this->m_current_state];
+    }
+    virtual bool dead() const override
+    {
+        if (this->m_bailed_out)
+            return this->m_current_set.empty();
+
+        return this->m_current_state == dead_state;
+    }
+    virtual void reset() override
+    {
+        this->m_bailed_out = false;
+        this->m_current_set.clear();
+        this->m_current_state = this->m_start_state;
+    }
+
+    std::shared_ptr<const RegexNFA<char_type>> get_nfa() const
+    {
+        return this->m_nfa;
+    }
+    size_t cached_states() const
+    {
+        return this->m_state_sets.size();
+    }
+    size_t cache_flushes() const
+    {
+        return this->m_flush_count;
+    }
+    size_t memory_used() const
+    {
+        return this->m_memory_used;
+    }
+    bool bailed_out() const
+    {
+        return this->m_bailed_out;
+    }
+
+    std::string to_string() const
+    {
+        std::ostringstream ss;
+        ss << "lazy DFA: " << this->m_state_sets.size() << " cached states, "
+           << this->m_nclasses << " classes, " << this->m_flush_count << " flushes" << std::endl;
+        ss << this->m_nfa->to_string();
+        return ss.str();
+    }
+    virtual ~LazyDFAMatcher() = default;
+};
+
+#endif // _DC_PARSER_REGEX_AUTOMATA_LAZY_DFA_HPP_
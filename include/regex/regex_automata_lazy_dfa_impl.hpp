@@ -0,0 +1,18 @@
+#ifndef _DC_PARSER_REGEX_AUTOMATA_LAZY_DFA_IMPL_HPP_
+#define _DC_PARSER_REGEX_AUTOMATA_LAZY_DFA_IMPL_HPP_
+
+#include "./regex_automata_lazy_dfa.hpp"
+#include "./regex_automata_node_nfa.hpp"
+
+
+template<typename CharT>
+LazyDFAMatcher<CharT>::LazyDFAMatcher(const std::vector<char_type>& pattern, size_t memory_budget)
+    : m_memory_budget(memory_budget)
+{
+    auto nfa = NodeNFA<CharT>::from_regex(pattern);
+    auto rnfa = nfa.toRegexNFA();
+    this->m_nfa = std::make_shared<RegexNFA<char_type>>(std::move(rnfa));
+    this->setup();
+}
+
+#endif // _DC_PARSER_REGEX_AUTOMATA_LAZY_DFA_IMPL_HPP_
@@ -5,10 +5,15 @@
 #include "./regex_automata.hpp"
 #include "./regex_automata_dfa.hpp"
 #include "./regex_char.hpp"
+#include "./regex_state_set.h"
+#include "./worker_pool.hpp"
+#include <algorithm>
 #include <assert.h>
 #include <map>
 #include <memory>
+#include <optional>
 #include <set>
+#include <span>
 #include <sstream>
 #include <vector>
 
@@ -42,59 +47,63 @@ class RegexNFA
   private:
     NFAState_t m_start_state;
     std::set<NFAState_t> m_final_states;
+    // pattern tag of each final state, empty for untagged NFAs
+    std::map<NFAState_t, size_t> m_final_tags;
     NFATransitionTable m_transitions;
     std::vector<std::set<NFAState_t>> m_epsilon_closure;
-    std::vector<std::vector<std::pair<char_type, char_type>>> m_range_units;
 
-    std::vector<std::set<size_t>> get_epsilon_closure() const
+    /** closure of every state by a search over the epsilon edges */
+    std::vector<std::set<NFAState_t>> get_epsilon_closure() const
     {
-        std::vector<std::set<size_t>> worklist(this->m_transitions.size());
-        for (size_t i = 0; i < worklist.size(); ++i) {
-            auto& states = this->m_transitions[i];
-            if (states.size() > 0 && states[0].low == traits::EMPTY_CHAR) {
-                worklist[i].insert(states[0].state.begin(), states[0].state.end());
-            }
-        }
-
-        return transitive_closure(worklist);
-    }
-
-    std::vector<std::vector<std::pair<char_type, char_type>>> range_units_map() const
-    {
-        assert(this->m_epsilon_closure.size() == this->m_transitions.size());
-        std::vector<std::vector<std::pair<char_type, char_type>>> result;
-        result.resize(m_transitions.size());
-
-        for (size_t i = 0; i < m_transitions.size(); ++i) {
-            auto& ru = result[i];
-
-            for (auto& ci : this->m_epsilon_closure[i]) {
-                assert(ci < m_transitions.size());
-                auto& trans = this->m_transitions[ci];
-                for (auto& m : trans) {
-                    if (m.low == traits::EMPTY_CHAR)
-                        continue;
-
-                    ru.push_back(std::make_pair(m.low, m.high));
+        const auto nstates = this->m_transitions.size();
+        std::vector<std::set<NFAState_t>> closures(nstates);
+        std::vector<size_t> visited_by(nstates, nstates);
+        std::vector<NFAState_t> stack, reached;
+        for (size_t i = 0; i < nstates; ++i) {
+            reached.clear();
+            stack.push_back(i);
+            visited_by[i] = i;
+            while (!stack.empty()) {
+                auto s = stack.back();
+                stack.pop_back();
+                reached.push_back(s);
+
+                auto& trans = this->m_transitions[s];
+                if (trans.empty() || trans[0].low != traits::EMPTY_CHAR)
+                    continue;
+                for (auto t : trans[0].state) {
+                    if (visited_by[t] != i) {
+                        visited_by[t] = i;
+                        stack.push_back(t);
+                    }
                 }
             }
-            ru = split_ranges_to_units(std::move(ru));
+
+            std::sort(reached.begin(), reached.end());
+            closures[i] = std::set<NFAState_t>(reached.begin(), reached.end());
         }
 
-        return result;
+        return closures;
     }
 
   public:
     RegexNFA() = delete;
-    RegexNFA(NFATransitionTable table, NFAState_t start_state, std::set<NFAState_t> final_states)
+    RegexNFA(NFATransitionTable table,
+             NFAState_t start_state,
+             std::set<NFAState_t> final_states,
+             std::map<NFAState_t, size_t> final_tags = {})
         : m_transitions(std::move(table)),
           m_start_state(start_state),
-          m_final_states(std::move(final_states))
+          m_final_states(std::move(final_states)),
+          m_final_tags(std::move(final_tags))
     {
         this->m_epsilon_closure = this->get_epsilon_closure();
-        this->m_range_units = this->range_units_map();
     }
 
+    NFAState_t start_state() const
+    {
+        return this->m_start_state;
+    }
     std::set<NFAState_t> start_closure() const
     {
         return this->m_epsilon_closure[this->m_start_state];
@@ -104,6 +113,51 @@ class RegexNFA
     {
         return m_final_states;
     }
+    const NFATransitionTable& transitions() const
+    {
+        return m_transitions;
+    }
+    const std::map<NFAState_t, size_t>& final_tags() const
+    {
+        return m_final_tags;
+    }
+
+    /**
+     * union of @nfas, final states of the i-th NFA are tagged with i.
+     * states of each NFA are offset after the previous ones and a new start
+     * state leads to every start state by epsilon transitions.
+     */
+    static RegexNFA tagged_union(const std::vector<RegexNFA>& nfas)
+    {
+        NFATransitionTable table;
+        std::set<NFAState_t> final_states;
+        std::map<NFAState_t, size_t> final_tags;
+        std::set<NFAState_t> starts;
+        for (size_t tag = 0; tag < nfas.size(); tag++) {
+            auto& nfa = nfas[tag];
+            const auto offset = table.size();
+            starts.insert(nfa.m_start_state + offset);
+            for (auto f : nfa.m_final_states) {
+                final_states.insert(f + offset);
+                final_tags[f + offset] = tag;
+            }
+
+            for (auto& trans : nfa.m_transitions) {
+                std::vector<NFAEntry> ntrans;
+                for (auto& entry : trans) {
+                    std::set<NFAState_t> targets;
+                    for (auto t : entry.state)
+                        targets.insert(t + offset);
+                    ntrans.emplace_back(entry.low, entry.high, std::move(targets));
+                }
+                table.push_back(std::move(ntrans));
+            }
+        }
+
+        const auto start = table.size();
+        table.push_back({NFAEntry(traits::EMPTY_CHAR, traits::EMPTY_CHAR, std::move(starts))});
+        return RegexNFA(std::move(table), start, std::move(final_states), std::move(final_tags));
+    }
     const std::vector<std::set<NFAState_t>>& epsilon_closure() const
     {
         return m_epsilon_closure;
@@ -162,120 +216,197 @@ class RegexNFA
         return ss.str();
     }
 
-    RegexDFA<char_type> compile() const
+  private:
+    using state_t = StateSetTable::state_t;
+
+    /** epsilon closures as sorted lists, the closure of s is [offsets[s], offsets[s + 1]) */
+    struct ClosureTable
     {
-        size_t dfa_state_count = 0;
-        std::map<std::set<NFAState_t>, DFAState_t> dfa_state_map;
-        const auto query_dfa_state = [&](std::set<NFAState_t> states) -> DFAState_t {
-            auto it = dfa_state_map.find(states);
-            if (it != dfa_state_map.end())
-                return it->second;
-
-            const auto val = dfa_state_count++;
-            dfa_state_map[states] = val;
-            return val;
-        };
-
-        const auto sclosure = this->start_closure();
-        typename RegexDFA<char_type>::DFATransitionTable transtable;
-        const auto start_state = query_dfa_state(sclosure);
-        const auto dead_state = query_dfa_state({});
-        transtable.resize(dfa_state_count);
-        transtable[dead_state].emplace_back(traits::MIN, traits::MAX, dead_state);
-
-        const auto state_trans = [&](NFAState_t state, std::pair<char_type, char_type> ch) {
-            assert(state < this->m_transitions.size());
-            auto& trans = this->m_transitions[state];
-            auto lb = std::lower_bound(trans.begin(),
-                                       trans.end(),
-                                       ch.second,
-                                       [](const auto& te, char_type bd) { return te.high < bd; });
-            if (lb == trans.end() || lb->low > ch.second)
-                return std::set<size_t>();
-
-            assert(lb->high >= ch.second);
-            assert(ch.first >= lb->low);
-            return lb->state;
-        };
-
-        const auto state_set_trans = [&](const std::set<NFAState_t>& states,
-                                         std::pair<char_type, char_type> ch) {
-            std::set<NFAState_t> next_state;
-            for (auto& s : states) {
-                auto sn = state_trans(s, ch);
-                for (auto& ks : sn) {
-                    auto& mm = this->m_epsilon_closure[ks];
-                    next_state.insert(mm.begin(), mm.end());
-                }
-            }
+        std::vector<size_t> offsets;
+        std::vector<state_t> states;
+    };
+
+    /** successors of one DFA state, interval i goes to targets[offsets[i], offsets[i + 1]) */
+    struct SubsetExpansion
+    {
+        std::vector<char_type> lows;
+        std::vector<std::pair<size_t, state_t>> moves;
+        std::vector<size_t> offsets;
+        std::vector<state_t> targets;
+        std::vector<uint64_t> hashes;
+        // seen[s] == stamp when s is already in the interval being built
+        std::vector<size_t> seen;
+        size_t stamp = 0;
+    };
 
-            return next_state;
-        };
-
-        std::queue<std::set<NFAState_t>> process_queue;
-        process_queue.push(sclosure);
-        std::set<std::set<NFAState_t>> processed_states = {sclosure};
-
-        while (!process_queue.empty()) {
-            auto stateset = process_queue.front();
-            process_queue.pop();
-            auto state = query_dfa_state(stateset);
-            if (transtable.size() <= state)
-                transtable.resize(state + 1);
-            auto& trans = transtable[state];
-
-            std::set<std::pair<char_type, char_type>> range_units;
-            for (auto& s : stateset) {
-                assert(m_range_units.size() > s);
-                auto& range_unit = m_range_units[s];
-                range_units.insert(range_unit.begin(), range_unit.end());
+    void expand_subset(std::span<const state_t> set,
+                       const ClosureTable& closures,
+                       SubsetExpansion& step) const
+    {
+        // intervals no transition of a member crosses
+        auto& lows = step.lows;
+        lows.assign(1, traits::MIN);
+        for (auto s : set) {
+            for (auto& entry : this->m_transitions[s]) {
+                if (entry.low == traits::EMPTY_CHAR)
+                    continue;
+                lows.push_back(entry.low);
+                if (entry.high < traits::MAX)
+                    lows.push_back(entry.high + 1);
             }
-            auto ranges = split_ranges_to_units(std::vector<std::pair<char_type, char_type>>(
-                range_units.begin(), range_units.end()));
-
-            auto lv = traits::MIN;
-            for (auto& r : ranges) {
-                auto sn = state_set_trans(stateset, r);
-                if (processed_states.find(sn) == processed_states.end()) {
-                    process_queue.push(sn);
-                    processed_states.insert(sn);
+        }
+        std::sort(lows.begin(), lows.end());
+        lows.erase(std::unique(lows.begin(), lows.end()), lows.end());
+
+        step.moves.clear();
+        for (auto s : set) {
+            for (auto& entry : this->m_transitions[s]) {
+                if (entry.low == traits::EMPTY_CHAR)
+                    continue;
+
+                auto first = std::lower_bound(lows.begin(), lows.end(), entry.low);
+                auto last = std::upper_bound(first, lows.end(), entry.high);
+                for (auto i = first - lows.begin(); i < last - lows.begin(); i++) {
+                    for (auto t : entry.state)
+                        step.moves.emplace_back(i, t);
                 }
-
-                auto n = query_dfa_state(sn);
-                if (lv == traits::MAX) {
-                    assert(r.first == r.second);
-                    assert(r.first == traits::MAX);
+            }
+        }
+        std::sort(step.moves.begin(), step.moves.end());
+
+        step.seen.resize(this->m_transitions.size(), 0);
+        step.offsets.assign(1, 0);
+        step.targets.clear();
+        step.hashes.resize(lows.size());
+        auto move = step.moves.begin();
+        for (size_t i = 0; i < lows.size(); i++) {
+            ++step.stamp;
+            const auto begin = step.targets.size();
+            for (; move != step.moves.end() && move->first == i; ++move) {
+                for (auto k = closures.offsets[move->second];
+                     k < closures.offsets[move->second + 1];
+                     k++) {
+                    const auto t = closures.states[k];
+                    if (step.seen[t] != step.stamp) {
+                        step.seen[t] = step.stamp;
+                        step.targets.push_back(t);
+                    }
                 }
+            }
+            std::sort(step.targets.begin() + begin, step.targets.end());
+            step.offsets.push_back(step.targets.size());
+            step.hashes[i] = StateSetTable::hash(
+                std::span<const state_t>(step.targets.data() + begin, step.targets.size() - begin));
+        }
+    }
 
-                if (r.first > lv)
-                    trans.emplace_back(lv, r.first - 1, dead_state);
-                trans.emplace_back(r.first, r.second, n);
-                if (r.second < traits::MAX) {
-                    lv = r.second + 1;
-                } else {
-                    assert(r.second == traits::MAX);
-                    lv = traits::MAX;
-                }
+  public:
+    /**
+     * subset construction. DFA states are sorted lists of NFA states
+     * interned in a StateSetTable, so the work of a transition is
+     * proportional to the states it reaches plus one hash lookup.
+     *
+     * with @threads > 1 the discovered but unexpanded states are expanded in
+     * batches across a pool of that many threads, and their successors are
+     * interned in state order afterwards, so the result is identical to the
+     * serial one.
+     */
+    RegexDFA<char_type> compile(size_t threads = 1) const
+    {
+        constexpr size_t max_batch = 1024, min_parallel_batch = 16;
+        const auto nstates = this->m_transitions.size();
+        StateSetTable sets;
+
+        ClosureTable closures;
+        closures.offsets.reserve(nstates + 1);
+        closures.offsets.push_back(0);
+        for (size_t s = 0; s < nstates; s++) {
+            auto& closure = this->m_epsilon_closure[s];
+            closures.states.insert(closures.states.end(), closure.begin(), closure.end());
+            closures.offsets.push_back(closures.states.size());
+        }
+
+        typename RegexDFA<char_type>::DFATransitionTable transtable;
+        const auto start = this->m_start_state;
+        const DFAState_t start_state =
+            sets.insert(std::span<const state_t>(closures.states.data() + closures.offsets[start],
+                                                 closures.offsets[start + 1] -
+                                                     closures.offsets[start]))
+                .first;
+        const DFAState_t dead_state = sets.insert(std::span<const state_t>()).first;
+
+        std::vector<SubsetExpansion> steps(threads > 1 ? max_batch : 1);
+        std::optional<WorkerPool> pool;
+        for (DFAState_t state = 0; state < sets.size();) {
+            const size_t batch = std::min(sets.size() - state, steps.size());
+            const auto expand = [&](size_t i) {
+                this->expand_subset(sets[state + i], closures, steps[i]);
+            };
+            if (batch < min_parallel_batch || threads <= 1) {
+                for (size_t i = 0; i < batch; i++)
+                    expand(i);
+            } else {
+                if (!pool.has_value())
+                    pool.emplace(threads);
+                pool->run(batch, expand);
             }
 
-            if (trans.empty()) {
-                trans.emplace_back(traits::MIN, traits::MAX, dead_state);
-            } else if (trans.back().high < traits::MAX) {
-                trans.emplace_back(trans.back().high + 1, traits::MAX, dead_state);
+            for (size_t i = 0; i < batch; i++, state++) {
+                auto& step = steps[i];
+                std::vector<typename RegexDFA<char_type>::DFAEntry> row;
+                if (state == dead_state) {
+                    row.emplace_back(traits::MIN, traits::MAX, dead_state);
+                } else {
+                    for (size_t j = 0; j < step.lows.size(); j++) {
+                        const std::span<const state_t> target(
+                            step.targets.data() + step.offsets[j],
+                            step.offsets[j + 1] - step.offsets[j]);
+                        const DFAState_t next = sets.insert(target, step.hashes[j]).first;
+                        const char_type high = j + 1 < step.lows.size()
+                                                   ? char_type(step.lows[j + 1] - 1)
+                                                   : traits::MAX;
+                        if (!row.empty() && row.back().state == next) {
+                            row.back().high = high;
+                        } else {
+                            row.emplace_back(step.lows[j], high, next);
+                        }
+                    }
+                }
+                transtable.push_back(std::move(row));
             }
         }
 
+        std::vector<bool> is_final(nstates, false);
+        for (auto f : this->m_final_states)
+            is_final[f] = true;
+
         std::set<DFAState_t> final_states;
-        for (auto& s : processed_states) {
-            for (auto& f : this->m_final_states) {
-                if (s.find(f) != s.end()) {
-                    final_states.insert(query_dfa_state(s));
+        std::vector<std::vector<size_t>> accept_tags;
+        if (!this->m_final_tags.empty())
+            accept_tags.resize(sets.size());
+        for (DFAState_t state = 0; state < sets.size(); state++) {
+            std::set<size_t> tags;
+            for (auto s : sets[state]) {
+                if (!is_final[s])
+                    continue;
+
+                final_states.insert(state);
+                if (accept_tags.empty())
                     break;
-                }
+
+                auto it = this->m_final_tags.find(s);
+                if (it != this->m_final_tags.end())
+                    tags.insert(it->second);
             }
+            if (!accept_tags.empty())
+                accept_tags[state].assign(tags.begin(), tags.end());
         }
 
-        return RegexDFA<char_type>(transtable, start_state, {dead_state}, final_states);
+        return RegexDFA<char_type>(std::move(transtable),
+                                   start_state,
+                                   {dead_state},
+                                   std::move(final_states),
+                                   std::move(accept_tags));
     }
 };
 
@@ -287,12 +418,12 @@ class NFAMatcher : public AutomataMatcher<CharT>
     using char_type = CharT;
     using NFAEntry = typename RegexNFA<char_type>::NFAEntry;
     using NFAState_t = typename RegexNFA<char_type>::NFAState_t;
-    std::shared_ptr<RegexNFA<char_type>> m_nfa;
+    std::shared_ptr<const RegexNFA<char_type>> m_nfa;
     std::set<NFAState_t> m_current_states;
 
   public:
     NFAMatcher() = delete;
-    NFAMatcher(std::shared_ptr<RegexNFA<char_type>> nfa) : m_nfa(nfa)
+    NFAMatcher(std::shared_ptr<const RegexNFA<char_type>> nfa) : m_nfa(nfa)
     {
         if (this->m_nfa == nullptr)
             throw std::runtime_error("NFA is null");
@@ -301,7 +432,7 @@ class NFAMatcher : public AutomataMatcher<CharT>
     }
     NFAMatcher(const std::vector<char_type>& pattern);
 
-    std::shared_ptr<RegexNFA<char_type>> get_nfa()
+    std::shared_ptr<const RegexNFA<char_type>> get_nfa() const
     {
         return this->m_nfa;
     }
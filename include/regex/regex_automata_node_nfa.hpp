@@ -3,211 +3,181 @@
 
 #include "./regex_automata_nfa.hpp"
 #include "./regex_char.hpp"
+#include <algorithm>
 #include <assert.h>
-#include <map>
 #include <set>
+#include <sstream>
 #include <vector>
 
 
+/**
+ * thompson NFA under construction. states are dense indices and every
+ * edge has a single target, edges of all states live in one pool in the
+ * order they were added. composing NFAs only appends edges, another
+ * NodeNFA is spliced in by offsetting its states.
+ */
 template<typename CharT>
 class NodeNFA
 {
   public:
     using traits = character_traits<CharT>;
     using char_type = CharT;
-    using NodeNFAEntry = typename RegexNFA<char_type>::NFAEntry;
     using NFAState_t = typename RegexNFA<char_type>::NFAState_t;
-    using NodeNFATransitionTable = std::map<size_t, std::vector<NodeNFAEntry>>;
+    struct NodeNFAEdge
+    {
+        NFAState_t from, to;
+        char_type low, high;
+    };
 
   private:
     NFAState_t m_start_state, m_final_state;
-    NodeNFATransitionTable m_transitions;
-
-    static std::vector<NodeNFAEntry> merge_two_transitions(std::vector<NodeNFAEntry> first,
-                                                           std::vector<NodeNFAEntry> second)
-    {
-        std::vector<NodeNFAEntry> result;
-        result.reserve(first.size() + second.size());
-
-        auto first_it = first.begin();
-        auto second_it = second.begin();
-        while (first_it != first.end() && second_it != second.end()) {
-            if (first_it->high < second_it->low) {
-                result.push_back(std::move(*first_it));
-                ++first_it;
-            } else if (first_it->low > second_it->high) {
-                result.push_back(std::move(*second_it));
-                ++second_it;
-            } else {
-                auto& sm = first_it->low < second_it->low ? first_it : second_it;
-                auto& bg = first_it->low >= second_it->low ? first_it : second_it;
-
-                if (sm->low < bg->low) {
-                    result.push_back(NodeNFAEntry(sm->low, (char_type) (bg->low - 1), sm->state));
-                    sm->low = bg->low;
-                    assert(sm->low <= sm->high);
-                }
-
-                auto& sm2 = sm->high < bg->high ? sm : bg;
-                auto& bg2 = sm->high >= bg->high ? sm : bg;
-                result.push_back(NodeNFAEntry(sm2->low, sm2->high, std::move(sm2->state)));
-                result.back().state.insert(bg2->state.begin(), bg2->state.end());
-
-                if (sm2->high + 1 <= bg2->high) {
-                    bg2->low = (char_type) (sm->high + 1);
-                } else {
-                    bg2++;
-                }
-                sm2++;
-            }
-        }
-
-        if (first_it != first.end()) {
-            for (; first_it != first.end(); ++first_it)
-                result.push_back(std::move(*first_it));
-        }
-        if (second_it != second.end()) {
-            for (; second_it != second.end(); ++second_it)
-                result.push_back(std::move(*second_it));
-        }
-
-        return result;
-    }
-
+    size_t m_state_count;
+    std::vector<NodeNFAEdge> m_edges;
 
   public:
-    NodeNFA() = delete;
-    NodeNFA(NodeNFATransitionTable transitions, NFAState_t start_state, NFAState_t final_state)
-        : m_transitions(std::move(transitions)),
-          m_start_state(start_state),
-          m_final_state(final_state)
+    /** an NFA with only its start and final state */
+    NodeNFA() : m_start_state(0), m_final_state(1), m_state_count(2)
     {}
+    NodeNFA(size_t state_count, NFAState_t start_state, NFAState_t final_state)
+        : m_start_state(start_state), m_final_state(final_state), m_state_count(state_count)
+    {
+        assert(start_state < state_count && final_state < state_count);
+    }
 
-    NodeNFATransitionTable& transitions()
+    NFAState_t start_state() const
     {
-        return m_transitions;
+        return m_start_state;
     }
-    const NodeNFATransitionTable& transitions() const
+    NFAState_t final_state() const
     {
-        return m_transitions;
+        return m_final_state;
     }
-    NFAState_t start_state()
+    size_t state_count() const
     {
-        return m_start_state;
+        return m_state_count;
     }
-    NFAState_t final_state()
+    const std::vector<NodeNFAEdge>& edges() const
     {
-        return m_final_state;
+        return m_edges;
     }
 
-    RegexNFA<char_type> toRegexNFA()
+    NFAState_t newstate()
     {
-        typename RegexNFA<char_type>::NFATransitionTable transitions;
-        transitions.resize(this->m_transitions.size());
-        assert(transitions.size() == this->m_transitions.size());
-
-        std::map<size_t, size_t> state_rewriter;
-        size_t state_size = 0;
-        const auto query_state = [&](size_t state) {
-            if (state_rewriter.find(state) == state_rewriter.end())
-                state_rewriter[state] = state_size++;
-            return state_rewriter[state];
-        };
-        const auto query_state_set = [&](std::set<size_t> states) {
-            std::set<size_t> result;
-            for (auto state : states)
-                result.insert(query_state(state));
-            return result;
-        };
-
-        for (auto& m : this->m_transitions) {
-            auto state = query_state(m.first);
-            if (transitions.size() < state_size)
-                transitions.resize(state_size);
-            assert(state < transitions.size());
-
-            auto& entries = m.second;
-            auto& new_entries = transitions[state];
-            for (auto& entry : entries) {
-                assert(entry.low <= entry.high);
-                auto new_state = query_state_set(entry.state);
-                new_entries.emplace_back(entry.low, entry.high, new_state);
-            }
-        }
-
-        transitions.resize(state_size);
-        auto start_state = query_state(this->m_start_state);
-        auto finals = query_state(m_final_state);
-        return RegexNFA<char_type>(transitions, start_state, {finals});
+        return this->m_state_count++;
     }
 
-    std::string to_string() const
+    void add_link(NFAState_t from, NFAState_t to, char_type low, char_type high)
     {
-        std::ostringstream ss;
-        ss << "start: " << m_start_state << std::endl;
-        ss << "final: " << m_final_state << std::endl;
-        ss << "transitions: " << std::endl;
-        for (auto& trans : this->m_transitions) {
-            ss << trans.first << ": ";
-            for (auto& e : trans.second) {
-                if (e.low == traits::EMPTY_CHAR) {
-                    ss << "ε -> {";
-                } else if (e.low == e.high) {
-                    ss << char_to_string(e.low) << " -> {";
-                } else {
-                    ss << "[" << char_to_string(e.low) << "-" << char_to_string(e.high) << "] -> {";
-                }
-                for (auto& s : e.state)
-                    ss << s << " ";
-                ss << "} ";
-            }
-            ss << std::endl;
-        }
-        return ss.str();
+        assert(low <= high);
+        assert(from < this->m_state_count && to < this->m_state_count);
+        this->m_edges.push_back(NodeNFAEdge{from, to, low, high});
     }
 
-    void merge_with(NFAState_t state, std::vector<NodeNFAEntry> entries)
+    void add_epsilon(NFAState_t from, NFAState_t to)
     {
-        auto& transitions = this->m_transitions;
-
-        if (transitions.find(state) == transitions.end()) {
-            transitions[state] = std::move(entries);
-        } else {
-            transitions[state] = NodeNFA<char_type>::merge_two_transitions(
-                std::move(entries), std::move(transitions[state]));
-        }
+        this->add_link(from, to, traits::EMPTY_CHAR, traits::EMPTY_CHAR);
     }
 
-    void add_link(NFAState_t from, std::set<NFAState_t> to, char_type low, char_type high)
+    /** copy @other in between @starts and @finals, its states are appended */
+    void splice(const NodeNFA& other, NFAState_t starts, NFAState_t finals)
     {
-        assert(low <= high);
-        this->merge_with(from, {NodeNFAEntry(low, high, to)});
+        const auto offset = this->m_state_count;
+        this->m_state_count += other.m_state_count;
+        this->m_edges.reserve(this->m_edges.size() + other.m_edges.size() + 2);
+        for (auto& edge : other.m_edges)
+            this->add_link(edge.from + offset, edge.to + offset, edge.low, edge.high);
+        this->add_epsilon(starts, other.m_start_state + offset);
+        this->add_epsilon(other.m_final_state + offset, finals);
     }
 
-    NodeNFA<char_type>
-    relocate_state(StateAllocator<>& allocator, NFAState_t starts, NFAState_t finals)
+    RegexNFA<char_type> toRegexNFA() const
     {
-        NodeNFATransitionTable new_transitions;
-        std::map<NFAState_t, NFAState_t> state_rewriter(
-            {{this->m_start_state, starts}, {this->m_final_state, finals}});
-        for (auto& transp : this->m_transitions) {
-            if (state_rewriter.find(transp.first) == state_rewriter.end())
-                state_rewriter[transp.first] = allocator.newstate();
-
-            auto& new_transp = new_transitions[state_rewriter[transp.first]];
-            for (auto& entry : transp.second) {
-                std::set<NFAState_t> new_states;
-                for (auto s : entry.state) {
-                    if (state_rewriter.find(s) == state_rewriter.end())
-                        state_rewriter[s] = allocator.newstate();
-                    new_states.insert(state_rewriter[s]);
+        const auto nstates = this->m_state_count;
+        std::vector<size_t> offsets(nstates + 1, 0);
+        for (auto& edge : this->m_edges)
+            offsets[edge.from + 1]++;
+        for (size_t s = 0; s < nstates; s++)
+            offsets[s + 1] += offsets[s];
+
+        // edges grouped by source state, in insertion order
+        std::vector<const NodeNFAEdge*> sorted(this->m_edges.size());
+        std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+        for (auto& edge : this->m_edges)
+            sorted[next[edge.from]++] = &edge;
+
+        typename RegexNFA<char_type>::NFATransitionTable transitions(nstates);
+        std::vector<char_type> lows;
+        std::vector<NFAState_t> epsilons;
+        for (size_t s = 0; s < nstates; s++) {
+            auto& entries = transitions[s];
+            const auto begin = sorted.begin() + offsets[s], end = sorted.begin() + offsets[s + 1];
+
+            epsilons.clear();
+            lows.clear();
+            for (auto it = begin; it != end; ++it) {
+                auto& edge = **it;
+                if (edge.low == traits::EMPTY_CHAR) {
+                    epsilons.push_back(edge.to);
+                } else {
+                    lows.push_back(edge.low);
+                    if (edge.high < traits::MAX)
+                        lows.push_back(edge.high + 1);
                 }
+            }
+            if (!epsilons.empty()) {
+                entries.emplace_back(traits::EMPTY_CHAR,
+                                     traits::EMPTY_CHAR,
+                                     std::set<NFAState_t>(epsilons.begin(), epsilons.end()));
+            }
 
-                new_transp.emplace_back(entry.low, entry.high, new_states);
+            // split overlapping edges into disjoint ranges, adjacent ranges
+            // with the same targets are joined
+            std::sort(lows.begin(), lows.end());
+            lows.erase(std::unique(lows.begin(), lows.end()), lows.end());
+            for (size_t i = 0; i < lows.size(); i++) {
+                const char_type low = lows[i];
+                const char_type high =
+                    i + 1 < lows.size() ? char_type(lows[i + 1] - 1) : traits::MAX;
+                std::set<NFAState_t> targets;
+                for (auto it = begin; it != end; ++it) {
+                    auto& edge = **it;
+                    if (edge.low != traits::EMPTY_CHAR && edge.low <= low && high <= edge.high)
+                        targets.insert(edge.to);
+                }
+                if (targets.empty())
+                    continue;
+
+                if (!entries.empty() && entries.back().low != traits::EMPTY_CHAR &&
+                    entries.back().high + 1 == low && entries.back().state == targets) {
+                    entries.back().high = high;
+                } else {
+                    entries.emplace_back(low, high, std::move(targets));
+                }
             }
         }
 
-        return NodeNFA<char_type>(std::move(new_transitions), starts, finals);
+        return RegexNFA<char_type>(
+            std::move(transitions), this->m_start_state, {this->m_final_state});
+    }
+
+    std::string to_string() const
+    {
+        std::ostringstream ss;
+        ss << "start: " << m_start_state << std::endl;
+        ss << "final: " << m_final_state << std::endl;
+        ss << "edges: " << std::endl;
+        for (auto& e : this->m_edges) {
+            ss << e.from << " ";
+            if (e.low == traits::EMPTY_CHAR) {
+                ss << "ε";
+            } else if (e.low == e.high) {
+                ss << char_to_string(e.low);
+            } else {
+                ss << "[" << char_to_string(e.low) << "-" << char_to_string(e.high) << "]";
+            }
+            ss << " -> " << e.to << std::endl;
+        }
+        return ss.str();
     }
 
     static NodeNFA<char_type> from_basic_regex(const std::vector<char_type>& regex);
@@ -10,10 +10,8 @@ template<typename CharT>
 NodeNFA<CharT> NodeNFA<CharT>::from_basic_regex(const std::vector<char_type>& regex)
 {
     auto node = RegexNodeTreeGenerator<CharT>::parse(regex);
-    StateAllocator allocator;
-    auto starts = allocator.newstate();
-    auto finals = allocator.newstate();
-    auto nfa = node->to_nfa(allocator, starts, finals);
+    NodeNFA<CharT> nfa;
+    node->to_nfa(nfa, nfa.start_state(), nfa.final_state());
     return nfa;
 }
 
@@ -0,0 +1,133 @@
+#ifndef _DC_PARSER_REGEX_CACHE_HPP_
+#define _DC_PARSER_REGEX_CACHE_HPP_
+
+#include "./regex_automata_dfa.hpp"
+#include "./regex_automata_nfa.hpp"
+#include "./regex_automata_node_nfa.hpp"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+/**
+ * process-wide cache of compiled automata. automata are immutable once built
+ * and handed out as shared_ptr<const T>, so every matcher built from the same
+ * key shares one copy and only keeps its own cursor. an entry is built outside
+ * of the lock, when two threads race on a key the first one stored wins.
+ *
+ * the cache only holds weak references, an automaton is freed with its last
+ * user and built again when the key is asked for later. expired entries are
+ * pruned as the cache grows.
+ */
+template<typename CharT>
+class RegexCache
+{
+  public:
+    using char_type = CharT;
+    using pattern_t = std::vector<char_type>;
+
+  private:
+    std::mutex m_mutex;
+    std::unordered_map<std::string, std::weak_ptr<const void>> m_entries;
+    // entries, live or expired, at which the next insert prunes the expired ones
+    size_t m_prune_at = 16;
+
+    /** drop the entries whose automaton is gone, amortized over the inserts */
+    void prune()
+    {
+        if (this->m_entries.size() < this->m_prune_at)
+            return;
+
+        std::erase_if(this->m_entries, [](const auto& entry) { return entry.second.expired(); });
+        this->m_prune_at = std::max<size_t>(16, this->m_entries.size() * 2);
+    }
+
+    RegexCache() = default;
+
+  public:
+    RegexCache(const RegexCache&) = delete;
+    RegexCache& operator=(const RegexCache&) = delete;
+
+    static RegexCache& instance()
+    {
+        static RegexCache cache;
+        return cache;
+    }
+
+    /** key of the @kind automaton of @pattern, @kind names the type and its options */
+    static std::string key(const std::string& kind, const pattern_t& pattern)
+    {
+        std::string key = kind;
+        key.push_back('\0');
+        key.resize(key.size() + pattern.size() * sizeof(char_type));
+        if (!pattern.empty())
+            std::memcpy(key.data() + kind.size() + 1,
+                        pattern.data(),
+                        pattern.size() * sizeof(char_type));
+        return key;
+    }
+
+    /** the automaton stored under @key, built by @build() when no one holds it */
+    template<typename T, typename Build>
+    std::shared_ptr<const T> get(const std::string& key, Build build)
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            auto it = this->m_entries.find(key);
+            if (it != this->m_entries.end()) {
+                if (auto value = it->second.lock())
+                    return std::static_pointer_cast<const T>(value);
+            }
+        }
+
+        std::shared_ptr<const T> value = build();
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        auto& entry = this->m_entries[key];
+        if (auto stored = entry.lock())
+            return std::static_pointer_cast<const T>(stored);
+
+        entry = value;
+        this->prune();
+        return value;
+    }
+
+    std::shared_ptr<const RegexNFA<char_type>> nfa(const pattern_t& pattern)
+    {
+        return this->get<RegexNFA<char_type>>(key("nfa", pattern), [&]() {
+            return std::make_shared<const RegexNFA<char_type>>(
+                NodeNFA<char_type>::from_regex(pattern).toRegexNFA());
+        });
+    }
+
+    /** minimized DFA of @pattern */
+    std::shared_ptr<const RegexDFA<char_type>> dfa(const pattern_t& pattern)
+    {
+        return this->get<RegexDFA<char_type>>(key("dfa", pattern), [&]() {
+            auto dfa = this->nfa(pattern)->compile();
+            dfa.optimize();
+            return std::make_shared<const RegexDFA<char_type>>(std::move(dfa));
+        });
+    }
+
+    /** automata still alive, expired entries not pruned yet are not counted */
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        return std::count_if(this->m_entries.begin(),
+                             this->m_entries.end(),
+                             [](const auto& entry) { return !entry.second.expired(); });
+    }
+
+    /** forget every entry, automata still in use stay alive with their users */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(this->m_mutex);
+        this->m_entries.clear();
+    }
+};
+
+#endif // _DC_PARSER_REGEX_CACHE_HPP_
@@ -0,0 +1,151 @@
+#ifndef _DC_PARSER_REGEX_CHAR_CLASS_HPP_
+#define _DC_PARSER_REGEX_CHAR_CLASS_HPP_
+
+#include "./regex_char.hpp"
+#include <algorithm>
+#include <array>
+#include <assert.h>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+
+/**
+ * partition of the alphabet [MIN, MAX] into equivalence classes.
+ * the alphabet is cut into sorted intervals starting at @m_lows, and each
+ * interval belongs to exactly one class. characters below 256 are resolved
+ * by a direct lookup table, others by a binary search over the intervals.
+ */
+template<typename CharT>
+class CharClassMap
+{
+  public:
+    using traits = character_traits<CharT>;
+    using char_type = CharT;
+    using class_t = uint32_t;
+    static constexpr size_t byte_size = 256;
+
+  private:
+    std::vector<char_type> m_lows;
+    std::vector<class_t> m_interval_class;
+    std::vector<char_type> m_representatives;
+    std::array<class_t, byte_size> m_bytes;
+    size_t m_nclasses;
+
+    class_t lookup(char_type c) const
+    {
+        assert(traits::MIN <= c && c <= traits::MAX);
+        auto ub = std::upper_bound(m_lows.begin(), m_lows.end(), c);
+        assert(ub != m_lows.begin());
+        return m_interval_class[std::distance(m_lows.begin(), ub) - 1];
+    }
+
+    void setup()
+    {
+        assert(!m_lows.empty() && m_lows.front() == traits::MIN);
+        assert(m_lows.size() == m_interval_class.size());
+
+        m_representatives.assign(m_nclasses, traits::MIN);
+        std::vector<bool> seen(m_nclasses, false);
+        for (size_t i = 0; i < m_lows.size(); i++) {
+            auto cls = m_interval_class[i];
+            assert(cls < m_nclasses);
+            if (!seen[cls]) {
+                seen[cls] = true;
+                m_representatives[cls] = m_lows[i];
+            }
+        }
+
+        for (size_t i = 0; i < byte_size; i++) {
+            auto c = static_cast<char_type>(i);
+            if (static_cast<size_t>(c) == i && traits::MIN <= c && c <= traits::MAX) {
+                m_bytes[i] = this->lookup(c);
+            } else {
+                m_bytes[i] = 0;
+            }
+        }
+    }
+
+  public:
+    CharClassMap() : m_lows({traits::MIN}), m_interval_class({0}), m_nclasses(1)
+    {
+        this->setup();
+    }
+
+    CharClassMap(std::vector<char_type> lows, std::vector<class_t> interval_class, size_t nclasses)
+        : m_lows(std::move(lows)),
+          m_interval_class(std::move(interval_class)),
+          m_nclasses(nclasses)
+    {
+        this->setup();
+    }
+
+    /**
+     * build the coarsest partition that keeps every boundary in @lows
+     * distinguishable, intervals with equal @signature share one class.
+     * @signature is invoked with interval index and the interval's lower bound.
+     */
+    template<typename SignatureFn>
+    static CharClassMap from_boundaries(std::vector<char_type> lows, SignatureFn signature)
+    {
+        lows.push_back(traits::MIN);
+        std::sort(lows.begin(), lows.end());
+        lows.erase(std::unique(lows.begin(), lows.end()), lows.end());
+
+        using signature_t = decltype(signature(size_t(0), traits::MIN));
+        std::map<signature_t, class_t> classes;
+        std::vector<class_t> interval_class;
+        interval_class.reserve(lows.size());
+        for (size_t i = 0; i < lows.size(); i++) {
+            auto sig = signature(i, lows[i]);
+            auto it = classes.find(sig);
+            if (it == classes.end())
+                it = classes.emplace(std::move(sig), classes.size()).first;
+            interval_class.push_back(it->second);
+        }
+
+        const auto n = classes.size();
+        return CharClassMap(std::move(lows), std::move(interval_class), n);
+    }
+
+    /** split the alphabet at both ends of every range, each interval is its own class */
+    static CharClassMap from_ranges(const std::vector<std::pair<char_type, char_type>>& ranges)
+    {
+        std::vector<char_type> lows;
+        for (auto& r : ranges) {
+            lows.push_back(r.first);
+            if (r.second < traits::MAX)
+                lows.push_back(r.second + 1);
+        }
+
+        return from_boundaries(std::move(lows), [](size_t i, char_type) { return i; });
+    }
+
+    inline class_t operator()(char_type c) const
+    {
+        if (0 <= c && static_cast<size_t>(c) < byte_size)
+            return m_bytes[static_cast<size_t>(c)];
+
+        return this->lookup(c);
+    }
+
+    size_t size() const
+    {
+        return m_nclasses;
+    }
+    char_type representative(class_t cls) const
+    {
+        assert(cls < m_nclasses);
+        return m_representatives[cls];
+    }
+    const std::vector<char_type>& lows() const
+    {
+        return m_lows;
+    }
+    const std::vector<class_t>& interval_classes() const
+    {
+        return m_interval_class;
+    }
+};
+
+#endif // _DC_PARSER_REGEX_CHAR_CLASS_HPP_
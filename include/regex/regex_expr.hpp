@@ -4,6 +4,7 @@
 #include "./regex_char.hpp"
 #include <assert.h>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 
@@ -101,6 +102,13 @@ class Regex2BasicConvertor
         }
     }
 
+    void push_number(size_t n)
+    {
+        const auto digits = std::to_string(n);
+        for (auto d : digits)
+            this->__result.push_back(regex_char::unescape(traits::ZERO + (d - '0')));
+    }
+
     void enter_brace_mode()
     {
         this->m_brace_count_low = 0;
@@ -125,37 +133,28 @@ class Regex2BasicConvertor
             this->m_brace_count_up = brace_infinity;
             return true;
         } else if (c == traits::RBRACE) {
-            this->__result.resize(this->__result.size() - this->__copy_content.size());
-            for (size_t i = 0; i < this->m_brace_count_low; i++) {
-                this->__result.insert(
-                    this->__result.end(), this->__copy_content.begin(), this->__copy_content.end());
-            }
-
-            if (this->m_brace_got_comma) {
-                if (this->m_brace_count_up < this->m_brace_count_low)
-                    throw std::runtime_error("range error");
-
-                if (this->m_brace_count_up == brace_infinity) {
-                    this->__result.insert(this->__result.end(),
-                                          this->__copy_content.begin(),
-                                          this->__copy_content.end());
-                    this->__result.push_back(regex_char::unescape(traits::STAR));
-                } else {
-                    const auto opt_count = this->m_brace_count_up - this->m_brace_count_low;
-                    for (size_t i = 0; i < opt_count; i++) {
-                        this->__result.push_back(regex_char::unescape(traits::LPAREN));
-                        this->__result.push_back(regex_char::unescape(traits::OR));
-                        this->__result.insert(this->__result.end(),
-                                              this->__copy_content.begin(),
-                                              this->__copy_content.end());
-                    }
-                    std::vector<regex_char> nrparen(opt_count,
-                                                    regex_char::unescape(traits::RPAREN));
-                    this->__result.insert(this->__result.end(), nrparen.begin(), nrparen.end());
-                }
-            }
-
             this->m_in_brace_mode = false;
+            const bool bounded =
+                !this->m_brace_got_comma || this->m_brace_count_up != brace_infinity;
+            const auto low = this->m_brace_count_low;
+            const auto up = this->m_brace_got_comma ? this->m_brace_count_up : low;
+            if (bounded && up < low)
+                throw std::runtime_error("range error");
+
+            // repetition stays a {} node of the basic regex instead of being unrolled
+            if (!bounded && low == 0) {
+                this->__result.push_back(regex_char::unescape(traits::STAR));
+            } else if (bounded && up == 0) {
+                this->__result.resize(this->__result.size() - this->__copy_content.size());
+            } else if (!bounded || low != 1 || up != 1) {
+                this->__result.push_back(regex_char::unescape(traits::LBRACE));
+                this->push_number(low);
+                if (low != up || !bounded)
+                    this->__result.push_back(regex_char::unescape(traits::COMMA));
+                if (bounded && low != up)
+                    this->push_number(up);
+                this->__result.push_back(regex_char::unescape(traits::RBRACE));
+            }
             return true;
         }
 
@@ -195,8 +194,15 @@ class Regex2BasicConvertor
         if (c.is_escaped()) {
             switch (_c) {
             case traits::LBRACE:
-            case traits::COMMA:
             case traits::RBRACE:
+                // braces are special in the basic regex as well, except in a bracket
+                if (this->m_bracket_mode) {
+                    this->__result.push_back(regex_char::unescape(_c));
+                } else {
+                    this->__result.push_back(c);
+                }
+                break;
+            case traits::COMMA:
             case traits::QUESTION:
             case traits::PLUS:
             case traits::DOT:
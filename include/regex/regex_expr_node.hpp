@@ -6,6 +6,7 @@
 #include "./regex_expr.hpp"
 #include <algorithm>
 #include <assert.h>
+#include <limits>
 #include <memory>
 #include <optional>
 #include <stdexcept>
@@ -20,7 +21,8 @@ enum ExprNodeType
     ExprNodeType_CharRange,
     ExprNodeType_Concatenation,
     ExprNodeType_Union,
-    ExprNodeType_KleeneStar
+    ExprNodeType_KleeneStar,
+    ExprNodeType_Repeat
 };
 
 template<typename CharT>
@@ -31,8 +33,8 @@ class ExprNode
     virtual ExprNodeType node_type() const = 0;
     virtual std::string to_string() const = 0;
 
-    virtual NodeNFA<CharT>
-    to_nfa(StateAllocator<>& allocator, NFAState_t starts, NFAState_t finals) const = 0;
+    /** add the edges of this node between @starts and @finals of @nfa */
+    virtual void to_nfa(NodeNFA<CharT>& nfa, NFAState_t starts, NFAState_t finals) const = 0;
 
     virtual ~ExprNode() = default;
 };
@@ -43,8 +45,6 @@ class ExprNodeEmpty : public ExprNode<CharT>
   private:
     using traits = character_traits<CharT>;
     using char_type = CharT;
-    using NodeNFATransitionTable = typename NodeNFA<CharT>::NodeNFATransitionTable;
-    using NodeNFAEntry = typename NodeNFA<CharT>::NodeNFAEntry;
     using NFAState_t = typename NodeNFA<CharT>::NFAState_t;
 
   public:
@@ -57,13 +57,9 @@ class ExprNodeEmpty : public ExprNode<CharT>
         return "";
     }
 
-    virtual NodeNFA<CharT>
-    to_nfa(StateAllocator<>& allocator, NFAState_t starts, NFAState_t finals) const override
+    virtual void to_nfa(NodeNFA<CharT>& nfa, NFAState_t starts, NFAState_t finals) const override
     {
-        NodeNFA<CharT> retval(NodeNFATransitionTable(), starts, finals);
-        ;
-        retval.add_link(starts, {finals}, traits::EMPTY_CHAR, traits::EMPTY_CHAR);
-        return retval;
+        nfa.add_epsilon(starts, finals);
     }
 
     virtual ~ExprNodeEmpty() override = default;
@@ -100,20 +96,17 @@ class ExprNodeGroup : public ExprNode<CharT>
         return "(" + this->_next->to_string() + ")";
     }
 
-    virtual NodeNFA<CharT>
-    to_nfa(StateAllocator<>& allocator, NFAState_t starts, NFAState_t finals) const override
+    virtual void to_nfa(NodeNFA<CharT>& nfa, NFAState_t starts, NFAState_t finals) const override
     {
-        auto nfa = this->_next->to_nfa(allocator, starts, finals);
         if (!this->_complemented)
-            return nfa;
+            return this->_next->to_nfa(nfa, starts, finals);
 
-        auto rnfa = nfa.toRegexNFA();
-        auto dfa = rnfa.compile();
+        NodeNFA<CharT> inner;
+        this->_next->to_nfa(inner, inner.start_state(), inner.final_state());
+        auto dfa = inner.toRegexNFA().compile();
         auto complemented_dfa = dfa.complement();
         complemented_dfa.optimize();
-        auto complemented_nfa = complemented_dfa.toNodeNFA();
-        return complemented_nfa.relocate_state(allocator, starts, finals);
-        ;
+        nfa.splice(complemented_dfa.toNodeNFA(), starts, finals);
     }
 
     virtual ~ExprNodeGroup() override = default;
@@ -125,8 +118,6 @@ class ExprNodeCharRange : public ExprNode<CharT>
   private:
     using traits = character_traits<CharT>;
     using char_type = CharT;
-    using NodeNFATransitionTable = typename NodeNFA<CharT>::NodeNFATransitionTable;
-    using NodeNFAEntry = typename NodeNFA<CharT>::NodeNFAEntry;
     using NFAState_t = typename NodeNFA<CharT>::NFAState_t;
     char_type _min, _max;
 
@@ -159,12 +150,9 @@ class ExprNodeCharRange : public ExprNode<CharT>
             return char_to_string(this->_min) + "-" + char_to_string(this->_max);
     }
 
-    virtual NodeNFA<CharT>
-    to_nfa(StateAllocator<>& allocator, NFAState_t starts, NFAState_t finals) const override
+    virtual void to_nfa(NodeNFA<CharT>& nfa, NFAState_t starts, NFAState_t finals) const override
     {
-        NodeNFA<CharT> retval(NodeNFATransitionTable(), starts, finals);
-        retval.add_link(starts, {finals}, this->min(), this->max());
-        return retval;
+        nfa.add_link(starts, finals, this->min(), this->max());
     }
 
     virtual ~ExprNodeCharRange() override = default;
@@ -176,8 +164,6 @@ class ExprNodeConcatenation : public ExprNode<CharT>
   private:
     using traits = character_traits<CharT>;
     using char_type = CharT;
-    using NodeNFATransitionTable = typename NodeNFA<CharT>::NodeNFATransitionTable;
-    using NodeNFAEntry = typename NodeNFA<CharT>::NodeNFAEntry;
     using NFAState_t = typename NodeNFA<CharT>::NFAState_t;
     std::vector<std::shared_ptr<ExprNode<CharT>>> children;
 
@@ -219,39 +205,15 @@ class ExprNodeConcatenation : public ExprNode<CharT>
         return result;
     }
 
-    virtual NodeNFA<CharT>
-    to_nfa(StateAllocator<>& allocator, NFAState_t starts, NFAState_t finals) const override
+    virtual void to_nfa(NodeNFA<CharT>& nfa, NFAState_t starts, NFAState_t finals) const override
     {
         assert(this->size() > 0);
-        if (this->size() == 1)
-            return this->back()->to_nfa(allocator, starts, finals);
-
-        NodeNFA<CharT> retval(NodeNFATransitionTable(), starts, finals);
-
-        std::vector<std::pair<size_t, size_t>> starts_finals(this->size());
-        starts_finals.front().first = starts;
-        starts_finals.back().second = finals;
-        for (size_t i = 0; i < starts_finals.size() - 1; i++) {
-            auto ns = allocator.newstate();
-            starts_finals[i].second = ns;
-            starts_finals[i + 1].first = ns;
+        auto s = starts;
+        for (size_t i = 0; i < this->size(); i++) {
+            auto f = i + 1 < this->size() ? nfa.newstate() : finals;
+            this->children[i]->to_nfa(nfa, s, f);
+            s = f;
         }
-
-        for (size_t i = 0; i < starts_finals.size(); i++) {
-            auto s = starts_finals[i].first;
-            auto f = starts_finals[i].second;
-            auto& child = this->children[i];
-            auto child_nfa = child->to_nfa(allocator, s, f);
-            auto& child_transitions = child_nfa.transitions();
-            for (auto& entryp : child_transitions) {
-                auto& w = entryp.first;
-                auto& entry = entryp.second;
-
-                retval.merge_with(w, entry);
-            }
-        }
-
-        return retval;
     }
 
     virtual ~ExprNodeConcatenation() override = default;
@@ -263,8 +225,6 @@ class ExprNodeUnion : public ExprNode<CharT>
   private:
     using traits = character_traits<CharT>;
     using char_type = CharT;
-    using NodeNFATransitionTable = typename NodeNFA<CharT>::NodeNFATransitionTable;
-    using NodeNFAEntry = typename NodeNFA<CharT>::NodeNFAEntry;
     using NFAState_t = typename NodeNFA<CharT>::NFAState_t;
     std::vector<std::shared_ptr<ExprNode<CharT>>> children;
 
@@ -307,27 +267,11 @@ class ExprNodeUnion : public ExprNode<CharT>
         return result;
     }
 
-    virtual NodeNFA<CharT>
-    to_nfa(StateAllocator<>& allocator, NFAState_t starts, NFAState_t finals) const override
+    virtual void to_nfa(NodeNFA<CharT>& nfa, NFAState_t starts, NFAState_t finals) const override
     {
         assert(this->size() > 0);
-        if (this->size() == 1)
-            return this->back()->to_nfa(allocator, starts, finals);
-
-        NodeNFA<CharT> retval(NodeNFATransitionTable(), starts, finals);
-
-        for (auto& child : this->children) {
-            auto child_nfa = child->to_nfa(allocator, starts, finals);
-            auto& child_transitions = child_nfa.transitions();
-            for (auto& entryp : child_transitions) {
-                auto& w = entryp.first;
-                auto& entry = entryp.second;
-
-                retval.merge_with(w, entry);
-            }
-        }
-
-        return retval;
+        for (auto& child : this->children)
+            child->to_nfa(nfa, starts, finals);
     }
 
     virtual ~ExprNodeUnion() override = default;
@@ -339,8 +283,6 @@ class ExprNodeKleeneStar : public ExprNode<CharT>
   private:
     using traits = character_traits<CharT>;
     using char_type = CharT;
-    using NodeNFATransitionTable = typename NodeNFA<CharT>::NodeNFATransitionTable;
-    using NodeNFAEntry = typename NodeNFA<CharT>::NodeNFAEntry;
     using NFAState_t = typename NodeNFA<CharT>::NFAState_t;
     std::shared_ptr<ExprNode<CharT>> _next;
 
@@ -366,18 +308,103 @@ class ExprNodeKleeneStar : public ExprNode<CharT>
         return this->_next->to_string() + "*";
     }
 
-    virtual NodeNFA<CharT>
-    to_nfa(StateAllocator<>& allocator, NFAState_t starts, NFAState_t finals) const override
+    virtual void to_nfa(NodeNFA<CharT>& nfa, NFAState_t starts, NFAState_t finals) const override
     {
-        auto retval = this->next()->to_nfa(allocator, starts, finals);
-        retval.add_link(starts, {finals}, traits::EMPTY_CHAR, traits::EMPTY_CHAR);
-        retval.add_link(finals, {starts}, traits::EMPTY_CHAR, traits::EMPTY_CHAR);
-        return retval;
+        // the loop must not pass through @starts or @finals, they may be shared with siblings
+        auto inner_starts = nfa.newstate();
+        auto inner_finals = nfa.newstate();
+        this->next()->to_nfa(nfa, inner_starts, inner_finals);
+        nfa.add_epsilon(starts, inner_starts);
+        nfa.add_epsilon(inner_starts, finals);
+        nfa.add_epsilon(inner_finals, inner_starts);
     }
 
     virtual ~ExprNodeKleeneStar() override = default;
 };
 
+/** @min to @max copies of a node, @max is npos for no upper bound */
+template<typename CharT>
+class ExprNodeRepeat : public ExprNode<CharT>
+{
+  private:
+    using NFAState_t = typename NodeNFA<CharT>::NFAState_t;
+    std::shared_ptr<ExprNode<CharT>> _next;
+    size_t _min, _max;
+
+  public:
+    static constexpr size_t npos = std::numeric_limits<size_t>::max();
+
+    ExprNodeRepeat(std::shared_ptr<ExprNode<CharT>> next, size_t min, size_t max)
+        : _next(next), _min(min), _max(max)
+    {
+        assert(min <= max);
+    }
+
+    const std::shared_ptr<ExprNode<CharT>> next() const
+    {
+        return _next;
+    }
+    size_t min() const
+    {
+        return _min;
+    }
+    size_t max() const
+    {
+        return _max;
+    }
+
+    virtual ExprNodeType node_type() const override
+    {
+        return ExprNodeType_Repeat;
+    }
+    virtual std::string to_string() const override
+    {
+        auto result = this->_next->to_string() + "{" + std::to_string(this->_min);
+        if (this->_max != this->_min)
+            result += ",";
+        if (this->_max != this->_min && this->_max != npos)
+            result += std::to_string(this->_max);
+        return result + "}";
+    }
+
+    /**
+     * copies are chained one after another. the start of every optional copy
+     * also leads to @finals directly, so all of them share the same suffix
+     * and an epsilon closure never spans more than one copy.
+     */
+    virtual void to_nfa(NodeNFA<CharT>& nfa, NFAState_t starts, NFAState_t finals) const override
+    {
+        auto s = starts;
+        for (size_t i = 0; i < this->_min; i++) {
+            auto f = i + 1 == this->_max ? finals : nfa.newstate();
+            this->_next->to_nfa(nfa, s, f);
+            s = f;
+        }
+
+        if (this->_max == npos) {
+            // the loop must not pass through @starts or @finals, they may be shared with siblings
+            auto inner_starts = nfa.newstate();
+            auto inner_finals = nfa.newstate();
+            this->_next->to_nfa(nfa, inner_starts, inner_finals);
+            nfa.add_epsilon(s, inner_starts);
+            nfa.add_epsilon(inner_starts, finals);
+            nfa.add_epsilon(inner_finals, inner_starts);
+            return;
+        }
+
+        for (size_t i = this->_min; i < this->_max; i++) {
+            nfa.add_epsilon(s, finals);
+            auto f = i + 1 == this->_max ? finals : nfa.newstate();
+            this->_next->to_nfa(nfa, s, f);
+            s = f;
+        }
+        if (s != finals)
+            nfa.add_epsilon(s, finals);
+    }
+
+    virtual ~ExprNodeRepeat() override = default;
+};
+
 template<typename CharT>
 class RegexNodeTreeGenerator
 {
@@ -417,7 +444,8 @@ class RegexNodeTreeGenerator
         } break;
         case ExprNodeType_Group:
         case ExprNodeType_CharRange:
-        case ExprNodeType_KleeneStar: {
+        case ExprNodeType_KleeneStar:
+        case ExprNodeType_Repeat: {
             auto newnode = std::make_shared<ExprNodeConcatenation<char_type>>();
             newnode->add_child(oldnode);
             newnode->add_child(node);
@@ -452,6 +480,7 @@ class RegexNodeTreeGenerator
         case ExprNodeType_Group:
         case ExprNodeType_CharRange:
         case ExprNodeType_KleeneStar:
+        case ExprNodeType_Repeat:
         case ExprNodeType_Concatenation: {
             auto newnode = std::make_shared<ExprNodeUnion<char_type>>();
             newnode->add_child(stacktop.node);
@@ -463,7 +492,9 @@ class RegexNodeTreeGenerator
             assert("regex: invalid node type");
         }
     }
-    node_type node_to_kleen_start_node(node_type node)
+    /** apply a postfix operator given by @wrap to the last atom of @node */
+    template<typename Wrap>
+    node_type wrap_last_node(node_type node, const Wrap& wrap)
     {
         assert(node != nullptr);
         node_type ret;
@@ -471,26 +502,26 @@ class RegexNodeTreeGenerator
         switch (node->node_type()) {
         case ExprNodeType_Group:
         case ExprNodeType_KleeneStar:
+        case ExprNodeType_Repeat:
         case ExprNodeType_CharRange: {
-            auto newnode = std::make_shared<ExprNodeKleeneStar<char_type>>(node);
-            ret = newnode;
+            ret = wrap(node);
         } break;
         case ExprNodeType_Concatenation: {
             auto ptr = std::dynamic_pointer_cast<ExprNodeConcatenation<char_type>>(node);
             assert(ptr->size() >= 1);
             auto& back = ptr->back();
-            back = node_to_kleen_start_node(back);
+            back = wrap_last_node(back, wrap);
             ret = node;
         } break;
         case ExprNodeType_Union: {
             auto ptr = std::dynamic_pointer_cast<ExprNodeUnion<char_type>>(node);
             assert(ptr->size() >= 1);
             auto& back = ptr->back();
-            back = node_to_kleen_start_node(back);
+            back = wrap_last_node(back, wrap);
             ret = node;
         } break;
         case ExprNodeType_Empty:
-            throw std::runtime_error("regex: invalid kleene star node");
+            throw std::runtime_error("regex: nothing to repeat");
         default:
             assert("regex: invalid node type");
         }
@@ -501,9 +532,53 @@ class RegexNodeTreeGenerator
     {
         auto& stacktop = _stack.back();
         assert(stacktop.node != nullptr);
-        stacktop.node = node_to_kleen_start_node(stacktop.node);
+        stacktop.node = wrap_last_node(stacktop.node, [](node_type node) -> node_type {
+            return std::make_shared<ExprNodeKleeneStar<char_type>>(node);
+        });
         assert(stacktop.node != nullptr);
     }
+    void stacktop_to_repeat_node(size_t min, size_t max)
+    {
+        auto& stacktop = _stack.back();
+        assert(stacktop.node != nullptr);
+        stacktop.node = wrap_last_node(stacktop.node, [&](node_type node) -> node_type {
+            return std::make_shared<ExprNodeRepeat<char_type>>(node, min, max);
+        });
+    }
+
+    // {min} {min,} {min,max} of the basic regex
+    bool m_in_brace_mode;
+    bool m_brace_got_comma;
+    std::optional<size_t> m_brace_min, m_brace_max;
+
+    bool handle_brace_mode(regex_char _c)
+    {
+        if (!this->m_in_brace_mode)
+            return false;
+
+        const auto c = _c.get();
+        if (!_c.is_escaped() && c == traits::COMMA && !this->m_brace_got_comma) {
+            this->m_brace_got_comma = true;
+        } else if (!_c.is_escaped() && c == traits::RBRACE) {
+            this->m_in_brace_mode = false;
+            if (!this->m_brace_min.has_value())
+                throw std::runtime_error("regex: expect a number in {}");
+            const auto min = this->m_brace_min.value();
+            const auto max = this->m_brace_got_comma
+                                 ? this->m_brace_max.value_or(ExprNodeRepeat<char_type>::npos)
+                                 : min;
+            if (max < min)
+                throw std::runtime_error("regex: range error in {}");
+            this->stacktop_to_repeat_node(min, max);
+        } else if (!_c.is_escaped() && traits::ZERO <= c && c <= traits::NINE) {
+            auto& n = this->m_brace_got_comma ? this->m_brace_max : this->m_brace_min;
+            n = n.value_or(0) * 10 + (c - traits::ZERO);
+        } else {
+            throw std::runtime_error("regex: unexpected '" + char_to_string(c) + "' in {}");
+        }
+
+        return true;
+    }
 
     bool m_in_bracket_mode;
     bool m_bracket_reversed;
@@ -641,7 +716,9 @@ class RegexNodeTreeGenerator
     }
 
   public:
-    RegexNodeTreeGenerator() : _endding(false), m_in_bracket_mode(false), _stack()
+    RegexNodeTreeGenerator()
+        : _stack(), _endding(false), m_in_brace_mode(false), m_brace_got_comma(false),
+          m_in_bracket_mode(false)
     {
         this->_stack.push_back(StackValueState());
     }
@@ -650,7 +727,7 @@ class RegexNodeTreeGenerator
     {
         assert(!this->_endding);
 
-        if (this->handle_bracket_mode(_c))
+        if (this->handle_bracket_mode(_c) || this->handle_brace_mode(_c))
             return;
 
         auto c = _c.get();
@@ -658,7 +735,7 @@ class RegexNodeTreeGenerator
             if (c != traits::LPAREN && c != traits::RPAREN && c != traits::LBRACKET &&
                 c != traits::CARET && c != traits::DASH && c != traits::RBRACKET &&
                 c != traits::OR && c != traits::STAR && c != traits::EXCLAMATION &&
-                c != traits::BACKSLASH) {
+                c != traits::BACKSLASH && c != traits::LBRACE && c != traits::RBRACE) {
                 throw std::runtime_error("unexpected escape seqeuence");
             }
 
@@ -704,6 +781,15 @@ class RegexNodeTreeGenerator
         case traits::STAR: {
             this->stacktop_to_kleene_star_node();
         } break;
+        case traits::LBRACE: {
+            this->m_in_brace_mode = true;
+            this->m_brace_got_comma = false;
+            this->m_brace_min.reset();
+            this->m_brace_max.reset();
+        } break;
+        case traits::RBRACE: {
+            throw std::runtime_error("unexpected }");
+        } break;
         default:
             this->push_char(c);
         }
@@ -716,7 +802,7 @@ class RegexNodeTreeGenerator
 
         this->_endding = true;
 
-        if (this->_stack.size() != 1)
+        if (this->_stack.size() != 1 || this->m_in_brace_mode)
             throw std::runtime_error("unexpected end");
 
         auto top = this->_stack.back();
@@ -2,19 +2,29 @@
 #define _DC_PARSER_REGEX_INTERNAL_HPP_
 
 #include "./regex_automata.hpp"
+#include "./regex_automata_bit_nfa.hpp"
+#include "./regex_automata_bit_nfa_impl.hpp"
 #include "./regex_automata_dfa.hpp"
+#include "./regex_automata_dfa_image.hpp"
 #include "./regex_automata_dfa_impl.hpp"
+#include "./regex_automata_lazy_dfa.hpp"
+#include "./regex_automata_lazy_dfa_impl.hpp"
 #include "./regex_automata_nfa.hpp"
 #include "./regex_automata_nfa_impl.hpp"
 #include "./regex_automata_node_nfa.hpp"
 #include "./regex_automata_node_nfa_impl.hpp"
+#include "./regex_cache.hpp"
 #include "./regex_char.hpp"
 #include "./regex_expr.hpp"
 #include "./regex_expr_node.hpp"
+#include "./regex_search.hpp"
 #include <algorithm>
 #include <memory>
+#include <optional>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 
@@ -24,27 +34,55 @@ class SimpleRegExp : public AutomataMatcher<CharT>
   private:
     using traits = character_traits<CharT>;
     using char_type = CharT;
+    std::vector<char_type> m_pattern;
+    std::shared_ptr<const RegexNFA<char_type>> m_nfa;
     std::shared_ptr<AutomataMatcher<char_type>> m_matcher;
+    // the cached matcher the bit-parallel one was copied from, held so that
+    // the cache keeps handing out its tables while this regex lives
+    std::shared_ptr<const void> m_prototype;
+    using BitNFA64 = BitNFAMatcher<char_type, 1>;
+    using BitNFA256 = BitNFAMatcher<char_type, 4>;
+
+    /** a fresh cursor over the cached bit-parallel tables of the pattern */
+    template<typename BitNFA>
+    std::shared_ptr<BitNFA> cached_bit_matcher(const std::string& kind)
+    {
+        auto& cache = RegexCache<char_type>::instance();
+        auto prototype = cache.template get<BitNFA>(cache.key(kind, this->m_pattern), [&]() {
+            return std::make_shared<const BitNFA>(this->m_nfa);
+        });
+        auto matcher = std::make_shared<BitNFA>(*prototype);
+        matcher->reset();
+        this->m_prototype = prototype;
+        return matcher;
+    }
+
+    /** small NFAs are simulated bit-parallel, larger ones fall back to NFAMatcher */
+    void setup_nfa_matcher()
+    {
+        this->m_nfa = RegexCache<char_type>::instance().nfa(this->m_pattern);
+        if (BitNFA64::fits(*this->m_nfa)) {
+            this->m_matcher = this->cached_bit_matcher<BitNFA64>("bit64");
+        } else if (BitNFA256::fits(*this->m_nfa)) {
+            this->m_matcher = this->cached_bit_matcher<BitNFA256>("bit256");
+        } else {
+            this->m_matcher = std::make_shared<NFAMatcher<char_type>>(this->m_nfa);
+        }
+    }
 
   public:
     SimpleRegExp() = delete;
 
+    /** automata of a pattern are compiled once per process, see RegexCache */
     template<typename Iterator>
-    SimpleRegExp(Iterator begin, Iterator end)
+    SimpleRegExp(Iterator begin, Iterator end) : m_pattern(begin, end)
     {
-        std::vector<char_type> regex(begin, end);
-        auto nfa = NodeNFA<char_type>::from_regex(regex);
-        auto rnfa = nfa.toRegexNFA();
-        auto rnfa_ptr = std::make_shared<RegexNFA<char_type>>(std::move(rnfa));
-        this->m_matcher = std::make_shared<NFAMatcher<char_type>>(rnfa_ptr);
+        this->setup_nfa_matcher();
     }
 
-    SimpleRegExp(const std::vector<char_type>& regex)
+    SimpleRegExp(const std::vector<char_type>& regex) : m_pattern(regex)
     {
-        auto nfa = NodeNFA<char_type>::from_regex(regex);
-        auto rnfa = nfa.toRegexNFA();
-        auto rnfa_ptr = std::make_shared<RegexNFA<char_type>>(std::move(rnfa));
-        this->m_matcher = std::make_shared<NFAMatcher<char_type>>(rnfa_ptr);
+        this->setup_nfa_matcher();
     }
 
     virtual void feed(char_type c) override
@@ -65,28 +103,177 @@ class SimpleRegExp : public AutomataMatcher<CharT>
     }
     void compile()
     {
-        auto nfa_matcher = std::dynamic_pointer_cast<NFAMatcher<char_type>>(m_matcher);
-        if (nfa_matcher == nullptr)
-            throw std::runtime_error("unexpected matcher type");
-
-        auto nfa = nfa_matcher->get_nfa();
-        auto dfa = std::make_shared<RegexDFA<char_type>>(nfa->compile());
+        auto dfa = RegexCache<char_type>::instance().dfa(this->m_pattern);
         this->m_matcher = std::make_shared<DFAMatcher<char_type>>(dfa);
     }
 
+    /** same as DFAMatcher::test_many() once compiled, otherwise inputs are tested one by one */
+    std::vector<bool> test_many(std::span<const std::basic_string_view<char_type>> inputs)
+    {
+        auto dfa_matcher = std::dynamic_pointer_cast<DFAMatcher<char_type>>(this->m_matcher);
+        if (dfa_matcher)
+            return dfa_matcher->test_many(inputs);
+
+        std::vector<bool> result(inputs.size());
+        for (size_t i = 0; i < inputs.size(); i++)
+            result[i] = this->test(inputs[i].begin(), inputs[i].end());
+        return result;
+    }
+
+    /** match with a DFA built on demand, its state cache is bounded by @memory_budget bytes */
+    void compile_lazy(size_t memory_budget = LazyDFAMatcher<char_type>::default_memory_budget)
+    {
+        this->m_matcher = std::make_shared<LazyDFAMatcher<char_type>>(this->m_nfa, memory_budget);
+    }
+
+    std::shared_ptr<const RegexNFA<char_type>> get_nfa() const
+    {
+        return this->m_nfa;
+    }
+
+    bool is_bit_parallel() const
+    {
+        return std::dynamic_pointer_cast<BitNFA64>(m_matcher) != nullptr ||
+               std::dynamic_pointer_cast<BitNFA256>(m_matcher) != nullptr;
+    }
+
     std::string to_string() const
     {
         auto nfa_matcher = std::dynamic_pointer_cast<NFAMatcher<char_type>>(m_matcher);
         auto dfa_matcher = std::dynamic_pointer_cast<DFAMatcher<char_type>>(m_matcher);
+        auto lazy_matcher = std::dynamic_pointer_cast<LazyDFAMatcher<char_type>>(m_matcher);
+        auto bit64_matcher = std::dynamic_pointer_cast<BitNFA64>(m_matcher);
+        auto bit256_matcher = std::dynamic_pointer_cast<BitNFA256>(m_matcher);
 
         if (nfa_matcher) {
             return nfa_matcher->to_string();
         } else if (dfa_matcher) {
             return dfa_matcher->to_string();
+        } else if (lazy_matcher) {
+            return lazy_matcher->to_string();
+        } else if (bit64_matcher) {
+            return bit64_matcher->to_string();
+        } else if (bit256_matcher) {
+            return bit256_matcher->to_string();
         } else {
             return "bad matcher";
         }
     }
 };
 
+/**
+ * several patterns compiled into one DFA. the final states of pattern i are
+ * tagged with i, so a single pass tells which patterns match the input and
+ * the longest prefix matched by any of them. a smaller index means a higher
+ * priority.
+ */
+template<typename CharT>
+class RegexSet
+{
+  public:
+    using traits = character_traits<CharT>;
+    using char_type = CharT;
+    using DFAState_t = typename RegexDFA<char_type>::DFAState_t;
+
+  private:
+    std::shared_ptr<RegexDFA<char_type>> m_dfa;
+    size_t m_size;
+
+  public:
+    RegexSet() = delete;
+    RegexSet(const std::vector<std::vector<char_type>>& patterns) : m_size(patterns.size())
+    {
+        std::vector<RegexNFA<char_type>> nfas;
+        for (auto& pattern : patterns)
+            nfas.push_back(NodeNFA<char_type>::from_regex(pattern).toRegexNFA());
+
+        auto nfa = RegexNFA<char_type>::tagged_union(nfas);
+        auto dfa = nfa.compile();
+        dfa.optimize();
+        this->m_dfa = std::make_shared<RegexDFA<char_type>>(std::move(dfa));
+    }
+    RegexSet(const std::vector<std::basic_string<char_type>>& patterns)
+        : RegexSet(to_patterns(patterns))
+    {}
+
+    static std::vector<std::vector<char_type>>
+    to_patterns(const std::vector<std::basic_string<char_type>>& patterns)
+    {
+        std::vector<std::vector<char_type>> result;
+        for (auto& p : patterns)
+            result.emplace_back(p.begin(), p.end());
+        return result;
+    }
+
+    size_t size() const
+    {
+        return this->m_size;
+    }
+    const RegexDFA<char_type>& dfa() const
+    {
+        return *this->m_dfa;
+    }
+
+    DFAState_t start_state() const
+    {
+        return this->m_dfa->start_state();
+    }
+    DFAState_t next_state(DFAState_t state, char_type c) const
+    {
+        return this->m_dfa->state_transition(state, c);
+    }
+    bool dead(DFAState_t state) const
+    {
+        return this->m_dfa->is_dead(state);
+    }
+    /** patterns accepted in @state, sorted by priority */
+    const std::vector<size_t>& matched(DFAState_t state) const
+    {
+        return this->m_dfa->accept_tags(state);
+    }
+
+    /** patterns matching the whole input */
+    template<typename Iterator>
+    std::vector<size_t> matches(Iterator begin, Iterator end) const
+    {
+        auto state = this->start_state();
+        for (auto it = begin; it != end && !this->dead(state); ++it)
+            state = this->next_state(state, *it);
+
+        return this->matched(state);
+    }
+    std::vector<size_t> matches(const std::basic_string<char_type>& str) const
+    {
+        return this->matches(str.begin(), str.end());
+    }
+
+    /** length of the longest matched prefix and the patterns matching it */
+    template<typename Iterator>
+    std::optional<std::pair<size_t, std::vector<size_t>>> longest_match(Iterator begin,
+                                                                        Iterator end) const
+    {
+        std::optional<std::pair<size_t, std::vector<size_t>>> result;
+        auto state = this->start_state();
+        size_t length = 0;
+        for (auto it = begin;; ++it) {
+            if (!this->matched(state).empty())
+                result = std::make_pair(length, this->matched(state));
+            if (it == end)
+                break;
+
+            state = this->next_state(state, *it);
+            length++;
+            if (this->dead(state))
+                break;
+        }
+
+        return result;
+    }
+    std::optional<std::pair<size_t, std::vector<size_t>>>
+    longest_match(const std::basic_string<char_type>& str) const
+    {
+        return this->longest_match(str.begin(), str.end());
+    }
+};
+
 #endif // _DC_PARSER_REGEX_INTERNAL_HPP_
@@ -0,0 +1,239 @@
+#ifndef _DC_PARSER_REGEX_SEARCH_HPP_
+#define _DC_PARSER_REGEX_SEARCH_HPP_
+
+#include "./regex_automata_dfa.hpp"
+#include "./regex_automata_nfa.hpp"
+#include "./regex_automata_node_nfa.hpp"
+#include "./regex_char.hpp"
+#include <algorithm>
+#include <assert.h>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+/** first position in [begin, end) holding one of the @nneedles bytes, or @end */
+inline const char*
+scan_bytes(const char* begin, const char* end, const char* needles, size_t nneedles)
+{
+    assert(nneedles > 0 && nneedles <= 3);
+    if (nneedles == 1) {
+        auto p = std::memchr(begin, needles[0], end - begin);
+        return p == nullptr ? end : static_cast<const char*>(p);
+    }
+
+#if defined(__SSE2__)
+    const auto n0 = _mm_set1_epi8(needles[0]);
+    const auto n1 = _mm_set1_epi8(needles[1]);
+    const auto n2 = _mm_set1_epi8(needles[nneedles - 1]);
+    for (; end - begin >= 16; begin += 16) {
+        const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        const auto eq01 = _mm_or_si128(_mm_cmpeq_epi8(block, n0), _mm_cmpeq_epi8(block, n1));
+        const auto eq = _mm_or_si128(eq01, _mm_cmpeq_epi8(block, n2));
+        const auto mask = _mm_movemask_epi8(eq);
+        if (mask != 0)
+            return begin + __builtin_ctz(mask);
+    }
+#endif
+
+    for (; begin != end; ++begin) {
+        if (std::find(needles, needles + nneedles, *begin) != needles + nneedles)
+            return begin;
+    }
+    return end;
+}
+
+/**
+ * unanchored leftmost-longest search with a DFA. before running the DFA at a
+ * position, candidates are skipped to the literal prefix every match starts
+ * with, or to a character that can start a match. for char buffers the skip
+ * uses memchr, and SSE2 when few bytes can start a match.
+ */
+template<typename CharT>
+class RegexSearcher
+{
+  public:
+    using traits = character_traits<CharT>;
+    using char_type = CharT;
+    using DFAState_t = typename RegexDFA<char_type>::DFAState_t;
+    /** [begin, end) offsets of a match */
+    using match_t = std::pair<size_t, size_t>;
+
+  private:
+    std::shared_ptr<RegexDFA<char_type>> m_dfa;
+    std::vector<char_type> m_prefix;
+    std::vector<char_type> m_first_chars;
+    bool m_any_start;
+
+    static constexpr size_t max_first_chars = 3;
+
+    bool can_start(char_type c) const
+    {
+        return !m_dfa->is_dead(m_dfa->state_transition(m_dfa->start_state(), c));
+    }
+
+    /** literal prefix and the set of starting characters, read off the minimized DFA */
+    void setup()
+    {
+        auto& dfa = *this->m_dfa;
+        this->m_any_start = dfa.is_final(dfa.start_state());
+        if (this->m_any_start)
+            return;
+
+        auto state = dfa.start_state();
+        for (size_t i = 0; i < dfa.state_count() && !dfa.is_final(state); i++) {
+            const typename RegexDFA<char_type>::DFAEntry* only = nullptr;
+            size_t alive = 0;
+            for (auto& entry : dfa.transitions()[state]) {
+                if (!dfa.is_dead(entry.state)) {
+                    alive++;
+                    only = &entry;
+                }
+            }
+            if (alive != 1 || only->low != only->high)
+                break;
+
+            this->m_prefix.push_back(only->low);
+            state = only->state;
+        }
+
+        size_t nfirst = 0;
+        for (auto& entry : dfa.transitions()[dfa.start_state()]) {
+            if (!dfa.is_dead(entry.state))
+                nfirst += static_cast<size_t>(entry.high) - static_cast<size_t>(entry.low) + 1;
+        }
+        if (nfirst <= max_first_chars) {
+            for (auto& entry : dfa.transitions()[dfa.start_state()]) {
+                if (dfa.is_dead(entry.state))
+                    continue;
+                for (auto c = entry.low; c <= entry.high; c++) {
+                    this->m_first_chars.push_back(c);
+                    if (c == entry.high)
+                        break;
+                }
+            }
+        }
+    }
+
+    const char_type* next_candidate(const char_type* p, const char_type* end) const
+    {
+        if (this->m_any_start)
+            return p;
+
+        if constexpr (std::is_same<char_type, char>::value) {
+            if (!this->m_prefix.empty()) {
+                const auto plen = this->m_prefix.size();
+                for (;; ++p) {
+                    p = scan_bytes(p, end, this->m_prefix.data(), 1);
+                    if (static_cast<size_t>(end - p) < plen)
+                        return end;
+                    if (std::equal(this->m_prefix.begin(), this->m_prefix.end(), p))
+                        return p;
+                }
+            }
+            if (!this->m_first_chars.empty())
+                return scan_bytes(p, end, this->m_first_chars.data(), this->m_first_chars.size());
+        }
+
+        if (!this->m_prefix.empty())
+            return std::search(p, end, this->m_prefix.begin(), this->m_prefix.end());
+
+        while (p != end && !this->can_start(*p))
+            ++p;
+        return p;
+    }
+
+    /** end of the longest match starting at @p */
+    std::optional<const char_type*> longest_at(const char_type* p, const char_type* end) const
+    {
+        auto& dfa = *this->m_dfa;
+        auto state = dfa.start_state();
+        std::optional<const char_type*> last;
+        if (dfa.is_final(state))
+            last = p;
+
+        for (; p != end; ++p) {
+            state = dfa.state_transition(state, *p);
+            if (dfa.is_dead(state))
+                break;
+            if (dfa.is_final(state))
+                last = p + 1;
+        }
+
+        return last;
+    }
+
+  public:
+    RegexSearcher() = delete;
+    RegexSearcher(std::shared_ptr<RegexDFA<char_type>> dfa) : m_dfa(dfa)
+    {
+        if (this->m_dfa == nullptr)
+            throw std::runtime_error("DFA is null");
+
+        this->setup();
+    }
+    RegexSearcher(const std::vector<char_type>& pattern)
+    {
+        auto nfa = NodeNFA<char_type>::from_regex(pattern);
+        auto dfa = nfa.toRegexNFA().compile();
+        dfa.optimize();
+        this->m_dfa = std::make_shared<RegexDFA<char_type>>(std::move(dfa));
+        this->setup();
+    }
+
+    const std::vector<char_type>& literal_prefix() const
+    {
+        return this->m_prefix;
+    }
+
+    /** leftmost-longest match in [begin + from, end), offsets are relative to @begin */
+    std::optional<match_t>
+    find(const char_type* begin, const char_type* end, size_t from = 0) const
+    {
+        for (auto p = begin + from;; ++p) {
+            p = this->next_candidate(p, end);
+            if (p == end && !this->m_any_start)
+                return std::nullopt;
+
+            auto last = this->longest_at(p, end);
+            if (last.has_value())
+                return std::make_pair(size_t(p - begin), size_t(last.value() - begin));
+            if (p == end)
+                return std::nullopt;
+        }
+    }
+
+    /** non-overlapping leftmost-longest matches, an empty match advances by one character */
+    std::vector<match_t> find_all(const char_type* begin, const char_type* end) const
+    {
+        std::vector<match_t> result;
+        for (size_t from = 0; from <= size_t(end - begin);) {
+            auto m = this->find(begin, end, from);
+            if (!m.has_value())
+                break;
+
+            result.push_back(m.value());
+            from = m->second > m->first ? m->second : m->second + 1;
+        }
+
+        return result;
+    }
+
+    std::optional<match_t> find(const std::basic_string<char_type>& str, size_t from = 0) const
+    {
+        return this->find(str.data(), str.data() + str.size(), from);
+    }
+    std::vector<match_t> find_all(const std::basic_string<char_type>& str) const
+    {
+        return this->find_all(str.data(), str.data() + str.size());
+    }
+};
+
+#endif // _DC_PARSER_REGEX_SEARCH_HPP_
@@ -0,0 +1,48 @@
+#ifndef _DC_PARSER_REGEX_STATE_SET_H_
+#define _DC_PARSER_REGEX_STATE_SET_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+
+/**
+ * hash-consed sets of NFA states, each a sorted list in one pool. every
+ * distinct set gets a dense index in insertion order. lookups probe an
+ * open-addressing table with the 64-bit hash computed once per stored
+ * set, and only compare states when the hashes agree.
+ */
+class StateSetTable
+{
+  public:
+    using state_t = uint32_t;
+
+  private:
+    // set i is m_states[m_offsets[i], m_offsets[i + 1])
+    std::vector<state_t> m_states;
+    std::vector<size_t> m_offsets;
+    std::vector<uint64_t> m_hashes;
+    // index + 1 of the set in each slot, 0 for an empty slot
+    std::vector<uint32_t> m_slots;
+
+    size_t find_slot(std::span<const state_t> set, uint64_t hash) const;
+    void grow();
+
+  public:
+    StateSetTable();
+
+    static uint64_t hash(std::span<const state_t> set);
+
+    size_t size() const;
+    /** invalidated by insert() */
+    std::span<const state_t> operator[](size_t index) const;
+
+    /** index of the sorted @set and whether it's new, a new set is copied into the table */
+    std::pair<size_t, bool> insert(std::span<const state_t> set);
+    /** same as above with @hash precomputed by hash() */
+    std::pair<size_t, bool> insert(std::span<const state_t> set, uint64_t hash);
+};
+
+#endif // _DC_PARSER_REGEX_STATE_SET_H_
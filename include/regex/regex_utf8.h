@@ -9,16 +9,29 @@
 #include <vector>
 
 
+/**
+ * lower a DFA over code points into an equivalent DFA over UTF-8 bytes.
+ * bytes are fed as int values in [0, 255], a malformed sequence leads to
+ * the dead state. the result is minimized.
+ */
+RegexDFA<int> utf8_byte_dfa(const RegexDFA<int>& dfa);
+
 class RegExpUTF8 : public SimpleRegExp<int>
 {
   private:
     UTF8Decoder m_decoder;
+    std::shared_ptr<RegexDFA<int>> m_byte_dfa;
+    RegexDFA<int>::DFAState_t m_byte_state;
 
   public:
     RegExpUTF8(const std::string& pattern);
 
     virtual void feed(char c);
     virtual void feed(int c) override;
+    void feed(const char* begin, const char* end);
+    virtual bool match() const override;
+    virtual bool dead() const override;
+    virtual void reset() override;
 
     template<
         typename Iterator,
@@ -35,7 +48,12 @@ class RegExpUTF8 : public SimpleRegExp<int>
 
     bool test(const std::string& str);
 
+    /** match raw UTF-8 bytes without decoding them into code points */
+    void compile_bytes();
+    bool byte_mode() const;
+
     static RegExpUTF8 compiled(const std::string& pattern);
+    static RegExpUTF8 compiled_bytes(const std::string& pattern);
 };
 
 #endif // _DC_PARSER_REGEX_UTF8_HPP_
@@ -0,0 +1,128 @@
+#ifndef _DC_PARSER_WORKER_POOL_HPP_
+#define _DC_PARSER_WORKER_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+/**
+ * threads started once and handed one indexed job after another. the
+ * calling thread of run() works on the job as well, so a pool of n threads
+ * starts n - 1 of them.
+ */
+class WorkerPool
+{
+  private:
+    std::mutex m_mutex;
+    std::condition_variable m_work, m_done;
+    std::vector<std::thread> m_threads;
+    // the job of the current run(), indices up to m_count are taken from m_next
+    const std::function<void(size_t)>* m_job = nullptr;
+    size_t m_count = 0;
+    std::atomic<size_t> m_next = 0;
+    // bumped by every run(), workers wait for a generation they haven't seen
+    size_t m_generation = 0;
+    size_t m_busy = 0;
+    bool m_stop = false;
+    std::exception_ptr m_error;
+
+    void work()
+    {
+        try {
+            for (size_t i = this->m_next++; i < this->m_count; i = this->m_next++)
+                (*this->m_job)(i);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            if (!this->m_error)
+                this->m_error = std::current_exception();
+            // the indices left are skipped
+            this->m_next = this->m_count;
+        }
+    }
+
+    void loop()
+    {
+        size_t seen = 0;
+        std::unique_lock<std::mutex> lock(this->m_mutex);
+        for (;;) {
+            this->m_work.wait(lock,
+                              [&]() { return this->m_stop || this->m_generation != seen; });
+            if (this->m_stop)
+                return;
+
+            seen = this->m_generation;
+            lock.unlock();
+            this->work();
+            lock.lock();
+            if (--this->m_busy == 0)
+                this->m_done.notify_one();
+        }
+    }
+
+  public:
+    explicit WorkerPool(size_t threads)
+    {
+        for (size_t t = 1; t < threads; t++)
+            this->m_threads.emplace_back([this]() { this->loop(); });
+    }
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            this->m_stop = true;
+        }
+        this->m_work.notify_all();
+        for (auto& thread : this->m_threads)
+            thread.join();
+    }
+
+    /** threads working on a job, the caller of run() included */
+    size_t size() const
+    {
+        return this->m_threads.size() + 1;
+    }
+
+    /**
+     * call @job(i) for every i < @count across the pool. the first exception
+     * @job throws is rethrown once every thread is done, the rest of the
+     * indices may be skipped.
+     */
+    template<typename Job>
+    void run(size_t count, Job&& job)
+    {
+        if (this->m_threads.empty()) {
+            for (size_t i = 0; i < count; i++)
+                job(i);
+            return;
+        }
+
+        const std::function<void(size_t)> fn(std::ref(job));
+        {
+            std::lock_guard<std::mutex> lock(this->m_mutex);
+            this->m_job = &fn;
+            this->m_count = count;
+            this->m_next = 0;
+            this->m_busy = this->m_threads.size();
+            this->m_generation++;
+        }
+        this->m_work.notify_all();
+        this->work();
+
+        std::unique_lock<std::mutex> lock(this->m_mutex);
+        this->m_done.wait(lock, [&]() { return this->m_busy == 0; });
+        this->m_job = nullptr;
+        if (this->m_error)
+            std::rethrow_exception(std::exchange(this->m_error, nullptr));
+    }
+};
+
+#endif // _DC_PARSER_WORKER_POOL_HPP_
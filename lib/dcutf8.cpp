@@ -1,5 +1,8 @@
 #include "dcutf8.h"
 #include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 using namespace std;
 
 
@@ -36,34 +39,29 @@ constexpr int utf8_bound[4][2] = {
     {0x10000, 0x10ffff},
 };
 
-UTF8CodePoint UTF8Decoder::decode(char cc)
+// bytes following the lead byte @c in a sequence
+static int continuation_count(unsigned char c)
 {
-    this->m_buffer.push_back(cc);
-    auto& str = this->m_buffer;
+    if ((c & 0b10000000) == 0)
+        return 0;
+    else if ((c & 0b11111000) == 0b11110000)
+        return 3;
+    else if ((c & 0b11110000) == 0b11100000)
+        return 2;
+    else if ((c & 0b11100000) == 0b11000000)
+        return 1;
 
-    unsigned char c = str[0];
-    int val, len = 0;
-    if ((c & 0b10000000) == 0) {
-        len = 0;
-        val = c;
-    } else if ((c & 0b11111000) == 0b11110000) {
-        len = 3;
-        val = (c & 0b00000111) << 18;
-    } else if ((c & 0b11110000) == 0b11100000) {
-        len = 2;
-        val = (c & 0b00001111) << 12;
-    } else if ((c & 0b11100000) == 0b11000000) {
-        len = 1;
-        val = (c & 0b00011111) << 6;
-    } else {
-        throw runtime_error("Invalid UTF-8 sequence");
-    }
-
-    if (len >= str.size())
-        return UTF8CodePoint();
+    throw runtime_error("Invalid UTF-8 sequence");
+}
 
+// code point of the sequence at @str with @len continuation bytes
+static int decode_sequence(const unsigned char* str, int len)
+{
+    static constexpr unsigned char lead_mask[4] = {
+        0b01111111, 0b00011111, 0b00001111, 0b00000111};
+    int val = (str[0] & lead_mask[len]) << (6 * len);
     for (int j = 0; j < len; ++j) {
-        c = str[1 + j];
+        const unsigned char c = str[1 + j];
         if ((c & 0b11000000) != 0b10000000)
             throw runtime_error("Invalid UTF-8 sequence");
 
@@ -75,19 +73,85 @@ UTF8CodePoint UTF8Decoder::decode(char cc)
 
     if (val < lb || val > ub)
         throw runtime_error("Invalid UTF-8 sequence: unexpected codepoint");
+    if (val >= 0xD800 && val <= 0xDFFF)
+        throw runtime_error("Invalid UTF-8 sequence: surrogate codepoint");
+
+    return val;
+}
+
+// widen the ascii bytes at the start of @str, @return how many
+static size_t decode_ascii(const char* str, size_t size, int* out)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    const auto zero = _mm_setzero_si128();
+    for (; i + 16 <= size; i += 16) {
+        const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(str + i));
+        if (_mm_movemask_epi8(block) != 0)
+            break;
 
+        const auto lo = _mm_unpacklo_epi8(block, zero);
+        const auto hi = _mm_unpackhi_epi8(block, zero);
+        auto dst = reinterpret_cast<__m128i*>(out + i);
+        _mm_storeu_si128(dst, _mm_unpacklo_epi16(lo, zero));
+        _mm_storeu_si128(dst + 1, _mm_unpackhi_epi16(lo, zero));
+        _mm_storeu_si128(dst + 2, _mm_unpacklo_epi16(hi, zero));
+        _mm_storeu_si128(dst + 3, _mm_unpackhi_epi16(hi, zero));
+    }
+#endif
+    for (; i < size && (str[i] & 0x80) == 0; i++)
+        out[i] = str[i];
+    return i;
+}
+
+UTF8CodePoint UTF8Decoder::decode(char cc)
+{
+    this->m_buffer.push_back(cc);
+    auto& str = this->m_buffer;
+
+    const size_t len = continuation_count(str[0]);
+    if (len >= str.size())
+        return UTF8CodePoint();
+
+    const auto val = decode_sequence(reinterpret_cast<const unsigned char*>(str.data()), len);
     this->m_buffer.clear();
     return UTF8CodePoint(val);
 }
 
-vector<int> UTF8Decoder::strdecode(const string& str)
+size_t UTF8Decoder::decode(span<const char> text, int* out)
 {
-    UTF8Decoder decoder;
-    vector<int> result;
-    for (auto c : str) {
-        auto cp = decoder.decode(c);
+    const size_t size = text.size();
+    size_t i = 0, n = 0;
+    for (; i < size && !this->m_buffer.empty(); i++) {
+        auto cp = this->decode(text[i]);
         if (cp.presented())
-            result.push_back(cp.getval());
+            out[n++] = cp.getval();
     }
+
+    const auto str = reinterpret_cast<const unsigned char*>(text.data());
+    while (i < size) {
+        if (str[i] < 0x80) {
+            const auto count = decode_ascii(text.data() + i, size - i, out + n);
+            i += count;
+            n += count;
+            continue;
+        }
+
+        const size_t len = continuation_count(str[i]);
+        if (i + len >= size) {
+            this->m_buffer.assign(text.begin() + i, text.end());
+            break;
+        }
+        out[n++] = decode_sequence(str + i, len);
+        i += len + 1;
+    }
+    return n;
+}
+
+vector<int> UTF8Decoder::strdecode(const string& str)
+{
+    UTF8Decoder decoder;
+    vector<int> result(str.size());
+    result.resize(decoder.decode(span<const char>(str), result.data()));
     return result;
 }
@@ -1,5 +1,11 @@
 #include "lexer/text_info.h"
 #include "assert.h"
+#include "lexer/lexer_error.h"
+#include "regex/mapped_file.h"
+#include <algorithm>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 using namespace std;
 using PInfo = TextInfo::PInfo;
 using LineRange = TextInfo::LineRange;
@@ -69,6 +75,17 @@ void TextRangeEntity::benowhere()
     this->m_range = nullopt;
 }
 
+void TextRangeEntity::shift(ptrdiff_t offset)
+{
+    if (!this->m_range.has_value())
+        return;
+
+    auto& range = this->m_range.value();
+    assert(offset >= 0 || range.first >= size_t(-offset));
+    range.first += offset;
+    range.second += offset;
+}
+
 string TextInfo::row_col_str(size_t pos) const
 {
     auto px = this->query(pos);
@@ -121,3 +138,89 @@ vector<LineRange> TextInfo::lines(size_t beg_pos, size_t end_pos) const
 
     return ret;
 }
+
+BufferTextInfo::BufferTextInfo(string_view text, string filename)
+    : m_filename(std::move(filename)), m_text(text)
+{}
+
+shared_ptr<BufferTextInfo> BufferTextInfo::map_file(const string& path)
+{
+    auto file = MappedFile::open(path);
+    if (file == nullptr)
+        return nullptr;
+
+    auto info = make_shared<BufferTextInfo>(string_view(file->data(), file->size()), path);
+    info->m_file = std::move(file);
+    return info;
+}
+
+string_view BufferTextInfo::text() const
+{
+    return this->m_text;
+}
+
+const vector<size_t>& BufferTextInfo::line_starts() const
+{
+    call_once(this->m_lines_once, [this]() {
+        auto& lines = this->m_lines;
+        const char* data = this->m_text.data();
+        const size_t size = this->m_text.size();
+        size_t i = 0;
+        lines.push_back(0);
+#if defined(__SSE2__)
+        const auto newline = _mm_set1_epi8('\n');
+        for (; i + 16 <= size; i += 16) {
+            const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            for (unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)); mask != 0;
+                 mask &= mask - 1) {
+                lines.push_back(i + __builtin_ctz(mask) + 1);
+            }
+        }
+#endif
+        for (; i < size; i++) {
+            if (data[i] == '\n')
+                lines.push_back(i + 1);
+        }
+    });
+    return this->m_lines;
+}
+
+const string& BufferTextInfo::filename() const
+{
+    return this->m_filename;
+}
+
+size_t BufferTextInfo::len() const
+{
+    return this->m_text.size();
+}
+
+PInfo BufferTextInfo::query(size_t pos) const
+{
+    if (pos >= this->m_text.size())
+        throw LexerError("query position out of range");
+
+    auto& lines = this->line_starts();
+    auto up = upper_bound(lines.begin(), lines.end(), pos);
+    assert(up != lines.begin());
+    const size_t line = distance(lines.begin(), up);
+    return PInfo{.line = line, .column = pos - *(up - 1) + 1};
+}
+
+pair<size_t, size_t> BufferTextInfo::line_range(size_t line) const
+{
+    auto& lines = this->line_starts();
+    if (line == 0 || line > lines.size())
+        throw LexerError("query line out of range");
+
+    const auto end = line < lines.size() ? lines[line] : this->m_text.size();
+    return make_pair(lines[line - 1], end);
+}
+
+string BufferTextInfo::query_string(size_t from, size_t to) const
+{
+    if (from > to || to > this->m_text.size())
+        throw LexerError("query string out of range");
+
+    return string(this->m_text.substr(from, to - from));
+}
@@ -20,7 +20,17 @@ size_t DChar::charid() const
 }
 
 
-LexerToken::LexerToken()
+LexerToken::LexerToken() : m_extent(0)
 {}
-LexerToken::LexerToken(TextRange range) : DChar(range)
+LexerToken::LexerToken(TextRange range) : DChar(range), m_extent(0)
 {}
+
+size_t LexerToken::extent() const
+{
+    return this->m_extent;
+}
+
+void LexerToken::set_extent(size_t bytes)
+{
+    this->m_extent = bytes;
+}
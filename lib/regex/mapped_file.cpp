@@ -0,0 +1,77 @@
+#include "regex/mapped_file.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+
+MappedFile::MappedFile(const char* data, size_t size) : m_data(data), m_size(size)
+{}
+
+MappedFile::~MappedFile()
+{
+    if (this->m_size > 0)
+        munmap(const_cast<char*>(this->m_data), this->m_size);
+}
+
+shared_ptr<MappedFile> MappedFile::open(const string& path)
+{
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    const size_t size = st.st_size;
+    if (size == 0) {
+        close(fd);
+        return shared_ptr<MappedFile>(new MappedFile("", 0));
+    }
+
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED)
+        return nullptr;
+
+    return shared_ptr<MappedFile>(new MappedFile(static_cast<const char*>(addr), size));
+}
+
+const char* MappedFile::data() const
+{
+    return this->m_data;
+}
+
+size_t MappedFile::size() const
+{
+    return this->m_size;
+}
+
+bool write_file_atomic(const string& path, const string& content)
+{
+    const auto tmp = path + ".tmp." + to_string(getpid());
+    {
+        ofstream out(tmp, ios::binary | ios::trunc);
+        if (!out)
+            return false;
+
+        out.write(content.data(), content.size());
+        if (!out) {
+            out.close();
+            remove(tmp.c_str());
+            return false;
+        }
+    }
+
+    if (rename(tmp.c_str(), path.c_str()) != 0) {
+        remove(tmp.c_str());
+        return false;
+    }
+    return true;
+}
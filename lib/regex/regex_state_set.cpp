@@ -0,0 +1,89 @@
+#include "regex/regex_state_set.h"
+#include <algorithm>
+#include <assert.h>
+#include <limits>
+#include <stdexcept>
+using namespace std;
+
+
+StateSetTable::StateSetTable() : m_offsets(1, 0), m_slots(16, 0)
+{}
+
+uint64_t StateSetTable::hash(span<const state_t> set)
+{
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ set.size();
+    for (auto s : set) {
+        h = (h ^ s) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+size_t StateSetTable::find_slot(span<const state_t> set, uint64_t hash) const
+{
+    const auto mask = this->m_slots.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        const auto entry = this->m_slots[slot];
+        if (entry == 0)
+            return slot;
+
+        const auto index = entry - 1;
+        if (this->m_hashes[index] == hash) {
+            auto stored = (*this)[index];
+            if (std::equal(set.begin(), set.end(), stored.begin(), stored.end()))
+                return slot;
+        }
+    }
+}
+
+void StateSetTable::grow()
+{
+    vector<uint32_t> slots(this->m_slots.size() * 2, 0);
+    const auto mask = slots.size() - 1;
+    for (size_t index = 0; index < this->m_hashes.size(); index++) {
+        auto slot = this->m_hashes[index] & mask;
+        while (slots[slot] != 0)
+            slot = (slot + 1) & mask;
+        slots[slot] = index + 1;
+    }
+    this->m_slots = std::move(slots);
+}
+
+size_t StateSetTable::size() const
+{
+    return this->m_hashes.size();
+}
+
+span<const StateSetTable::state_t> StateSetTable::operator[](size_t index) const
+{
+    assert(index < this->size());
+    return span<const state_t>(this->m_states.data() + this->m_offsets[index],
+                               this->m_offsets[index + 1] - this->m_offsets[index]);
+}
+
+pair<size_t, bool> StateSetTable::insert(span<const state_t> set)
+{
+    return this->insert(set, hash(set));
+}
+
+pair<size_t, bool> StateSetTable::insert(span<const state_t> set, uint64_t h)
+{
+    assert(h == hash(set));
+    assert(std::is_sorted(set.begin(), set.end()));
+    auto slot = this->find_slot(set, h);
+    if (this->m_slots[slot] != 0)
+        return make_pair(size_t(this->m_slots[slot] - 1), false);
+
+    const auto index = this->size();
+    if (index >= numeric_limits<uint32_t>::max())
+        throw runtime_error("too many state sets");
+
+    this->m_states.insert(this->m_states.end(), set.begin(), set.end());
+    this->m_offsets.push_back(this->m_states.size());
+    this->m_hashes.push_back(h);
+    this->m_slots[slot] = index + 1;
+    // keep the load factor at most one half
+    if (2 * this->size() > this->m_slots.size())
+        this->grow();
+    return make_pair(index, true);
+}
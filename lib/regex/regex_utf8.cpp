@@ -1,15 +1,147 @@
+#include <algorithm>
 #include <assert.h>
+#include <iterator>
 #include <regex/regex.hpp>
 #include <regex/regex_utf8.h>
+#include <span>
 #include <stdexcept>
 using namespace std;
 
+using ByteRange = pair<int, int>;
+using ByteSequence = vector<ByteRange>;
 
-RegExpUTF8::RegExpUTF8(const string& pattern) : SimpleRegExp<int>(UTF8Decoder::strdecode(pattern))
+static constexpr uint32_t max_code_point = 0x10ffff;
+
+/**
+ * split [lo, hi] into byte range sequences each matching a set of code points
+ * of the same encoded length. when a range of a sequence spans more than one
+ * byte, all its following ranges are full continuation ranges, so sibling
+ * ranges of sequences sharing a prefix are either equal or disjoint.
+ */
+static void utf8_sequences(uint32_t lo, uint32_t hi, vector<ByteSequence>& out)
+{
+    static constexpr uint32_t max_of_length[] = {0x7f, 0x7ff, 0xffff};
+    for (auto m : max_of_length) {
+        if (lo <= m && m < hi) {
+            utf8_sequences(lo, m, out);
+            utf8_sequences(m + 1, hi, out);
+            return;
+        }
+    }
+
+    if (hi < 0x80) {
+        out.push_back({make_pair((int) lo, (int) hi)});
+        return;
+    }
+
+    for (size_t i = 1; i < 4; i++) {
+        const uint32_t m = (1u << (6 * i)) - 1;
+        if ((lo & ~m) == (hi & ~m))
+            continue;
+
+        if ((lo & m) != 0) {
+            utf8_sequences(lo, lo | m, out);
+            utf8_sequences((lo | m) + 1, hi, out);
+            return;
+        }
+        if ((hi & m) != m) {
+            utf8_sequences(lo, (hi & ~m) - 1, out);
+            utf8_sequences(hi & ~m, hi, out);
+            return;
+        }
+    }
+
+    UTF8Encoder encoder;
+    auto a = encoder.encode(lo), b = encoder.encode(hi);
+    assert(a.size() == b.size());
+    ByteSequence seq;
+    for (size_t k = 0; k < a.size(); k++)
+        seq.push_back(make_pair((unsigned char) a[k], (unsigned char) b[k]));
+    out.push_back(std::move(seq));
+}
+
+RegexDFA<int> utf8_byte_dfa(const RegexDFA<int>& dfa)
+{
+    using traits = character_traits<int>;
+    using DFAState_t = RegexDFA<int>::DFAState_t;
+    struct Edge
+    {
+        int low, high;
+        DFAState_t state;
+    };
+
+    // states of @dfa keep their numbers, partial sequences get new states after them
+    const auto nstates = dfa.state_count();
+    vector<vector<Edge>> edges(nstates);
+    for (size_t s = 0; s < nstates; s++) {
+        for (auto& entry : dfa.transitions()[s]) {
+            if (entry.high < 0 || entry.low > (int) max_code_point)
+                continue;
+
+            vector<ByteSequence> sequences;
+            utf8_sequences(max(entry.low, 0), min(entry.high, (int) max_code_point), sequences);
+            for (auto& seq : sequences) {
+                DFAState_t node = s;
+                for (size_t d = 0; d < seq.size(); d++) {
+                    auto& out = edges[node];
+                    if (d + 1 == seq.size()) {
+                        out.push_back({seq[d].first, seq[d].second, entry.state});
+                        break;
+                    }
+
+                    auto it = find_if(out.begin(), out.end(), [&](const Edge& e) {
+                        return e.low == seq[d].first && e.high == seq[d].second;
+                    });
+                    if (it != out.end()) {
+                        node = it->state;
+                    } else {
+                        const auto next = edges.size();
+                        out.push_back({seq[d].first, seq[d].second, next});
+                        edges.emplace_back();
+                        node = next;
+                    }
+                }
+            }
+        }
+    }
+
+    const DFAState_t dead_state = edges.size();
+    RegexDFA<int>::DFATransitionTable table(edges.size() + 1);
+    table[dead_state].emplace_back(traits::MIN, traits::MAX, dead_state);
+    for (size_t s = 0; s < edges.size(); s++) {
+        auto& out = edges[s];
+        sort(out.begin(), out.end(), [](const Edge& a, const Edge& b) { return a.low < b.low; });
+
+        auto& row = table[s];
+        int next_low = traits::MIN;
+        for (auto& e : out) {
+            assert(next_low <= e.low && "overlapping UTF-8 byte ranges");
+            if (next_low < e.low)
+                row.emplace_back(next_low, e.low - 1, dead_state);
+            row.emplace_back(e.low, e.high, e.state);
+            next_low = e.high + 1;
+        }
+        row.emplace_back(next_low, traits::MAX, dead_state);
+    }
+
+    RegexDFA<int> result(std::move(table), dfa.start_state(), {dead_state}, dfa.final_states());
+    result.optimize();
+    return result;
+}
+
+RegExpUTF8::RegExpUTF8(const string& pattern)
+    : SimpleRegExp<int>(UTF8Decoder::strdecode(pattern)), m_byte_state(0)
 {}
 
 void RegExpUTF8::feed(char c)
 {
+    if (this->m_byte_dfa) {
+        if (!this->m_byte_dfa->is_dead(this->m_byte_state))
+            this->m_byte_state = this->m_byte_dfa->state_transition(this->m_byte_state,
+                                                                    (unsigned char) c);
+        return;
+    }
+
     auto cp = this->m_decoder.decode(c);
     if (cp.presented())
         this->feed(cp.getval());
@@ -18,12 +150,80 @@ void RegExpUTF8::feed(char c)
 void RegExpUTF8::feed(int c)
 {
     assert(this->m_decoder.buflen() == 0);
+    if (this->m_byte_dfa) {
+        for (auto b : UTF8Encoder().encode(c))
+            this->feed(b);
+        return;
+    }
+
     SimpleRegExp<int>::feed(c);
 }
 
+void RegExpUTF8::feed(const char* begin, const char* end)
+{
+    if (!this->m_byte_dfa) {
+        int chars[1 << 10];
+        while (begin != end) {
+            const auto len = min<size_t>(size(chars), end - begin);
+            const auto n = this->m_decoder.decode(span<const char>(begin, len), chars);
+            for (size_t i = 0; i < n; i++)
+                SimpleRegExp<int>::feed(chars[i]);
+            begin += len;
+        }
+        return;
+    }
+
+    auto& dfa = *this->m_byte_dfa;
+    auto state = this->m_byte_state;
+    for (; begin != end && !dfa.is_dead(state); ++begin)
+        state = dfa.state_transition(state, (unsigned char) *begin);
+    this->m_byte_state = state;
+}
+
+bool RegExpUTF8::match() const
+{
+    if (this->m_byte_dfa)
+        return this->m_byte_dfa->is_final(this->m_byte_state);
+
+    return SimpleRegExp<int>::match();
+}
+
+bool RegExpUTF8::dead() const
+{
+    if (this->m_byte_dfa)
+        return this->m_byte_dfa->is_dead(this->m_byte_state);
+
+    return SimpleRegExp<int>::dead();
+}
+
+void RegExpUTF8::reset()
+{
+    if (this->m_byte_dfa) {
+        this->m_byte_state = this->m_byte_dfa->start_state();
+        return;
+    }
+
+    SimpleRegExp<int>::reset();
+}
+
 bool RegExpUTF8::test(const std::string& str)
 {
-    return this->test(str.begin(), str.end());
+    this->reset();
+    this->feed(str.data(), str.data() + str.size());
+    return this->match();
+}
+
+void RegExpUTF8::compile_bytes()
+{
+    auto dfa = this->get_nfa()->compile();
+    dfa.optimize();
+    this->m_byte_dfa = std::make_shared<RegexDFA<int>>(utf8_byte_dfa(dfa));
+    this->reset();
+}
+
+bool RegExpUTF8::byte_mode() const
+{
+    return this->m_byte_dfa != nullptr;
 }
 
 RegExpUTF8 RegExpUTF8::compiled(const string& pattern)
@@ -32,3 +232,10 @@ RegExpUTF8 RegExpUTF8::compiled(const string& pattern)
     reg.compile();
     return reg;
 }
+
+RegExpUTF8 RegExpUTF8::compiled_bytes(const string& pattern)
+{
+    auto reg = RegExpUTF8(pattern);
+    reg.compile_bytes();
+    return reg;
+}
@@ -1,9 +1,18 @@
+#include "lexer/incremental_lexer.hpp"
+#include "lexer/input_window.hpp"
 #include "lexer/lexer.hpp"
 #include "lexer/lexer_rule_cstring_literal.hpp"
 #include "lexer/lexer_rule_regex.hpp"
+#include "lexer/parallel_lexer.hpp"
 #include "lexer/simple_lexer.hpp"
+#include "lexer/text_info.h"
+#include "lexer/token_arena.hpp"
 #include "lexer/token.h"
+#include "regex/mapped_file.h"
 #include <gtest/gtest.h>
+#include <random>
+#include <span>
+#include <thread>
 #include <tuple>
 #include <vector>
 using namespace std;
@@ -39,13 +48,27 @@ class TokenStringLiteral : public LexerToken
     {}
 };
 
+class TokenNumber : public LexerToken
+{
+  public:
+    TokenNumber(TextRange info) : LexerToken(info)
+    {}
+};
+
+class TokenPunc : public LexerToken
+{
+  public:
+    TokenPunc(TextRange info) : LexerToken(info)
+    {}
+};
+
 
 class LexerTest : public ::testing::Test
 {
   protected:
     Lexer<char> lexer;
 
-    void SetUp() override
+    static void add_rules(Lexer<char>& lexer)
     {
         lexer(
             std::make_unique<LexerRuleRegex<char>>("/\\*(!.*\\*/.*)\\*/", [](auto str, auto info) {
@@ -76,6 +99,11 @@ class LexerTest : public ::testing::Test
         lexer(std::make_unique<LexerRuleRegex<char>>("( |\t|\r|\n)+",
                                                      [](auto str, auto info) { return nullptr; }));
     }
+
+    void SetUp() override
+    {
+        add_rules(lexer);
+    }
 };
 
 
@@ -171,3 +199,599 @@ TEST_F(LexerTest, SimpleLexer)
 
     EXPECT_THROW(slexer.next(), LexerError);
 }
+
+TEST_F(LexerTest, CombinedRules)
+{
+    Lexer<char> combined;
+    add_rules(combined);
+    combined.combine_rules();
+    combined.reset();
+
+    const string str = "if /*hello world   fi if ll*/ fi iff if_\n  if \"hello \\\"world\"";
+    auto expected = lexer.feed_char(str);
+    auto tail = lexer.feed_end();
+    expected.insert(expected.end(), tail.begin(), tail.end());
+
+    auto tokens = combined.feed_char(str);
+    tail = combined.feed_end();
+    tokens.insert(tokens.end(), tail.begin(), tail.end());
+
+    ASSERT_EQ(tokens.size(), expected.size());
+    ASSERT_EQ(tokens.size(), 7);
+    for (size_t i = 0; i < tokens.size(); i++) {
+        EXPECT_EQ(tokens[i]->charid(), expected[i]->charid());
+        EXPECT_EQ(tokens[i]->range(), expected[i]->range());
+
+        auto id = std::dynamic_pointer_cast<TokenID>(tokens[i]);
+        if (id != nullptr) {
+            EXPECT_EQ(id->id, std::dynamic_pointer_cast<TokenID>(expected[i])->id);
+        }
+    }
+}
+
+TEST_F(LexerTest, CombinedRulesCache)
+{
+    const string path = testing::TempDir() + "lexer_combined_rules.bin";
+    std::remove(path.c_str());
+    // only the first lexer combining these rules in the process touches the file
+    RegexCache<char>::instance().clear();
+    const string str = "if /*hello world   fi if ll*/ fi iff if_\n  if";
+    vector<std::shared_ptr<LexerToken>> results[2];
+    for (auto& tokens : results) {
+        Lexer<char> combined;
+        add_rules(combined);
+        combined.combine_rules(path);
+        combined.reset();
+        tokens = combined.feed_char(str);
+        auto tail = combined.feed_end();
+        tokens.insert(tokens.end(), tail.begin(), tail.end());
+        EXPECT_TRUE(RegexDFAImage<char>::load(path).has_value());
+    }
+
+    ASSERT_EQ(results[0].size(), 6);
+    ASSERT_EQ(results[1].size(), results[0].size());
+    for (size_t i = 0; i < results[0].size(); i++) {
+        EXPECT_EQ(results[1][i]->charid(), results[0][i]->charid());
+        EXPECT_EQ(results[1][i]->range(), results[0][i]->range());
+    }
+    std::remove(path.c_str());
+}
+
+TEST_F(LexerTest, SharedAutomata)
+{
+    Lexer<char> first, second;
+    add_rules(first);
+    add_rules(second);
+    first.combine_rules();
+    second.combine_rules();
+    EXPECT_EQ(first.combined_automaton(), second.combined_automaton());
+
+    const string pattern = "[a-z]+1";
+    SimpleRegExp<char> re1(pattern.begin(), pattern.end()), re2(pattern.begin(), pattern.end());
+    EXPECT_EQ(re1.get_nfa(), re2.get_nfa());
+    re1.compile();
+    re2.compile();
+    re1.feed('a');
+    EXPECT_FALSE(re2.dead());
+    re2.feed('1');
+    EXPECT_TRUE(re2.dead());
+    re1.feed('1');
+    EXPECT_TRUE(re1.match());
+    EXPECT_FALSE(re2.match());
+}
+
+TEST_F(LexerTest, SharedAutomataReleased)
+{
+    auto& cache = RegexCache<char>::instance();
+    const string pattern = "[a-z]+2";
+    std::weak_ptr<const void> automaton, dfa;
+    size_t live = 0;
+    {
+        Lexer<char> combined;
+        add_rules(combined);
+        combined.combine_rules();
+        SimpleRegExp<char> re(pattern.begin(), pattern.end());
+        re.compile();
+        automaton = combined.combined_automaton();
+        dfa = cache.dfa(vector<char>(pattern.begin(), pattern.end()));
+        live = cache.size();
+    }
+    // the cache doesn't keep an automaton its last user dropped
+    EXPECT_TRUE(automaton.expired());
+    EXPECT_TRUE(dfa.expired());
+    EXPECT_LT(cache.size(), live);
+
+    Lexer<char> again;
+    add_rules(again);
+    again.combine_rules();
+    EXPECT_NE(again.combined_automaton(), nullptr);
+}
+
+TEST_F(LexerTest, TokenTextViews)
+{
+    const string str = "if /*hello world   fi if ll*/ fi iff if_\n  if \"hello \\\"world\"";
+    auto expected = lexer.feed_char(str);
+    auto tail = lexer.feed_end();
+    expected.insert(expected.end(), tail.begin(), tail.end());
+
+    for (bool combine : {false, true}) {
+        Lexer<char> views;
+        views(LexerRuleRegex<char>::with_view(
+            string("/\\*(!.*\\*/.*)\\*/"), [](std::span<const char> str, TextRange info) {
+                return std::make_shared<TokenBlockComment>(string(str.begin(), str.end()), info);
+            }));
+        views.dec_priority_major();
+        views(std::make_unique<LexerRuleCStringLiteral<char>>([](auto str, auto info) {
+            return std::make_shared<TokenStringLiteral>(string(str.begin(), str.end()), info);
+        }));
+        views.dec_priority_major();
+        views(LexerRuleRegex<char>::with_view(
+            string("if"), [](std::span<const char>, TextRange info) -> std::shared_ptr<LexerToken> {
+                return std::make_shared<TokenIF>(info);
+            }));
+        views.dec_priority_minor();
+        views(LexerRuleRegex<char>::with_view(
+            string("[a-zA-Z_][a-zA-Z0-9_]*"), [](std::span<const char> str, TextRange info) {
+                return std::make_shared<TokenID>(string(str.begin(), str.end()), info);
+            }));
+        views.dec_priority_major();
+        views(LexerRuleRegex<char>::with_view(
+            string("( |\t|\r|\n)+"),
+            [](std::span<const char>, TextRange) -> std::shared_ptr<LexerToken> {
+                return nullptr;
+            }));
+        if (combine)
+            views.combine_rules();
+        views.reset();
+
+        auto tokens = views.feed_char(str);
+        tail = views.feed_end();
+        tokens.insert(tokens.end(), tail.begin(), tail.end());
+        ASSERT_EQ(tokens.size(), expected.size()) << combine;
+        for (size_t i = 0; i < tokens.size(); i++) {
+            EXPECT_EQ(tokens[i]->charid(), expected[i]->charid()) << combine;
+            EXPECT_EQ(tokens[i]->range(), expected[i]->range()) << combine;
+            auto id = std::dynamic_pointer_cast<TokenID>(tokens[i]);
+            if (id != nullptr) {
+                EXPECT_EQ(id->id, std::dynamic_pointer_cast<TokenID>(expected[i])->id);
+            }
+            auto comment = std::dynamic_pointer_cast<TokenBlockComment>(tokens[i]);
+            if (comment != nullptr) {
+                EXPECT_EQ(comment->comment,
+                          std::dynamic_pointer_cast<TokenBlockComment>(expected[i])->comment);
+            }
+        }
+    }
+}
+
+TEST(Lexer, TokenTextViewsCoverTheMatch)
+{
+    // "abc" keeps "ab(cd)?" alive one character past its match "ab"
+    const string str = "abce";
+    vector<vector<std::shared_ptr<LexerToken>>> results;
+    for (bool view : {false, true}) {
+        Lexer<char> lexer;
+        const auto factory = [](auto str, TextRange info) {
+            return std::make_shared<TokenID>(string(str.begin(), str.end()), info);
+        };
+        for (string pattern : {"ab(cd)?", "[a-z]"}) {
+            if (view) {
+                lexer(LexerRuleRegex<char>::with_view(pattern, factory));
+            } else {
+                lexer(std::make_unique<LexerRuleRegex<char>>(pattern, factory));
+            }
+            lexer.dec_priority_minor();
+        }
+        lexer.reset();
+        auto tokens = lexer.feed_char(str);
+        auto tail = lexer.feed_end();
+        tokens.insert(tokens.end(), tail.begin(), tail.end());
+        ASSERT_EQ(tokens.size(), 3u) << view;
+        results.push_back(tokens);
+    }
+
+    const auto id = [](const std::shared_ptr<LexerToken>& token) {
+        return std::dynamic_pointer_cast<TokenID>(token)->id;
+    };
+    // a rule keeping its text reports every character fed while it was alive
+    EXPECT_EQ(id(results[0][0]), "abc");
+    EXPECT_EQ(results[0][0]->range(), TextRange(0, 3));
+    // a view is only the matched characters, which the lexer consumed
+    EXPECT_EQ(id(results[1][0]), "ab");
+    EXPECT_EQ(results[1][0]->range(), TextRange(0, 2));
+    for (auto& tokens : results) {
+        EXPECT_EQ(id(tokens[1]), "c");
+        EXPECT_EQ(tokens[1]->range(), TextRange(2, 3));
+        EXPECT_EQ(id(tokens[2]), "e");
+    }
+}
+
+TEST(InputWindow, ReleaseKeepsOrder)
+{
+    InputWindow<int> window;
+    int next = 0, first = 0;
+    for (int round = 0; round < 100; round++) {
+        for (int i = 0; i < round % 7 + 1; i++)
+            window.push_back(next++);
+        window.release(std::min<size_t>(window.size(), round % 5));
+        first = next - window.size();
+        auto view = window.view();
+        ASSERT_EQ(view.size(), window.size());
+        for (size_t i = 0; i < view.size(); i++) {
+            ASSERT_EQ(view[i], first + int(i));
+            ASSERT_EQ(window[i], first + int(i));
+        }
+    }
+    window.release(window.size());
+    EXPECT_TRUE(window.empty());
+}
+
+TEST_F(LexerTest, LongTokens)
+{
+    const string comment = "/*" + string(200000, 'x') + "*/";
+    const string id(100000, 'a');
+    auto tokens = lexer.feed_char(comment + " " + id + " if");
+    auto tail = lexer.feed_end();
+    tokens.insert(tokens.end(), tail.begin(), tail.end());
+
+    ASSERT_EQ(tokens.size(), 3);
+    auto block = std::dynamic_pointer_cast<TokenBlockComment>(tokens[0]);
+    ASSERT_NE(block, nullptr);
+    EXPECT_EQ(block->comment.size(), comment.size());
+    auto name = std::dynamic_pointer_cast<TokenID>(tokens[1]);
+    ASSERT_NE(name, nullptr);
+    EXPECT_EQ(name->id, id);
+    EXPECT_EQ(tokens[2]->charid(), CharID<TokenIF>());
+}
+
+TEST_F(LexerTest, BufferTextInfo)
+{
+    string text = "if\n  /*a\nb*/ hello\n\n";
+    for (int i = 0; i < 8; i++)
+        text += "world_" + to_string(i) + "       iff\n";
+    auto expected = lexer.feed_char(text);
+    auto tail = lexer.feed_end();
+    expected.insert(expected.end(), tail.begin(), tail.end());
+    auto recorded = lexer.position_info();
+
+    const string path = testing::TempDir() + "lexer_buffer_text.txt";
+    ASSERT_TRUE(write_file_atomic(path, text));
+    auto mapped = BufferTextInfo::map_file(path);
+    ASSERT_NE(mapped, nullptr);
+    EXPECT_EQ(BufferTextInfo::map_file(path + ".missing"), nullptr);
+
+    for (auto source : {std::make_shared<BufferTextInfo>(text), mapped}) {
+        ASSERT_EQ(source->text(), text);
+        lexer.reset(source);
+        auto tokens = lexer.feed_char(source->text());
+        tail = lexer.feed_end();
+        tokens.insert(tokens.end(), tail.begin(), tail.end());
+        EXPECT_EQ(lexer.position_info(), source);
+
+        ASSERT_EQ(tokens.size(), expected.size());
+        for (size_t i = 0; i < tokens.size(); i++) {
+            EXPECT_EQ(tokens[i]->range(), expected[i]->range());
+            for (auto pos : {tokens[i]->beg().value(), tokens[i]->end().value() - 1}) {
+                EXPECT_EQ(source->query(pos).line, recorded->query(pos).line);
+                EXPECT_EQ(source->query(pos).column, recorded->query(pos).column);
+            }
+        }
+        for (size_t line = 1; line <= 13; line++)
+            EXPECT_EQ(source->line_range(line), recorded->line_range(line)) << line;
+        EXPECT_THROW(source->line_range(14), LexerError);
+        EXPECT_THROW(source->query(text.size()), LexerError);
+    }
+    std::remove(path.c_str());
+}
+
+// matches "a", counts the characters it's fed
+class CountingRule : public LexerRule<char>
+{
+  public:
+    size_t& fed;
+    size_t len;
+    bool failed;
+
+    CountingRule(size_t& fed) : fed(fed), len(0), failed(false)
+    {}
+
+    void feed(char c, size_t) override
+    {
+        this->fed++;
+        this->failed = this->failed || c != 'a' || this->len > 0;
+        this->len++;
+    }
+    bool dead() override
+    {
+        return this->failed;
+    }
+    bool match() override
+    {
+        return !this->failed && this->len == 1;
+    }
+    void reset(size_t, std::optional<std::shared_ptr<LexerToken>>) override
+    {
+        this->len = 0;
+        this->failed = false;
+    }
+    std::shared_ptr<LexerToken> token(std::vector<char>) override
+    {
+        return std::make_shared<TokenIF>(TextRange(0, 1));
+    }
+};
+
+TEST_F(LexerTest, DeadRulesAreNotFed)
+{
+    size_t fed = 0;
+    Lexer<char> counted;
+    counted(std::make_unique<CountingRule>(fed));
+    counted.dec_priority_major();
+    add_rules(counted);
+    counted.reset();
+
+    auto tokens = counted.feed_char(string("hello world a if"));
+    auto tail = counted.feed_end();
+    tokens.insert(tokens.end(), tail.begin(), tail.end());
+    ASSERT_EQ(tokens.size(), 4);
+    EXPECT_EQ(tokens[2]->charid(), CharID<TokenIF>());
+    EXPECT_EQ(tokens[2]->range(), TextRange(0, 1));
+    // once per token, whitespace included, and once more for the character after "a"
+    EXPECT_EQ(fed, 8);
+}
+
+static std::unique_ptr<Lexer<char>> make_regex_lexer()
+{
+    auto lexer = std::make_unique<Lexer<char>>();
+    (*lexer)(std::make_unique<LexerRuleRegex<char>>(
+        "/\\*([^*]|\\*+[^*/])*\\*+/", [](auto str, auto info) {
+            return std::make_shared<TokenBlockComment>(string(str.begin(), str.end()), info);
+        }));
+    (*lexer)(std::make_unique<LexerRuleRegex<char>>(
+        "\"([^\"\\\\\n]|\\\\.)*\"", [](auto str, auto info) {
+            return std::make_shared<TokenStringLiteral>(string(str.begin(), str.end()), info);
+        }));
+    (*lexer)(std::make_unique<LexerRuleRegex<char>>(
+        "if", [](auto str, auto info) { return std::make_shared<TokenIF>(info); }));
+    lexer->dec_priority_minor();
+    (*lexer)(std::make_unique<LexerRuleRegex<char>>(
+        "[a-zA-Z_][a-zA-Z0-9_]*", [](auto str, auto info) {
+            return std::make_shared<TokenID>(string(str.begin(), str.end()), info);
+        }));
+    (*lexer)(std::make_unique<LexerRuleRegex<char>>(
+        "[0-9]+\\.?([eE][\\-+]?[0-9]+)?",
+        [](auto, auto info) { return std::make_shared<TokenNumber>(info); }));
+    (*lexer)(std::make_unique<LexerRuleRegex<char>>(
+        "[\\-+*/.]", [](auto, auto info) { return std::make_shared<TokenPunc>(info); }));
+    (*lexer)(std::make_unique<LexerRuleRegex<char>>(
+        "( |\t|\r|\n)+", [](auto str, auto info) { return nullptr; }));
+    lexer->combine_rules();
+    lexer->reset();
+    return lexer;
+}
+
+TEST(Lexer, ParallelLexing)
+{
+    const auto make_lexer = make_regex_lexer;
+    string text;
+    for (int i = 0; i < 40; i++) {
+        text += "if x" + to_string(i) + " \"str\\\"ing " + to_string(i) + "\"\n";
+        if (i % 3 == 0)
+            text += "/* a comment\n  over @ lines\n if \"\n */ ";
+        text += "iff\t if_\n";
+    }
+    auto source = std::make_shared<BufferTextInfo>(text);
+    auto sequential = make_lexer();
+    auto expected = sequential->feed_char(text);
+    auto tail = sequential->feed_end();
+    expected.insert(expected.end(), tail.begin(), tail.end());
+    ASSERT_EQ(expected.size(), 40 * 5 + 14);
+
+    for (size_t min_chunk : {1, 7, 50, 400, 5000}) {
+        vector<std::shared_ptr<LexerToken>> tokens;
+        TokenBufferSink sink(tokens);
+        lex_parallel(source, span<const char>(text), make_lexer, sink, 4, min_chunk);
+        ASSERT_EQ(tokens.size(), expected.size()) << min_chunk;
+        for (size_t i = 0; i < tokens.size(); i++) {
+            EXPECT_EQ(tokens[i]->charid(), expected[i]->charid()) << min_chunk;
+            EXPECT_EQ(tokens[i]->range(), expected[i]->range()) << min_chunk;
+        }
+    }
+
+    vector<std::shared_ptr<LexerToken>> tokens;
+    TokenBufferSink sink(tokens);
+    const string bad = text + "@\n" + text;
+    EXPECT_THROW(lex_parallel(std::make_shared<BufferTextInfo>(bad),
+                              span<const char>(bad),
+                              make_lexer,
+                              sink,
+                              4,
+                              16),
+                 std::runtime_error);
+}
+
+TEST(Lexer, IncrementalRelex)
+{
+    const auto lex = [](const string& text) {
+        auto lexer = make_regex_lexer();
+        auto tokens = lexer->feed_char(text);
+        auto tail = lexer->feed_end();
+        tokens.insert(tokens.end(), tail.begin(), tail.end());
+        return tokens;
+    };
+
+    string text;
+    for (int i = 0; i < 10; i++)
+        text += "if x" + to_string(i) + " \"str " + to_string(i) + "\" /* c */ iff\n";
+    auto tokens = lex(text);
+    auto lexer = make_regex_lexer();
+
+    // offset, removed, inserted text
+    vector<tuple<size_t, size_t, string>> edits = {
+        {text.find("x5"), 2, "y55"},
+        {text.find("iff"), 0, "a"},
+        {text.find(" iff"), 1, ""},
+        {text.find("x2 "), 3, "\"x2\" "},
+        {0, 0, "/* "},
+        {0, 3, ""},
+        {text.size(), 0, "if tail"},
+        {text.find("if x"), 2, ""},
+    };
+    for (auto& [offset, removed, inserted] : edits) {
+        const auto before = tokens;
+        text.replace(offset, removed, inserted);
+        const auto damage = relex(*lexer,
+                                  std::make_shared<BufferTextInfo>(text),
+                                  tokens,
+                                  TextEdit{offset, removed, inserted.size()});
+
+        const auto expected = lex(text);
+        ASSERT_EQ(tokens.size(), expected.size()) << text;
+        for (size_t i = 0; i < tokens.size(); i++) {
+            EXPECT_EQ(tokens[i]->charid(), expected[i]->charid()) << text;
+            EXPECT_EQ(tokens[i]->range(), expected[i]->range()) << text;
+        }
+
+        ASSERT_EQ(before.size() - damage.old_end, tokens.size() - damage.new_end);
+        for (size_t i = 0; i < damage.first; i++)
+            EXPECT_EQ(tokens[i], before[i]);
+        for (size_t i = damage.new_end; i < tokens.size(); i++)
+            EXPECT_EQ(tokens[i], before[i - damage.new_end + damage.old_end]);
+        EXPECT_LE(damage.new_end - damage.first, 4u) << text;
+    }
+}
+
+TEST(TokenArena, TokensOutliveArena)
+{
+    vector<std::shared_ptr<LexerToken>> tokens;
+    std::weak_ptr<LexerToken> heap;
+    {
+        auto arena = std::make_unique<TokenArena>(256);
+        {
+            TokenArena::Scope scope(*arena);
+            EXPECT_EQ(TokenArena::current(), arena.get());
+            for (size_t i = 0; i < 100; i++)
+                tokens.push_back(make_token<TokenID>("id" + to_string(i), TextRange(i, i + 1)));
+        }
+        EXPECT_EQ(TokenArena::current(), nullptr);
+        EXPECT_GE(arena->used(), 100 * sizeof(TokenID));
+        EXPECT_GT(arena->blocks(), 1u);
+
+        const auto used = arena->used();
+        auto token = make_token<TokenIF>(TextRange(0, 2));
+        heap = token;
+        EXPECT_EQ(arena->used(), used);
+    }
+    EXPECT_TRUE(heap.expired());
+
+    for (size_t i = 0; i < tokens.size(); i++) {
+        auto id = std::dynamic_pointer_cast<TokenID>(tokens[i]);
+        ASSERT_NE(id, nullptr);
+        EXPECT_EQ(id->id, "id" + to_string(i));
+        EXPECT_EQ(id->range(), TextRange(i, i + 1));
+    }
+}
+
+TEST(TokenArena, SurvivingTokenPinsArena)
+{
+    std::shared_ptr<LexerToken> survivor;
+    {
+        TokenArena arena(128);
+        TokenArena::Scope scope(arena);
+        vector<std::shared_ptr<LexerToken>> tokens;
+        for (size_t i = 0; i < 1000; i++)
+            tokens.push_back(make_token<TokenID>("token" + to_string(i), TextRange(i, i + 1)));
+        survivor = tokens[500];
+        EXPECT_GT(arena.blocks(), 10u);
+    }
+
+    // the arena and the other tokens are gone, their memory must not have
+    // been handed back while the survivor still lives in one of its blocks
+    vector<std::shared_ptr<LexerToken>> heap;
+    for (size_t i = 0; i < 1000; i++)
+        heap.push_back(std::make_shared<TokenID>(string(40, 'x'), TextRange(0, 1)));
+    EXPECT_EQ(survivor.use_count(), 1);
+    auto id = std::dynamic_pointer_cast<TokenID>(survivor);
+    ASSERT_NE(id, nullptr);
+    EXPECT_EQ(id->id, "token500");
+    EXPECT_EQ(id->range(), TextRange(500, 501));
+}
+
+TEST(TokenArena, ReleasedOnOtherThreads)
+{
+    vector<std::shared_ptr<LexerToken>> early, late;
+    {
+        TokenArena arena(256);
+        TokenArena::Scope scope(arena);
+        for (size_t i = 0; i < 200; i++)
+            (i % 2 ? early : late).push_back(make_token<TokenIF>(TextRange(i, i + 1)));
+        for (size_t i = 0; i < 50; i++)
+            make_token<TokenIF>(TextRange(i, i + 1));
+
+        // counted atomically while the owner counts its own frees plainly
+        std::thread([&]() { early.clear(); }).join();
+    }
+
+    // the last token goes on another thread after the arena
+    std::thread([&]() {
+        for (size_t i = 0; i < late.size(); i++)
+            EXPECT_EQ(late[i]->range(), TextRange(2 * i, 2 * i + 1));
+        late.clear();
+    }).join();
+}
+
+TEST(Lexer, IncrementalRelexLookahead)
+{
+    auto full = make_regex_lexer();
+    const auto lex = [&](const string& text) {
+        full->reset();
+        auto tokens = full->feed_char(text);
+        auto tail = full->feed_end();
+        tokens.insert(tokens.end(), tail.begin(), tail.end());
+        return tokens;
+    };
+    auto lexer = make_regex_lexer();
+    const auto check = [&](string text, size_t offset, size_t removed, const string& inserted) {
+        SCOPED_TRACE(text + " @" + to_string(offset) + " -" + to_string(removed) + " +" + inserted);
+        auto tokens = lex(text);
+        text.replace(offset, removed, inserted);
+        relex(*lexer,
+              std::make_shared<BufferTextInfo>(text),
+              tokens,
+              TextEdit{offset, removed, inserted.size()});
+
+        const auto expected = lex(text);
+        ASSERT_EQ(tokens.size(), expected.size()) << text;
+        for (size_t i = 0; i < tokens.size(); i++) {
+            ASSERT_EQ(tokens[i]->charid(), expected[i]->charid()) << text << " " << i;
+            ASSERT_EQ(tokens[i]->range(), expected[i]->range()) << text << " " << i;
+        }
+    };
+
+    // "1." was cut after the number rule read up to the "x"
+    check("1.e+x", 4, 1, "5");
+    check("1.e+5", 4, 1, "x");
+    // "/" and "*" of an unterminated comment were decided at the end of file
+    check("a /* b * c", 10, 0, "*/");
+    check("a /* b */ c", 7, 2, "");
+    check("x /* b */ c", 2, 1, "");
+
+    std::default_random_engine generator(23);
+    const string alphabet = "a1.e+*/ \n";
+    std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1), length(0, 3);
+    string text = "1.e+5 /* a */ b 2.e c\n";
+    for (size_t i = 0; i < 2000; i++) {
+        std::uniform_int_distribution<size_t> at(0, text.size());
+        const auto offset = at(generator);
+        const auto removed = min(length(generator), text.size() - offset);
+        string inserted;
+        for (auto n = length(generator); n > 0; n--)
+            inserted.push_back(alphabet[pick(generator)]);
+        if (text.size() > 200)
+            inserted.clear();
+
+        check(text, offset, removed, inserted);
+        if (HasFatalFailure())
+            return;
+        text.replace(offset, removed, inserted);
+    }
+}
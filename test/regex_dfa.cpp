@@ -1,5 +1,12 @@
 #include "regex/regex.hpp"
 #include <gtest/gtest.h>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <span>
+#include <string_view>
+#include <thread>
 #include <tuple>
 #include <vector>
 using namespace std;
@@ -53,3 +60,302 @@ TEST(DFA, basic_dfa_test)
         }
     }
 }
+
+TEST(DFA, flat_table)
+{
+    vector<pair<string, size_t>> test_cases = {
+        {"[a-z]+", 2},
+        {"[ac]b", 3},
+        {"if|[a-zA-Z_][a-zA-Z0-9_]*", 4},
+        {"/\\*(!\\*/)\\*/", 3},
+        {"[^0-9]+", 2},
+    };
+
+    for (auto& testcase : test_cases) {
+        auto& re = testcase.first;
+        auto nfa = NodeNFA<char>::from_regex(vector<char>(re.begin(), re.end()));
+        auto dfa = nfa.toRegexNFA().compile();
+
+        ASSERT_TRUE(dfa.has_flat_table()) << re;
+        EXPECT_EQ(dfa.char_classes().size(), testcase.second) << re << endl << dfa.to_string();
+        for (size_t s = 0; s < dfa.state_count(); s++) {
+            for (int c = character_traits<char>::MIN; c <= character_traits<char>::MAX; c++) {
+                ASSERT_EQ(dfa.state_transition(s, c), dfa.range_transition(s, c))
+                    << re << ": state " << s << ", char " << c;
+            }
+        }
+    }
+
+    auto unfa = NodeNFA<int>::from_regex(UTF8Decoder::strdecode("[^\n]*意见"));
+    auto udfa = unfa.toRegexNFA().compile();
+    ASSERT_TRUE(udfa.has_flat_table());
+    vector<int> probes = {0, 1, '\n', 'a', 127, 128, 0x610f, 0x6110, 0x89c1, 0x10ffff, -5};
+    for (size_t s = 0; s < udfa.state_count(); s++) {
+        for (auto c : probes)
+            ASSERT_EQ(udfa.state_transition(s, c), udfa.range_transition(s, c)) << s << " " << c;
+    }
+}
+
+// Moore's refinement over every character, reference for minimal state counts
+static size_t naive_minimal_state_count(const RegexDFA<char>& dfa)
+{
+    using traits = character_traits<char>;
+    const auto n = dfa.state_count();
+    vector<size_t> cls(n);
+    for (size_t s = 0; s < n; s++)
+        cls[s] = dfa.is_final(s) ? 1 : 0;
+
+    for (size_t nclasses = 0;;) {
+        map<vector<size_t>, size_t> signatures;
+        vector<size_t> next(n);
+        for (size_t s = 0; s < n; s++) {
+            vector<size_t> sig = {cls[s]};
+            for (int c = traits::MIN; c <= traits::MAX; c++)
+                sig.push_back(cls[dfa.state_transition(s, c)]);
+            next[s] = signatures.emplace(sig, signatures.size()).first->second;
+        }
+        cls = next;
+        if (signatures.size() == nclasses)
+            break;
+        nclasses = signatures.size();
+    }
+
+    set<size_t> reachable = {dfa.start_state()};
+    vector<size_t> stack = {dfa.start_state()};
+    while (!stack.empty()) {
+        auto s = stack.back();
+        stack.pop_back();
+        for (int c = traits::MIN; c <= traits::MAX; c++) {
+            auto t = dfa.state_transition(s, c);
+            if (reachable.insert(t).second)
+                stack.push_back(t);
+        }
+    }
+
+    set<size_t> classes;
+    for (auto s : reachable)
+        classes.insert(cls[s]);
+    return classes.size();
+}
+
+TEST(DFA, minimization)
+{
+    // state counts include the dead state
+    vector<pair<string, size_t>> test_cases = {
+        {"a*", 2},
+        {"aa*", 3},
+        {"a+|b+", 4},
+        {"a*b|c", 4},
+        {"(a|b)*abb", 5},
+        {"(ab|cd)*", 4},
+        {"(a|ab)(c|bcd)", 8},
+        {"if|[a-zA-Z_][a-zA-Z0-9_]*", 3},
+    };
+    vector<string> c_patterns = {
+        "([a-zA-Z_]|\\\\0[uU][0-9a-fA-F]{4})([a-zA-Z0-9_]|\\\\0[uU][0-9a-fA-F]{4})*",
+        "[0-9]+[eE][\\+\\-]?[0-9]+[flFL]?",
+        "((([0-9]+)?\\.[0-9]+)|[0-9]+\\.)([eE][\\+\\-]?[0-9]+)?[flFL]?",
+        "(0[xX])?[0-9a-fA-F]+([uU][lL]?|[uU](ll|LL)|[lL][uU]?|(ll|LL)[uU]?)?",
+        "L?'([^\\\\']+|\\\\.|\\\\0[0-7]*|\\\\x[0-9a-fA-F]+)'",
+    };
+    for (auto& re : c_patterns)
+        test_cases.push_back(make_pair(re, 0));
+
+    for (auto& testcase : test_cases) {
+        auto& re = testcase.first;
+        auto nfa = NodeNFA<char>::from_regex(vector<char>(re.begin(), re.end()));
+        auto dfa = nfa.toRegexNFA().compile();
+        auto minimized = dfa;
+        minimized.optimize();
+
+        auto expected = testcase.second > 0 ? testcase.second : naive_minimal_state_count(dfa);
+        EXPECT_EQ(minimized.state_count(), expected) << re << endl << minimized.to_string();
+        EXPECT_LE(minimized.state_count(), dfa.state_count()) << re;
+
+        auto again = minimized;
+        again.optimize();
+        EXPECT_EQ(again.state_count(), minimized.state_count()) << re;
+
+        std::default_random_engine generator(re.size());
+        std::uniform_int_distribution<int> length(0, 8);
+        string alphabet = "abcdfiz_019eE+-.xXuUlLf\\'";
+        std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+        for (size_t i = 0; i < 2000; i++) {
+            string input;
+            for (int k = length(generator); k > 0; k--)
+                input.push_back(alphabet[pick(generator)]);
+
+            auto s1 = dfa.start_state(), s2 = minimized.start_state();
+            for (auto c : input) {
+                s1 = dfa.state_transition(s1, c);
+                s2 = minimized.state_transition(s2, c);
+            }
+            ASSERT_EQ(dfa.is_final(s1), minimized.is_final(s2)) << re << ": " << input;
+        }
+    }
+}
+
+TEST(DFA, image)
+{
+    using traits = character_traits<char>;
+    vector<string> patterns = {"[a-z]+", "if|[a-zA-Z_][a-zA-Z0-9_]*", "/\\*(!\\*/)\\*/", "[^0-9]+"};
+    for (auto& re : patterns) {
+        auto nfa = NodeNFA<char>::from_regex(vector<char>(re.begin(), re.end()));
+        auto dfa = nfa.toRegexNFA().compile();
+        dfa.optimize();
+
+        auto image = RegexDFAImage<char>::from_dfa(dfa, 42);
+        EXPECT_EQ(image.checksum(), 42);
+        ASSERT_EQ(image.state_count(), dfa.state_count());
+        EXPECT_EQ(image.start_state(), dfa.start_state());
+        auto decoded = image.to_dfa();
+        for (size_t s = 0; s < dfa.state_count(); s++) {
+            EXPECT_EQ(image.is_final(s), dfa.is_final(s)) << re;
+            EXPECT_EQ(image.is_dead(s), dfa.is_dead(s)) << re;
+            for (int c = traits::MIN; c <= traits::MAX; c++) {
+                ASSERT_EQ(image.state_transition(s, c), dfa.state_transition(s, c))
+                    << re << ": state " << s << ", char " << c;
+                ASSERT_EQ(decoded.state_transition(s, c), dfa.state_transition(s, c));
+            }
+        }
+    }
+
+    RegexSet<int> set(vector<vector<int>>({UTF8Decoder::strdecode("[^\n]*意见"),
+                                           UTF8Decoder::strdecode("[a-z]+"),
+                                           UTF8Decoder::strdecode("意[a-z]*")}));
+    const auto checksum = regex_patterns_checksum(vector<vector<int>>({{'a'}}));
+    auto uimage = RegexDFAImage<int>::from_dfa(set.dfa(), checksum);
+    ASSERT_TRUE(uimage.has_accept_tags());
+    const string path = testing::TempDir() + "regex_dfa_image.bin";
+    ASSERT_TRUE(uimage.save(path));
+    EXPECT_FALSE(RegexDFAImage<int>::load(path, checksum + 1).has_value());
+    EXPECT_FALSE(RegexDFAImage<char>::load(path).has_value());
+
+    auto loaded = RegexDFAImage<int>::load(path, checksum);
+    ASSERT_TRUE(loaded.has_value());
+    vector<int> probes = {0, 1, '\n', 'a', 'z', 127, 128, 0x610f, 0x610f, 0x89c1, 0x10ffff};
+    for (size_t s = 0; s < set.dfa().state_count(); s++) {
+        auto tags = loaded->accept_tags(s);
+        EXPECT_EQ(vector<size_t>(tags.begin(), tags.end()), set.dfa().accept_tags(s));
+        for (auto c : probes)
+            ASSERT_EQ(loaded->state_transition(s, c), set.dfa().state_transition(s, c));
+    }
+
+    string corrupt(uimage.data(), uimage.size() / 2);
+    EXPECT_TRUE(write_file_atomic(path, corrupt));
+    EXPECT_FALSE(RegexDFAImage<int>::load(path, checksum).has_value());
+
+    // "if" is accepted by both patterns, swapping its tags keeps the checksum
+    RegexSet<int> keywords(vector<vector<int>>({UTF8Decoder::strdecode("[a-z]+"),
+                                                UTF8Decoder::strdecode("if")}));
+    auto kimage = RegexDFAImage<int>::from_dfa(keywords.dfa(), checksum);
+    auto unsorted = make_shared<string>(kimage.data(), kimage.size());
+    size_t swapped = 0;
+    for (size_t s = 0; s < kimage.state_count(); s++) {
+        auto tags = kimage.accept_tags(s);
+        if (tags.size() < 2)
+            continue;
+
+        auto at = reinterpret_cast<const char*>(tags.data()) - kimage.data();
+        auto stored = reinterpret_cast<uint64_t*>(unsorted->data() + at);
+        std::swap(stored[0], stored[1]);
+        swapped++;
+    }
+    ASSERT_GT(swapped, 0u);
+    EXPECT_THROW(RegexDFAImage<int>(unsorted, unsorted->data(), unsorted->size()),
+                 std::runtime_error);
+    EXPECT_TRUE(write_file_atomic(path, *unsorted));
+    EXPECT_FALSE(RegexDFAImage<int>::load(path, checksum).has_value());
+    std::remove(path.c_str());
+}
+
+TEST(DFA, parallel_compile)
+{
+    vector<RegexNFA<char>> nfas;
+    for (size_t i = 0; i < 60; i++) {
+        string re = i % 3 == 0 ? "[a-z_][a-z0-9_]*" + to_string(i) : "kw" + to_string(i * 37);
+        nfas.push_back(NodeNFA<char>::from_regex(vector<char>(re.begin(), re.end())).toRegexNFA());
+    }
+    auto nfa = RegexNFA<char>::tagged_union(nfas);
+    auto serial = nfa.compile();
+    ASSERT_GT(serial.state_count(), 100);
+    for (size_t threads : {2, 4}) {
+        auto parallel = nfa.compile(threads);
+        ASSERT_EQ(parallel.state_count(), serial.state_count());
+        EXPECT_EQ(parallel.start_state(), serial.start_state());
+        EXPECT_EQ(parallel.final_states(), serial.final_states());
+        EXPECT_EQ(RegexDFAImage<char>::serialize(parallel), RegexDFAImage<char>::serialize(serial));
+        for (size_t s = 0; s < serial.state_count(); s++)
+            ASSERT_EQ(parallel.transitions()[s].size(), serial.transitions()[s].size());
+    }
+}
+
+TEST(DFA, worker_pool)
+{
+    WorkerPool pool(4);
+    ASSERT_EQ(pool.size(), 4u);
+    std::mutex mutex;
+    set<std::thread::id> ids;
+    for (size_t round = 0; round < 50; round++) {
+        vector<size_t> calls(100, 0);
+        pool.run(calls.size(), [&](size_t i) {
+            calls[i]++;
+            std::lock_guard<std::mutex> lock(mutex);
+            ids.insert(std::this_thread::get_id());
+        });
+        ASSERT_EQ(calls, vector<size_t>(100, 1));
+    }
+    // the same threads take every run
+    EXPECT_LE(ids.size(), pool.size());
+
+    EXPECT_THROW(pool.run(10,
+                          [](size_t i) {
+                              if (i == 3)
+                                  throw std::runtime_error("job failed");
+                          }),
+                 std::runtime_error);
+    std::atomic<size_t> sum = 0;
+    pool.run(10, [&](size_t i) { sum += i; });
+    EXPECT_EQ(sum, 45u);
+}
+
+TEST(DFA, test_many)
+{
+    vector<string> patterns = {
+        "[a-zA-Z_][a-zA-Z0-9_]*",
+        "0[xX][0-9a-fA-F]+|[0-9]+",
+        "(ab|c)*d",
+        "\"([^\"\\\\]|\\\\.)*\"",
+    };
+    std::default_random_engine generator(7);
+    std::uniform_int_distribution<int> length(0, 24);
+    const string alphabet = "abcdxX09_\"\\ ";
+    std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+    vector<string> strings;
+    for (size_t i = 0; i < 3000; i++) {
+        string str;
+        for (int k = length(generator); k > 0; k--)
+            str.push_back(alphabet[pick(generator)]);
+        strings.push_back(str);
+    }
+    strings.push_back("0x1f");
+    strings.push_back("abcabd");
+    vector<string_view> views(strings.begin(), strings.end());
+
+    for (auto& re : patterns) {
+        DFAMatcher<char> matcher(vector<char>(re.begin(), re.end()));
+        auto result = matcher.test_many(views);
+        ASSERT_EQ(result.size(), strings.size());
+        size_t matched = 0;
+        for (size_t i = 0; i < strings.size(); i++) {
+            ASSERT_EQ(result[i], matcher.test(strings[i])) << re << ": " << strings[i];
+            matched += result[i];
+        }
+        EXPECT_GT(matched, 0) << re;
+
+        auto few = matcher.test_many(span<const string_view>(views.data(), 3));
+        ASSERT_EQ(few.size(), 3);
+        for (size_t i = 0; i < few.size(); i++)
+            EXPECT_EQ(few[i], matcher.test(strings[i])) << re;
+    }
+}
@@ -45,14 +45,14 @@ TEST(regex, regex_convert)
         {"a?", "(|a)"},
         {"a+", "aa*"},
         {"a{1}", "a"},
-        {"a{2}", "aa"},
-        {"a{2,}", "aaa*"},
+        {"a{2}", "a{2}"},
+        {"a{2,}", "a{2,}"},
         {"a{,}", "a*"},
-        {"a{2,4}", "aa(|a(|a))"},
+        {"a{2,4}", "a{2,4}"},
 
         {"(ab)*", "(ab)*"},
-        {"(ab){2}", "(ab)(ab)"},
-        {"(ab){2,}", "(ab)(ab)(ab)*"},
+        {"(ab){2}", "(ab){2}"},
+        {"(ab){2,}", "(ab){2,}"},
 
         {"[\\-+?.]?", "(|[\\-+?.])"},
         {"([0-9]*[.])?", "(|([0-9]*[.]))"},
@@ -60,10 +60,10 @@ TEST(regex, regex_convert)
 
         {"(ab(ab(ab)))*", "(ab(ab(ab)))*"},
         {"(ab(ab(ab))){1}", "(ab(ab(ab)))"},
-        {"(ab(ab(ab))){1,2}", "(ab(ab(ab)))(|(ab(ab(ab))))"},
-        {"(ab(ab(ab))){1,}", "(ab(ab(ab)))(ab(ab(ab)))*"},
+        {"(ab(ab(ab))){1,2}", "(ab(ab(ab))){1,2}"},
+        {"(ab(ab(ab))){1,}", "(ab(ab(ab))){1,}"},
 
-        {"\\{\\}\\?\\+\\.", "{}?+."},
+        {"\\{\\}\\?\\+\\.", "\\{\\}?+."},
     };
 
     for (auto& test_case : test_cases) {
@@ -0,0 +1,79 @@
+#include "regex/regex.hpp"
+#include <gtest/gtest.h>
+#include <random>
+#include <tuple>
+#include <vector>
+using namespace std;
+
+
+TEST(LazyDFA, basic_test)
+{
+    vector<tuple<string, vector<string>, vector<string>>> test_cases = {
+        {"aa*", {"aa", "a", "aaa"}, {"", "b", "aab"}},
+        {"a*", {"", "a", "aa"}, {"aabaa", "b"}},
+        {"ab", {"ab"}, {"ba", "b", "a", ""}},
+        {"a|b|c|d|e", {"a", "b", "c", "d", "e"}, {"", "ab", "ba", "de", "ed", "ee", "dd"}},
+        {"(a|bd)", {"bd", "a"}, {"b", "d", "ab", "ad"}},
+        {"([a-bc])", {"a", "b", "c"}, {"", "aa", "bb", "cc", "ab"}},
+        {"a+|b+", {"a", "bb"}, {"ab", "ba", ""}},
+        {"a{2,4}", {"aa", "aaa", "aaaa"}, {"a", "aaaaa", ""}},
+        {"(!1234)", {"431", ""}, {"1234"}},
+        {"/\\*(!\\*/)\\*/", {"/* asdf */"}, {"", "/* asdf */ "}},
+        {"(a|b)*a(a|b)(a|b)(a|b)", {"abbb", "bbaaba"}, {"", "abb", "bbbbbb"}},
+    };
+
+    for (auto& testcase : test_cases) {
+        auto& re = get<0>(testcase);
+        auto& accepts = get<1>(testcase);
+        auto& rejects = get<2>(testcase);
+
+        auto matcher = LazyDFAMatcher<char>(vector<char>(re.begin(), re.end()));
+        for (auto& accept : accepts)
+            ASSERT_TRUE(matcher.test(accept.begin(), accept.end())) << re << ": " << accept;
+
+        for (auto& reject : rejects)
+            ASSERT_FALSE(matcher.test(reject.begin(), reject.end())) << re << ": " << reject;
+    }
+}
+
+TEST(LazyDFA, bounded_cache)
+{
+    // the subset construction of this pattern has 2^8 states
+    string re = "(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)";
+    auto nfa = make_shared<RegexNFA<char>>(
+        NodeNFA<char>::from_regex(vector<char>(re.begin(), re.end())).toRegexNFA());
+    NFAMatcher<char> reference(nfa);
+    LazyDFAMatcher<char> unbounded(nfa);
+    LazyDFAMatcher<char> bounded(nfa, 4096);
+
+    std::default_random_engine generator(1);
+    std::uniform_int_distribution<int> length(0, 40);
+    std::uniform_int_distribution<int> pick(0, 2);
+    for (size_t i = 0; i < 3000; i++) {
+        string input;
+        for (int k = length(generator); k > 0; k--)
+            input.push_back("abc"[pick(generator)]);
+
+        auto expected = reference.test(input);
+        ASSERT_EQ(unbounded.test(input), expected) << input;
+        ASSERT_EQ(bounded.test(input), expected) << input;
+        ASSERT_EQ(bounded.dead(), reference.dead()) << input;
+    }
+
+    EXPECT_EQ(unbounded.cache_flushes(), 0);
+    EXPECT_GT(bounded.cache_flushes(), 0);
+    EXPECT_LE(bounded.memory_used(), 4096 + 1024);
+}
+
+TEST(LazyDFA, simple_regexp)
+{
+    string re = "[a-zA-Z_][a-zA-Z0-9_]*";
+    SimpleRegExp<char> regex(re.begin(), re.end());
+    regex.compile_lazy();
+
+    EXPECT_TRUE(regex.test(string("hello_world1")));
+    EXPECT_FALSE(regex.test(string("1hello")));
+    regex.reset();
+    regex.feed('1');
+    EXPECT_TRUE(regex.dead());
+}
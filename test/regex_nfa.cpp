@@ -1,5 +1,6 @@
 #include "regex/regex.hpp"
 #include <gtest/gtest.h>
+#include <random>
 #include <tuple>
 #include <vector>
 using namespace std;
@@ -23,8 +24,14 @@ TEST(NFA, basic_test)
         {"a+", {"aaa", "a", "aa", "aaaaa"}, {"", "aabaa"}},
         {"a{,}", {"a", ""}, {"ab"}},
         {"a{2,4}", {"aa", "aaa", "aaaa"}, {"a", "aaaaa", ""}},
+        {"(ab|c){0,2}x", {"x", "abx", "cabx", "ccx"}, {"", "ccabx", "ax"}},
+        {"a{2}b{2,}", {"aabb", "aabbbb"}, {"aab", "abb", "aaabb"}},
+        {"ba{0}c", {"bc"}, {"bac"}},
+        {"(a*b){1,3}", {"b", "aabab", "bbb"}, {"", "bbbb", "aa"}},
+        {"\\{a,\\}", {"{a,}"}, {"a", "aa"}},
 
         {"(!1234)", {"431", ""}, {"1234"}},
+        {"x|(!ab)c", {"x", "c", "xc", "abbc", "ac"}, {"abc", "ab", "xx"}},
         {"/\\*(!\\*/)\\*/", {"/* asdf */"}, {"", "/* asdf */ "}},
 
         {"(a(a(a(a(a)))))", {"aaaaa"}, {"a"}},
@@ -50,3 +57,92 @@ TEST(NFA, basic_test)
         }
     }
 }
+
+TEST(NFA, bit_parallel)
+{
+    vector<string> patterns = {
+        "aa*",
+        "a|b|c|d|e",
+        "(a|bd)",
+        "a+|b+",
+        "a{2,4}",
+        "(!ab)",
+        "(a|b)*a(a|b)(a|b)",
+        "[a-c_][a-c0-9_]*",
+        "0[0-7]*([uU][lL]?|[uU](ll|LL)|[lL][uU]?|(ll|LL)[uU]?)?",
+        "a{40}",
+    };
+
+    for (auto& re : patterns) {
+        auto nfa = make_shared<RegexNFA<char>>(
+            NodeNFA<char>::from_regex(vector<char>(re.begin(), re.end())).toRegexNFA());
+        NFAMatcher<char> reference(nfa);
+        BitNFAMatcher<char, 4> wide(nfa);
+        ASSERT_LE(wide.state_count(), nfa->transitions().size()) << re;
+
+        std::default_random_engine generator(re.size());
+        std::uniform_int_distribution<int> length(0, 45);
+        string alphabet = "abcd_09uUlL";
+        std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+        for (size_t i = 0; i < 1000; i++) {
+            string input;
+            for (int k = length(generator); k > 0; k--)
+                input.push_back(alphabet[pick(generator)]);
+            if (i == 0)
+                input = string(40, 'a');
+
+            reference.reset();
+            wide.reset();
+            for (auto c : input) {
+                reference.feed(c);
+                wide.feed(c);
+                ASSERT_EQ(wide.match(), reference.match()) << re << ": " << input;
+                ASSERT_EQ(wide.dead(), reference.dead()) << re << ": " << input;
+            }
+
+            if (BitNFAMatcher<char, 1>::fits(*nfa)) {
+                BitNFAMatcher<char, 1> narrow(nfa);
+                ASSERT_EQ(narrow.test(input), reference.test(input)) << re << ": " << input;
+            }
+        }
+    }
+
+    using BitNFA64 = BitNFAMatcher<char, 1>;
+    using BitNFA256 = BitNFAMatcher<char, 4>;
+    string medium = "a{80}", big = "a{300}";
+    auto medium_nfa =
+        NodeNFA<char>::from_regex(vector<char>(medium.begin(), medium.end())).toRegexNFA();
+    auto big_nfa = NodeNFA<char>::from_regex(vector<char>(big.begin(), big.end())).toRegexNFA();
+    EXPECT_FALSE(BitNFA64::fits(medium_nfa));
+    EXPECT_TRUE(BitNFA256::fits(medium_nfa));
+    EXPECT_FALSE(BitNFA256::fits(big_nfa));
+}
+
+TEST(NFA, state_set_table)
+{
+    using state_t = StateSetTable::state_t;
+    StateSetTable table;
+    vector<vector<state_t>> sets = {{}};
+    for (state_t i = 0; i < 200; i++) {
+        vector<state_t> set = {i};
+        if (i % 3 == 0)
+            set.push_back(1000);
+        if (i % 5 == 0)
+            set.push_back(2000 + i);
+        sets.push_back(set);
+    }
+
+    for (size_t i = 0; i < sets.size(); i++) {
+        auto [index, inserted] = table.insert(sets[i]);
+        EXPECT_EQ(index, i);
+        EXPECT_TRUE(inserted);
+    }
+    for (size_t i = 0; i < sets.size(); i++) {
+        auto [index, inserted] = table.insert(sets[i]);
+        EXPECT_EQ(index, i);
+        EXPECT_FALSE(inserted);
+        auto stored = table[i];
+        EXPECT_EQ(vector<state_t>(stored.begin(), stored.end()), sets[i]);
+    }
+    EXPECT_EQ(table.size(), sets.size());
+}
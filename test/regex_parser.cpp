@@ -63,18 +63,18 @@ TEST(regex, regex_extend_node_generator)
 
         {"a?", "(|a)"},
         {"a+", "aa*"},
-        {"a{2}", "aa"},
+        {"a{2}", "a{2}"},
         {"a{,}", "a*"},
-        {"a{2,4}", "aa(|a(|a))"},
+        {"a{2,4}", "a{2,4}"},
 
         {"(ab)*", "(ab)*"},
-        {"(ab){2}", "(ab)(ab)"},
-        {"(ab){2,}", "(ab)(ab)(ab)*"},
+        {"(ab){2}", "(ab){2}"},
+        {"(ab){2,}", "(ab){2,}"},
 
         {"(ab(ab(ab)))*", "(ab(ab(ab)))*"},
         {"(ab(ab(ab))){1}", "(ab(ab(ab)))"},
-        {"(ab(ab(ab))){1,2}", "(ab(ab(ab)))(|(ab(ab(ab))))"},
-        {"(ab(ab(ab))){1,}", "(ab(ab(ab)))(ab(ab(ab)))*"},
+        {"(ab(ab(ab))){1,2}", "(ab(ab(ab))){1,2}"},
+        {"(ab(ab(ab))){1,}", "(ab(ab(ab))){1,}"},
     };
 
     for (auto& test_case : test_cases) {
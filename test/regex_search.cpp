@@ -0,0 +1,84 @@
+#include "regex/regex.hpp"
+#include <gtest/gtest.h>
+#include <random>
+#include <tuple>
+#include <vector>
+using namespace std;
+using match_t = RegexSearcher<char>::match_t;
+
+
+static vector<match_t> naive_find_all(const string& re, const string& text)
+{
+    DFAMatcher<char> matcher(vector<char>(re.begin(), re.end()));
+    vector<match_t> result;
+    for (size_t from = 0; from <= text.size();) {
+        bool found = false;
+        for (size_t b = from; b <= text.size() && !found; b++) {
+            for (size_t e = text.size() + 1; e-- > b;) {
+                if (matcher.test(text.begin() + b, text.begin() + e)) {
+                    result.push_back(make_pair(b, e));
+                    from = e > b ? e : e + 1;
+                    found = true;
+                    break;
+                }
+            }
+        }
+        if (!found)
+            break;
+    }
+    return result;
+}
+
+TEST(RegexSearch, find)
+{
+    vector<tuple<string, string, vector<match_t>>> test_cases = {
+        {"abc", "xxabcxabc", {{2, 5}, {6, 9}}},
+        {"a+", "baaab a", {{1, 4}, {6, 7}}},
+        {"if|[a-z]+", "if ifx 1", {{0, 2}, {3, 6}}},
+        {"a*", "ba", {{0, 0}, {1, 2}, {2, 2}}},
+        {"/\\*(!\\*/)\\*/", "x /* a */ y /**/", {{2, 16}}},
+        {"[0-9]+", "no digits", {}},
+    };
+
+    for (auto& testcase : test_cases) {
+        auto& re = get<0>(testcase);
+        auto& text = get<1>(testcase);
+        RegexSearcher<char> searcher(vector<char>(re.begin(), re.end()));
+        EXPECT_EQ(searcher.find_all(text), get<2>(testcase)) << re << ": " << text;
+    }
+
+    string re = "hello[0-9]";
+    RegexSearcher<char> searcher(vector<char>(re.begin(), re.end()));
+    EXPECT_EQ(string(searcher.literal_prefix().begin(), searcher.literal_prefix().end()), "hello");
+    auto m = searcher.find(string("hello hellx hello7"));
+    ASSERT_TRUE(m.has_value());
+    EXPECT_EQ(m.value(), make_pair(size_t(12), size_t(18)));
+}
+
+TEST(RegexSearch, random)
+{
+    vector<string> patterns = {
+        "ab",
+        "a(b|c)+",
+        "[abc]",
+        "ab|ba",
+        "a*b",
+        "(ab)*",
+        "[^a]c",
+        "cab*c",
+    };
+
+    std::default_random_engine generator(7);
+    std::uniform_int_distribution<int> length(0, 40);
+    std::uniform_int_distribution<int> pick(0, 3);
+    for (auto& re : patterns) {
+        RegexSearcher<char> searcher(vector<char>(re.begin(), re.end()));
+        for (size_t i = 0; i < 200; i++) {
+            string text;
+            for (int k = length(generator); k > 0; k--)
+                text.push_back("abcd"[pick(generator)]);
+
+            ASSERT_EQ(searcher.find_all(text), naive_find_all(re, text)) << re << ": " << text;
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#include "regex/regex.hpp"
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+using namespace std;
+
+
+TEST(RegexSet, matches)
+{
+    vector<string> patterns = {"if", "[a-z]+", "[0-9]+", "[a-z0-9]+", "a*"};
+    RegexSet<char> set(patterns);
+    EXPECT_EQ(set.size(), 5);
+
+    EXPECT_EQ(set.matches(string("if")), vector<size_t>({0, 1, 3}));
+    EXPECT_EQ(set.matches(string("ab")), vector<size_t>({1, 3}));
+    EXPECT_EQ(set.matches(string("aa")), vector<size_t>({1, 3, 4}));
+    EXPECT_EQ(set.matches(string("12")), vector<size_t>({2, 3}));
+    EXPECT_EQ(set.matches(string("a1")), vector<size_t>({3}));
+    EXPECT_EQ(set.matches(string("")), vector<size_t>({4}));
+    EXPECT_EQ(set.matches(string("A")), vector<size_t>());
+
+    auto m = set.longest_match(string("ifx1+2"));
+    ASSERT_TRUE(m.has_value());
+    EXPECT_EQ(m->first, 4);
+    EXPECT_EQ(m->second, vector<size_t>({3}));
+
+    m = set.longest_match(string("if+"));
+    ASSERT_TRUE(m.has_value());
+    EXPECT_EQ(m->first, 2);
+    EXPECT_EQ(m->second.front(), 0);
+
+    EXPECT_FALSE(RegexSet<char>(vector<string>({"a", "b"})).longest_match(string("c")).has_value());
+}
+
+TEST(RegexSet, agrees_with_single_patterns)
+{
+    vector<string> patterns = {
+        "ab*",
+        "(a|b)*abb",
+        "b+",
+        "[ab]c",
+        "(!ab)",
+        "a{2,3}",
+    };
+    RegexSet<char> set(patterns);
+    vector<DFAMatcher<char>> singles;
+    for (auto& re : patterns)
+        singles.emplace_back(vector<char>(re.begin(), re.end()));
+
+    std::default_random_engine generator(3);
+    std::uniform_int_distribution<int> length(0, 8);
+    std::uniform_int_distribution<int> pick(0, 2);
+    for (size_t i = 0; i < 2000; i++) {
+        string input;
+        for (int k = length(generator); k > 0; k--)
+            input.push_back("abc"[pick(generator)]);
+
+        vector<size_t> expected;
+        for (size_t j = 0; j < singles.size(); j++) {
+            if (singles[j].test(input))
+                expected.push_back(j);
+        }
+        ASSERT_EQ(set.matches(input), expected) << input;
+    }
+}
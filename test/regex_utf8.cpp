@@ -1,5 +1,7 @@
+#include "dcutf8.h"
 #include "regex/regex_utf8.h"
 #include <gtest/gtest.h>
+#include <random>
 #include <tuple>
 #include <vector>
 using namespace std;
@@ -52,6 +54,7 @@ TEST(regex_utf8, basic)
 
         auto matcher = RegExpUTF8(re);
         auto m2 = RegExpUTF8::compiled(re);
+        auto m3 = RegExpUTF8::compiled_bytes(re);
 
         for (auto& accept : accepts) {
             ASSERT_TRUE(matcher.test(accept.begin(), accept.end()))
@@ -61,6 +64,8 @@ TEST(regex_utf8, basic)
             ASSERT_TRUE(m2.test(accept.begin(), accept.end()))
                 << "DFA ACCEPT >> " << re << ": " << accept << endl
                 << m2.to_string() << endl;
+
+            ASSERT_TRUE(m3.test(accept)) << "BYTE DFA ACCEPT >> " << re << ": " << accept << endl;
         }
 
         for (auto& reject : rejects) {
@@ -69,6 +74,89 @@ TEST(regex_utf8, basic)
 
             ASSERT_FALSE(m2.test(reject.begin(), reject.end()))
                 << "DFA REJECT >> " << re << ": " << reject << endl;
+
+            ASSERT_FALSE(m3.test(reject)) << "BYTE DFA REJECT >> " << re << ": " << reject << endl;
+        }
+    }
+}
+
+TEST(regex_utf8, byte_dfa)
+{
+    vector<string> patterns = {
+        "[^\n]*",
+        "[a-zA-Z_][a-zA-Z0-9_]*",
+        "[^a-z]+",
+        "意见(反馈)?",
+        "[一-龥]+|[α-ω]+",
+        "L?\"([^\\\\\"\n]|(\\\\[^\n]))*\"",
+    };
+    vector<int> alphabet = {'a', 'z', 'A', '_', '0', '\n', '"', '\\', 0x7f,  0x80,   0x3b1,
+                            0x3c9, 0x7ff, 0x800, 0x4e00, 0x610f, 0x89c1, 0xffff, 0x10000, 0x10ffff};
+
+    for (auto& re : patterns) {
+        auto codepoint = RegExpUTF8::compiled(re);
+        auto bytes = RegExpUTF8::compiled_bytes(re);
+        ASSERT_TRUE(bytes.byte_mode());
+
+        std::default_random_engine generator(re.size());
+        std::uniform_int_distribution<int> length(0, 6);
+        std::uniform_int_distribution<size_t> pick(0, alphabet.size() - 1);
+        for (size_t i = 0; i < 1000; i++) {
+            vector<int> cps;
+            for (int k = length(generator); k > 0; k--)
+                cps.push_back(alphabet[pick(generator)]);
+            auto input = UTF8Encoder::strencode(cps.begin(), cps.end());
+
+            ASSERT_EQ(bytes.test(input), codepoint.test(input)) << re << ": " << input;
+            ASSERT_EQ(bytes.dead(), codepoint.dead()) << re << ": " << input;
         }
+
+        // malformed input never matches
+        ASSERT_FALSE(bytes.test(string("\xe6\x84")));
+        ASSERT_FALSE(bytes.test(string("\xff")));
+        ASSERT_TRUE(bytes.dead());
+    }
+}
+
+TEST(regex_utf8, bulk_decode)
+{
+    const vector<string> pieces = {"a", "int x = 0;\n", "意见", "é", "\x7f", "😀", "\u07ff"};
+    std::default_random_engine generator(7);
+    std::uniform_int_distribution<size_t> pick(0, pieces.size() - 1);
+    string text;
+    while (text.size() < 5000)
+        text += pieces[pick(generator)];
+
+    vector<int> expected;
+    UTF8Decoder bytewise;
+    for (auto c : text) {
+        auto cp = bytewise.decode(c);
+        if (cp.presented())
+            expected.push_back(cp.getval());
+    }
+    EXPECT_EQ(UTF8Decoder::strdecode(text), expected);
+
+    // the same code points when the bytes come in arbitrary spans
+    std::uniform_int_distribution<size_t> length(0, 40);
+    UTF8Decoder streaming;
+    vector<int> chars;
+    for (size_t i = 0; i < text.size();) {
+        const auto len = min(length(generator), text.size() - i);
+        vector<int> out(len);
+        out.resize(streaming.decode(span<const char>(text.data() + i, len), out.data()));
+        chars.insert(chars.end(), out.begin(), out.end());
+        i += len;
+    }
+    EXPECT_EQ(streaming.buflen(), 0u);
+    EXPECT_EQ(chars, expected);
+
+    const vector<string> bad_texts = {
+        "ab\x80", "\xe6\x84" "a", "\xc0\x80", "\xf8", string(20, 'a') + "\xff",
+        "\xed\xa0\x80", string(20, 'a') + "\xed\xbf\xbf"};
+    for (auto& bad : bad_texts) {
+        UTF8Decoder decoder;
+        vector<int> out(bad.size());
+        EXPECT_THROW(decoder.decode(span<const char>(bad), out.data()), std::runtime_error)
+            << bad;
     }
 }